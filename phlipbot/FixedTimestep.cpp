@@ -0,0 +1,85 @@
+#include "FixedTimestep.hpp"
+
+#include <algorithm>
+
+#include <doctest.h>
+
+namespace phlipbot
+{
+FixedTimestep::FixedTimestep(float const _step,
+                             uint32_t const _max_steps) noexcept
+  : step(_step), max_steps(_max_steps)
+{
+}
+
+uint32_t FixedTimestep::Advance(float const frame_dt)
+{
+  accumulator += std::max(frame_dt, 0.0f);
+
+  uint32_t steps = 0;
+  while (accumulator >= step && steps < max_steps) {
+    accumulator -= step;
+    ++steps;
+  }
+
+  // keep up to a step's worth, for the alpha
+  if (accumulator >= step) {
+    dropped += accumulator - step;
+    accumulator = step;
+  }
+  return steps;
+}
+
+void FixedTimestep::Reset()
+{
+  accumulator = 0.0f;
+  dropped = 0.0f;
+}
+
+namespace test
+{
+// steps and frame times are exact in binary, so the counts are too
+
+TEST_CASE("FixedTimestep runs a fixed number of steps per second")
+{
+  FixedTimestep timestep{0.125f, 4};
+
+  // fast frames run a step every few frames
+  uint32_t steps = 0;
+  for (int i = 0; i < 64; ++i) {
+    steps += timestep.Advance(1.0f / 64.0f);
+  }
+  CHECK(steps == 8);
+  CHECK(timestep.GetAlpha() == doctest::Approx(0.0f));
+
+  CHECK(timestep.Advance(1.0f / 64.0f) == 0);
+  CHECK(timestep.GetAlpha() == doctest::Approx(0.125f));
+
+  // slow frames run a few steps each
+  timestep.Reset();
+  CHECK(timestep.Advance(0.3125f) == 2);
+  CHECK(timestep.GetAlpha() == doctest::Approx(0.5f));
+  CHECK(timestep.Advance(0.3125f) == 3);
+  CHECK(timestep.GetAlpha() == doctest::Approx(0.0f));
+
+  // time doesn't run backwards
+  CHECK(timestep.Advance(-1.0f) == 0);
+  CHECK(timestep.GetAlpha() == doctest::Approx(0.0f));
+}
+
+TEST_CASE("FixedTimestep drops what it can't catch up on")
+{
+  FixedTimestep timestep{0.125f, 4};
+
+  CHECK(timestep.Advance(2.0f) == 4);
+  // left a whole step for the alpha, the rest's gone
+  CHECK(timestep.GetAlpha() == doctest::Approx(1.0f));
+  CHECK(timestep.dropped == doctest::Approx(1.375f));
+
+  // and it's back to a step per step
+  CHECK(timestep.Advance(0.125f) == 2);
+  CHECK(timestep.Advance(0.125f) == 1);
+  CHECK(timestep.dropped == doctest::Approx(1.375f));
+}
+}
+}
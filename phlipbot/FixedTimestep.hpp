@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace phlipbot
+{
+// Runs logic at a fixed rate from a variable frame rate. Each frame, Advance
+// adds the frame's time to an accumulator and says how many steps of
+// exactly step seconds to run. What's left over, as a fraction of a step, is
+// GetAlpha(), for interpolating between the last two steps' results.
+//
+// A frame slow enough to need more than max_steps runs max_steps and drops
+// the rest, so a long hitch (a loading screen, the debugger) doesn't turn
+// into a burst of steps trying to catch up.
+struct FixedTimestep {
+  explicit FixedTimestep(float const step, uint32_t const max_steps) noexcept;
+
+  uint32_t Advance(float const frame_dt);
+  void Reset();
+
+  float GetStep() const { return step; }
+  float GetAlpha() const { return accumulator / step; }
+
+  float const step;
+  uint32_t const max_steps;
+
+  // seconds of frame time dropped since the last Reset
+  float dropped{0.0f};
+
+private:
+  float accumulator{0.0f};
+};
+}
@@ -1,6 +1,8 @@
 #include "Gui.hpp"
 
 #include <Windows.h>
+#include <cfloat>
+#include <cstdio>
 #include <inttypes.h>
 
 #include <imgui.h>
@@ -9,6 +11,8 @@
 
 #include <boost/math/constants/constants.hpp>
 
+#include <glm/geometric.hpp>
+
 #include <hadesmem/detail/smart_handle.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/error.hpp>
@@ -20,6 +24,19 @@ using hadesmem::detail::SmartComHandle;
 using hadesmem::ErrorCodeWinHr;
 using hadesmem::ErrorString;
 
+namespace
+{
+// TODO(phlip9): configurable, along with the mmaps directory
+char const* const PathQueryLogPath = "C:\\MaNGOS\\data\\path_queries.bin";
+char const* const RouteTableDir = "C:\\MaNGOS\\data\\routes";
+char const* const NavTelemetryPath = "C:\\MaNGOS\\data\\nav_telemetry.bin";
+// every client in the same party opens the same formation store
+wchar_t const* const FormationName = L"party";
+
+// how many of the latest NavSamples the Navigation plots show
+size_t const NavPlotSamples = 300;
+}
+
 namespace phlipbot
 {
 bool& GetGuiIsVisible()
@@ -152,6 +169,10 @@ void Gui::RenderImGui()
           HADESMEM_DETAIL_TRACE_A(obj->ToString().c_str());
         }
       }
+      ImGui::Checkbox("Incremental Enumeration", &objmgr.incremental_enum);
+      ImGui::Text("%zu objects, %u created, %u removed last frame",
+                  objmgr.GetObjectCount(), objmgr.objs_created,
+                  objmgr.objs_removed);
     }
 
     if (ImGui::CollapsingHeader("Movement Testing")) {
@@ -165,7 +186,8 @@ void Gui::RenderImGui()
           auto player_pos = player->GetPosition();
           player_pos.x += ctm_dx;
           player_pos.y += ctm_dy;
-          player->ClickToMove(CtmType::Move, 0, player_pos, ctm_precision);
+          player_controller.commands.ClickToMove(CtmType::Move, 0, player_pos,
+                                                 ctm_precision);
         }
       }
 
@@ -180,6 +202,12 @@ void Gui::RenderImGui()
                     player_pos.y, player_pos.z);
       }
 
+      {
+        auto const& commands = player_controller.commands;
+        ImGui::Text("Movement Commands: %u asked for, %u calls, %u packets",
+                    commands.intents, commands.game_calls, commands.packets);
+      }
+
       ImGui::SliderFloat("Facing Direction", &facing_direction, 0.0f, two_pi);
       ImGui::InputFloat3("Facing Position",
                          reinterpret_cast<float*>(&facing_position), 2);
@@ -188,17 +216,24 @@ void Gui::RenderImGui()
                          ImGuiInputTextFlags_CharsHexadecimal);
 
       if (ImGui::Button("SetFacing")) {
-        if (o_player) {
-          o_player.value()->SetFacing(facing_direction);
-        }
+        player_controller.commands.SetFacing(facing_direction);
       }
 
       ImGui::Text("Facing PID Controller");
 
-      auto& facing_ctrl = player_controller.facing_controller;
-      ImGui::SliderFloat("P Gain", &facing_ctrl.gain_p, 0.0f, 1.0f);
-      ImGui::SliderFloat("I Gain", &facing_ctrl.gain_i, 0.0f, 1.0f);
-      ImGui::SliderFloat("D Gain", &facing_ctrl.gain_d, 0.0f, 1.0f);
+      // P, I and D for each way of moving
+      ImGui::SliderFloat3(
+        "Position Gains",
+        reinterpret_cast<float*>(&player_controller.position_gains), 0.0f,
+        2.0f);
+      ImGui::SliderFloat3(
+        "Pursuit Gains",
+        reinterpret_cast<float*>(&player_controller.pursuit_gains), 0.0f,
+        2.0f);
+      if (ImGui::Button("Reset Gains")) {
+        player_controller.position_gains = FacingGains::Position;
+        player_controller.pursuit_gains = FacingGains::Pursuit;
+      }
 
       bool on_change = false;
       on_change |= ImGui::RadioButton("Direction ", &facing_type,
@@ -257,27 +292,168 @@ void Gui::RenderImGui()
       ImGui::CheckboxFlags("All Flags", &input_flags, 0xFFFFFFFF);
 
       if (ImGui::Button("SetControlBits")) {
-        if (o_player) {
-          o_player.value()->SetControlBits(input_flags, ::GetTickCount());
-        }
+        player_controller.commands.SetControlBits(input_flags);
       }
       ImGui::SameLine();
       if (ImGui::Button("UnsetControlBits")) {
-        if (o_player) {
-          o_player.value()->UnsetControlBits(input_flags, ::GetTickCount());
-        }
+        player_controller.commands.UnsetControlBits(input_flags);
       }
     }
 
     if (ImGui::CollapsingHeader("Navigation")) {
       if (ImGui::InputFloat3("Destination",
                              reinterpret_cast<float*>(&nav_destination), 2)) {
+        player_nav.ClearChaseTarget();
         player_nav.SetDestination(nav_destination);
       }
 
+      if (ImGui::Button("Chase Target") && o_player.has_value()) {
+        Guid const target_guid = o_player.value()->GetTargetGuid();
+        if (target_guid != 0) {
+          player_nav.SetChaseTarget(target_guid);
+        }
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("Stop Chasing")) {
+        player_nav.ClearChaseTarget();
+      }
+      ImGui::SameLine();
+      ImGui::Checkbox("Predict Intercept", &player_nav.predict_intercept);
+      if (player_nav.chase_target != 0) {
+        auto const velocity =
+          player_nav.unit_tracker.GetVelocity(player_nav.chase_target);
+        ImGui::Text("Chasing 0x%016" PRIx64 ": %.1f yd/s, %u replans",
+                    player_nav.chase_target,
+                    velocity ? glm::length(velocity->xy) : 0.0f,
+                    player_nav.chase_replans);
+      }
+
       if (ImGui::Checkbox("Navigation Enabled", &player_nav_enabled)) {
         player_nav.SetEnabled(player_nav_enabled);
       }
+      ImGui::SameLine();
+      bool pursuit = player_nav.pursuit;
+      if (ImGui::Checkbox("Pure Pursuit", &pursuit)) {
+        player_nav.SetPursuit(pursuit);
+      }
+
+      auto& nav_worker = player_nav.nav_worker;
+      uint32_t const hits = nav_worker.GetStartPolyCacheHits();
+      uint32_t const misses = nav_worker.GetStartPolyCacheMisses();
+      ImGui::Text("Start Poly Cache: %.1f%% hits (%u hits, %u misses)",
+                  hits + misses ? 100.0f * hits / (hits + misses) : 0.0f,
+                  hits, misses);
+
+      if (ImGui::Button("Load Route Tables")) {
+        try {
+          nav_worker.LoadRouteTables(RouteTableDir);
+        } catch (...) {
+          HADESMEM_DETAIL_TRACE_FORMAT_A(
+            "Error: Failed to load route tables: %s",
+            boost::current_exception_diagnostic_information().c_str());
+        }
+      }
+      ImGui::SameLine();
+      ImGui::Text("%zu maps, %u routes followed",
+                  nav_worker.GetRouteTableCount(), nav_worker.GetRouteHits());
+
+      using FormationRole = PlayerNavigator::FormationRole;
+      bool formation_changed = false;
+      formation_changed |= ImGui::RadioButton(
+        "Solo", &formation_role, int(FormationRole::None));
+      ImGui::SameLine();
+      formation_changed |= ImGui::RadioButton(
+        "Lead", &formation_role, int(FormationRole::Leader));
+      ImGui::SameLine();
+      formation_changed |= ImGui::RadioButton(
+        "Follow", &formation_role, int(FormationRole::Follower));
+      formation_changed |= ImGui::InputFloat2(
+        "Right, Behind", reinterpret_cast<float*>(&formation_offset), 1);
+      if (formation_changed) {
+        try {
+          if (!formation_store && formation_role != 0) {
+            formation_store =
+              std::make_unique<SharedFormationPathStore>(FormationName);
+          }
+          player_nav.SetFormation(FormationRole(formation_role),
+                                  formation_store.get(), formation_offset);
+        } catch (...) {
+          formation_role = int(FormationRole::None);
+          HADESMEM_DETAIL_TRACE_FORMAT_A(
+            "Error: Failed to open the formation store: %s",
+            boost::current_exception_diagnostic_information().c_str());
+        }
+      }
+      if (player_nav.formation_role == FormationRole::Follower) {
+        ImGui::Text("%u leader paths followed", player_nav.formation_paths);
+      }
+
+      auto const& follower = player_nav.follower;
+      ImGui::Text("Path: segment %zu of %zu, %.1f yards off",
+                  follower.GetSegment(),
+                  follower.HasPath() ? follower.GetPath().size() - 1 : 0,
+                  follower.GetCrossTrack());
+      ImGui::Text("%u repairs, %u replans, %u forward toggles",
+                  player_nav.repairs, player_nav.replans,
+                  player_controller.forward_toggles);
+
+      auto& telemetry = player_nav.telemetry;
+      ImGui::Checkbox("Record Telemetry", &player_nav.telemetry_enabled);
+      ImGui::SameLine();
+      if (ImGui::Button("Dump Telemetry")) {
+        try {
+          telemetry.Dump(NavTelemetryPath);
+        } catch (...) {
+          HADESMEM_DETAIL_TRACE_FORMAT_A(
+            "Error: Failed to dump nav telemetry: %s",
+            boost::current_exception_diagnostic_information().c_str());
+        }
+      }
+      ImGui::SameLine();
+      ImGui::Text("%" PRIu64 " samples", telemetry.GetCount());
+
+      auto const samples = telemetry.Snapshot(NavPlotSamples);
+      if (!samples.empty()) {
+        int const count = static_cast<int>(samples.size());
+        ImVec2 const plot_size{0, 50};
+        NavSample const& last = samples.back();
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "%.2f yd", last.cross_track);
+        ImGui::PlotLines("Cross Track", &samples[0].cross_track, count, 0,
+                         overlay, 0.0f, FLT_MAX, plot_size,
+                         sizeof(NavSample));
+        snprintf(overlay, sizeof(overlay), "%.2f rad", last.facing_error);
+        ImGui::PlotLines("Facing Error", &samples[0].facing_error, count, 0,
+                         overlay, -two_pi / 2, two_pi / 2, plot_size,
+                         sizeof(NavSample));
+        snprintf(overlay, sizeof(overlay), "%.2f rad", last.facing_output);
+        ImGui::PlotLines("Facing Output", &samples[0].facing_output, count,
+                         0, overlay, FLT_MAX, FLT_MAX, plot_size,
+                         sizeof(NavSample));
+        snprintf(overlay, sizeof(overlay), "%.0f us", last.tick_us);
+        ImGui::PlotLines("Tick Time", &samples[0].tick_us, count, 0,
+                         overlay, 0.0f, FLT_MAX, plot_size,
+                         sizeof(NavSample));
+      }
+
+      auto const& walk_cache = player_nav.walk_cache;
+      ImGui::Text("Walkable Units: %zu of %zu (%u raycasts)",
+                  walk_cache.GetWalkableCount(), walk_cache.GetUnitCount(),
+                  walk_cache.GetRaycastCount());
+
+      auto& recorder = nav_worker.GetRecorder();
+      bool recording = recorder.IsOpen();
+      if (ImGui::Checkbox("Record Path Queries", &recording)) {
+        if (recording) {
+          recorder.Open(PathQueryLogPath);
+        } else {
+          recorder.Close();
+        }
+      }
+      if (recording) {
+        ImGui::SameLine();
+        ImGui::Text("%u recorded", recorder.GetCount());
+      }
     }
   }
   ImGui::End();
@@ -2,6 +2,7 @@
 
 #include <Shlwapi.h>
 #include <d3d9.h>
+#include <memory>
 #include <stdint.h>
 
 #include "ObjectManager.hpp"
@@ -55,6 +56,11 @@ public:
   vec3 nav_destination{};
   bool player_nav_enabled{false};
 
+  // opened the first time we join a formation
+  std::unique_ptr<FormationPathStore> formation_store;
+  int formation_role{0};
+  vec2 formation_offset{0.0f, 4.0f};
+
   uint32_t input_flags{0};
   bool control_toggle{false};
 };
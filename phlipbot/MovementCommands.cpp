@@ -0,0 +1,255 @@
+#include "MovementCommands.hpp"
+
+#include <cmath>
+
+#include <boost/math/constants/constants.hpp>
+
+#include <doctest.h>
+
+#include "navigation/MovementSim.hpp"
+
+using boost::math::float_constants::two_pi;
+
+namespace
+{
+struct ControlMoveFlag {
+  uint32_t control;
+  uint32_t move;
+};
+
+ControlMoveFlag const ControlMoveFlagPairs[] = {
+  {phlipbot::InputControlFlags::Forward, phlipbot::MovementFlags::Forward},
+  {phlipbot::InputControlFlags::AutoRun, phlipbot::MovementFlags::Forward},
+  {phlipbot::InputControlFlags::Backward, phlipbot::MovementFlags::Backward},
+  {phlipbot::InputControlFlags::StrafeLeft,
+   phlipbot::MovementFlags::StrafeLeft},
+  {phlipbot::InputControlFlags::StrafeRight,
+   phlipbot::MovementFlags::StrafeRight},
+  {phlipbot::InputControlFlags::TurnLeft, phlipbot::MovementFlags::TurnLeft},
+  {phlipbot::InputControlFlags::TurnRight,
+   phlipbot::MovementFlags::TurnRight},
+};
+
+// the control bits that move the player, rather than set how
+uint32_t const MovingControls =
+  phlipbot::InputControlFlags::Forward |
+  phlipbot::InputControlFlags::AutoRun |
+  phlipbot::InputControlFlags::Backward |
+  phlipbot::InputControlFlags::StrafeLeft |
+  phlipbot::InputControlFlags::StrafeRight |
+  phlipbot::InputControlFlags::TurnLeft |
+  phlipbot::InputControlFlags::TurnRight;
+
+// facings closer than this are the same
+float const FacingEpsilon = 1e-4f;
+}
+
+namespace phlipbot
+{
+uint32_t ControlMoveFlags(uint32_t const control_flags)
+{
+  uint32_t flags = 0;
+  for (auto const& pair : ControlMoveFlagPairs) {
+    if (control_flags & pair.control) {
+      flags |= pair.move;
+    }
+  }
+  return flags;
+}
+
+MovementCommands::MovementCommands(ObjectManager& om) noexcept : objmgr(om)
+{
+}
+
+void MovementCommands::SetFacing(float const _facing)
+{
+  ++intents;
+  facing = _facing;
+}
+
+void MovementCommands::SetControlBits(uint32_t const flags)
+{
+  ++intents;
+  set_bits |= flags;
+  unset_bits &= ~flags;
+}
+
+void MovementCommands::UnsetControlBits(uint32_t const flags)
+{
+  ++intents;
+  unset_bits |= flags;
+  set_bits &= ~flags;
+}
+
+void MovementCommands::ClickToMove(CtmType const ctm_type,
+                                   Guid const target_guid,
+                                   vec3 const& target_pos,
+                                   float const precision)
+{
+  ++intents;
+  click_to_move = ClickToMoveIntent{ctm_type, target_guid, target_pos,
+                                    precision};
+}
+
+float MovementCommands::GetFacing(WowPlayer const& player) const
+{
+  return facing ? *facing : player.GetMovement()->facing;
+}
+
+uint32_t MovementCommands::GetMoveFlags(WowPlayer const& player) const
+{
+  uint32_t flags = player.GetMovement()->move_flags;
+  flags |= ControlMoveFlags(set_bits);
+  flags &= ~ControlMoveFlags(unset_bits);
+  return flags;
+}
+
+void MovementCommands::Flush(uint32_t const timestamp)
+{
+  auto const o_player = objmgr.GetPlayer();
+  if (!o_player.has_value()) {
+    Clear();
+    return;
+  }
+  auto* player = o_player.get();
+  auto* cmovement = player->GetMovement();
+
+  if (click_to_move) {
+    // turns the player and tells the server itself
+    player->ClickToMove(click_to_move->ctm_type, click_to_move->target_guid,
+                        click_to_move->target_pos, click_to_move->precision);
+    ++game_calls;
+    ++packets;
+    facing_unsent = false;
+  } else if (facing &&
+             std::abs(std::remainder(*facing - cmovement->facing, two_pi)) >
+               FacingEpsilon) {
+    player->SetFacing(*facing);
+    ++game_calls;
+    facing_unsent = true;
+  }
+
+  // only the bits that'd change anything, or that we can't tell about
+  uint32_t to_set = 0;
+  uint32_t to_unset = 0;
+  uint32_t const move_flags = cmovement->move_flags;
+  for (uint32_t bit = 1; bit != 0; bit <<= 1) {
+    uint32_t const move_flag = ControlMoveFlags(bit);
+    if ((set_bits & bit) && (!move_flag || !(move_flags & move_flag))) {
+      to_set |= bit;
+    }
+    if ((unset_bits & bit) && (!move_flag || (move_flags & move_flag))) {
+      to_unset |= bit;
+    }
+  }
+  if (to_set) {
+    player->SetControlBits(to_set, timestamp);
+    ++game_calls;
+  }
+  if (to_unset) {
+    player->UnsetControlBits(to_unset, timestamp);
+    ++game_calls;
+  }
+
+  // starting, stopping, and the heartbeats in between all carry the facing
+  bool const moving =
+    (cmovement->move_flags & ControlMoveFlags(MovingControls)) != 0;
+  if (moving || ((to_set | to_unset) & MovingControls)) {
+    facing_unsent = false;
+  } else if (facing_unsent &&
+             (!last_facing_packet ||
+              timestamp - *last_facing_packet >= heartbeat_interval)) {
+    player->SendUpdateMovement(timestamp, MovementOpCode::setFacing);
+    ++game_calls;
+    ++packets;
+    facing_unsent = false;
+    last_facing_packet = timestamp;
+  }
+
+  Clear();
+}
+
+void MovementCommands::Clear()
+{
+  facing.reset();
+  click_to_move.reset();
+  set_bits = 0;
+  unset_bits = 0;
+}
+
+namespace test
+{
+TEST_CASE("MovementCommands coalesces a frame's commands")
+{
+  SimObjectManager objmgr{0};
+  SimPlayer& player = objmgr.GetSimPlayer();
+  CMovementData& movement = *player.GetMovement();
+  MovementCommands commands{objmgr};
+
+  // the last facing asked for, once
+  commands.SetFacing(1.0f);
+  commands.SetFacing(2.0f);
+  CHECK(commands.GetFacing(player) == doctest::Approx(2.0f));
+  CHECK(movement.facing == doctest::Approx(0.0f));
+  commands.Flush(1000);
+  CHECK(movement.facing == doctest::Approx(2.0f));
+  CHECK(player.set_facing_calls == 1);
+  CHECK(player.movement_packets == 1);
+
+  // nothing for a facing we've already got
+  commands.SetFacing(2.0f);
+  commands.Flush(2000);
+  CHECK(player.set_facing_calls == 1);
+
+  // the last of set and unset wins
+  commands.SetControlBits(InputControlFlags::Forward);
+  commands.UnsetControlBits(InputControlFlags::Forward);
+  commands.SetControlBits(InputControlFlags::Forward |
+                          InputControlFlags::TurnLeft);
+  CHECK(commands.GetMoveFlags(player) ==
+        (MovementFlags::Forward | MovementFlags::TurnLeft));
+  commands.Flush(3000);
+  CHECK(movement.move_flags ==
+        (MovementFlags::Forward | MovementFlags::TurnLeft));
+
+  // nothing for bits that are already how we want them
+  uint32_t const calls = commands.game_calls;
+  commands.SetControlBits(InputControlFlags::Forward);
+  commands.UnsetControlBits(InputControlFlags::Backward);
+  commands.Flush(4000);
+  CHECK(commands.game_calls == calls);
+  CHECK(commands.intents == 8);
+}
+
+TEST_CASE("MovementCommands rate limits facing packets")
+{
+  SimObjectManager objmgr{0};
+  SimPlayer& player = objmgr.GetSimPlayer();
+  MovementCommands commands{objmgr};
+  commands.heartbeat_interval = 100;
+
+  // standing and turning every 10ms, a packet every 100ms
+  for (uint32_t t = 1000; t < 2000; t += 10) {
+    commands.SetFacing(t * 0.001f);
+    commands.Flush(t);
+  }
+  CHECK(player.set_facing_calls == 100);
+  CHECK(player.movement_packets == 10);
+
+  // the last facing still gets sent once it's allowed to
+  commands.Flush(2090);
+  CHECK(player.movement_packets == 11);
+  commands.Flush(2200);
+  CHECK(player.movement_packets == 11);
+
+  // running, the client's packets carry it
+  commands.SetControlBits(InputControlFlags::Forward);
+  commands.Flush(3000);
+  for (uint32_t t = 3010; t < 4000; t += 10) {
+    commands.SetFacing(t * 0.001f);
+    commands.Flush(t);
+  }
+  CHECK(player.movement_packets == 11);
+}
+}
+}
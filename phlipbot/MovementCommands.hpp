@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <boost/optional.hpp>
+
+#include "ObjectManager.hpp"
+#include "wow_constants.hpp"
+
+namespace phlipbot
+{
+// The MovementFlags the client sets for the InputControlFlags in
+// control_flags.
+uint32_t ControlMoveFlags(uint32_t const control_flags);
+
+// Collects what everything wants the player to do over a frame, and makes
+// as few calls into the client as it takes once at the end of it.
+//
+// Facing and click to move are whatever was asked for last, and click to
+// move wins over facing since it turns the player itself. Control bits are
+// set or unset by whichever was asked for last too, and only the ones the
+// player's movement flags don't already agree with are sent, all in one
+// call each way.
+//
+// CMovement::SetFacing doesn't tell the server, and standing still the
+// client doesn't either, so a standing player's new facing is sent as a
+// MSG_MOVE_SET_FACING, at most every heartbeat_interval ms. Running, the
+// client's own heartbeats and start/stop packets carry it.
+struct MovementCommands {
+  explicit MovementCommands(ObjectManager& om) noexcept;
+
+  MovementCommands(MovementCommands const&) = delete;
+  MovementCommands& operator=(MovementCommands const&) = delete;
+
+  void SetFacing(float const facing);
+  void SetControlBits(uint32_t const flags);
+  void UnsetControlBits(uint32_t const flags);
+  void ClickToMove(CtmType const ctm_type,
+                   Guid const target_guid,
+                   vec3 const& target_pos,
+                   float const precision = 2.0f);
+
+  // The player's facing and movement flags as they'll be after the next
+  // Flush, for deciding what else to ask for before it.
+  float GetFacing(WowPlayer const& player) const;
+  uint32_t GetMoveFlags(WowPlayer const& player) const;
+
+  // Make the calls, timestamp is the client's, as ::GetTickCount().
+  void Flush(uint32_t const timestamp);
+  // Forget everything asked for since the last Flush.
+  void Clear();
+
+  ObjectManager& objmgr;
+
+  uint32_t heartbeat_interval{250};
+
+  // everything asked for, and the calls into the client and packets it
+  // took, since they were last reset
+  uint32_t intents{0};
+  uint32_t game_calls{0};
+  uint32_t packets{0};
+
+private:
+  struct ClickToMoveIntent {
+    CtmType ctm_type;
+    Guid target_guid;
+    vec3 target_pos;
+    float precision;
+  };
+
+  boost::optional<float> facing;
+  boost::optional<ClickToMoveIntent> click_to_move;
+  uint32_t set_bits{0};
+  uint32_t unset_bits{0};
+
+  // a facing the server's yet to hear about, and when it last did
+  bool facing_unsent{false};
+  boost::optional<uint32_t> last_facing_packet;
+};
+}
@@ -2,13 +2,13 @@
 
 #include <inttypes.h>
 #include <memory>
+#include <vector>
 
 #include <hadesmem/detail/trace.hpp>
 
-// TODO(phlip9): possibe to use boost::bind to bind object manager instance
-//               to EnumVisibleObjects_Callback?
-// TODO(phlip9): Reverse ClntObjMgr struct and iterate over it directly so
-//               we can remove the global singleton.
+#include <doctest.h>
+
+#include "bench_helpers.hpp"
 
 using std::make_unique;
 using std::unique_ptr;
@@ -25,6 +25,7 @@ using phlipbot::WowItem;
 using phlipbot::WowObject;
 using phlipbot::WowPlayer;
 using phlipbot::WowUnit;
+using phlipbot::vec3;
 using phlipbot::memory::ReadRaw;
 
 namespace FunctionOffsets = phlipbot::offsets::FunctionOffsets;
@@ -34,34 +35,8 @@ using ClntObjMgr__GetActivePlayer_Fn = Guid(__stdcall*)();
 
 using ClntObjMgr__GetMapId_Fn = uint32_t(__stdcall*)();
 
-using ClntObjMgr__ObjectPtr_Fn = uintptr_t(__fastcall*)(uint32_t filter,
-                                                        const char* fileName,
-                                                        Guid guid,
-                                                        uint32_t lineNum);
-
-using ClntObjMgr__EnumVisibleObjects_Callback_Fn =
-  uint32_t(__thiscall*)(uint32_t filter, Guid guid);
-
-using ClntObjMgr__EnumVisibleObjects_Fn = uint32_t(__fastcall*)(
-  ClntObjMgr__EnumVisibleObjects_Callback_Fn callback, uint32_t filter);
-
 namespace
 {
-// A hack-ish way of passing the ObjectManager instance to
-// ClntObjMgr__EnumVisibleObjects_Callback.
-// NOTE: DO NOT USE FOR ANY OTHER REASON
-// NOTE: Obviously not threadsafe
-ObjectManager*& GetEnumVisibleCtxt() noexcept
-{
-  static ObjectManager* objmgr = nullptr;
-  return objmgr;
-}
-
-void SetEnumVisibleCtxt(ObjectManager* objmgr) noexcept
-{
-  GetEnumVisibleCtxt() = objmgr;
-}
-
 inline Guid ClntObjMgr__GetActivePlayer()
 {
   auto const getActivePlayerFn =
@@ -79,94 +54,27 @@ inline uint32_t ClntObjMgr__GetMapId()
   return (getMapIdFn)();
 }
 
-inline uintptr_t ClntObjMgr__ObjectPtr(uint32_t filter, Guid guid)
+// the client's object manager, null until it's made one
+inline uintptr_t ClntObjMgr()
 {
-  auto const objectPtrFn = reinterpret_cast<ClntObjMgr__ObjectPtr_Fn>(
-    FunctionOffsets::ClntObjMgr__ObjectPtr);
-
-  return (objectPtrFn)(filter, nullptr, guid, 0);
+  return ReadRaw<uintptr_t>(phlipbot::offsets::Data::ClntObjMgr);
 }
 
-struct ThisT {
-  uint32_t __thiscall ClntObjMgr__EnumVisibleObjects_Callback(Guid guid)
-  {
-    auto const filter = reinterpret_cast<uint32_t>(this);
-
-    if (!guid) {
-      // stop enumerating
-      return 0;
-    }
-
-    uintptr_t const obj_ptr = ClntObjMgr__ObjectPtr(filter, guid);
-    if (!obj_ptr) {
-      // stop enumerating
-      return 0;
-    }
-
-    uintptr_t const obj_type_ptr = obj_ptr + ObjectManagerOffsets::ObjType;
-    uint8_t const obj_type_raw = ReadRaw<uint8_t>(obj_type_ptr);
-    ObjectType const obj_type = static_cast<ObjectType>(obj_type_raw);
-
-    // HADESMEM_DETAIL_TRACE_FORMAT_A("guid: %#018" PRIx64 ", obj_ptr: %#10"
-    //                               PRIx32 ", obj_type_raw: %#4" PRIx8,
-    //                               guid, obj_ptr, obj_type_raw);
-
-    HADESMEM_DETAIL_ASSERT(obj_type_raw <=
-                           static_cast<uint8_t>(ObjectType::CORPSE));
-
-    std::unique_ptr<WowObject> obj = nullptr;
-
-    if (obj_type == ObjectType::NONE) {
-      obj = make_unique<WowObject>(guid, obj_ptr);
-    } else if (obj_type == ObjectType::ITEM) {
-      obj = make_unique<WowItem>(guid, obj_ptr);
-    } else if (obj_type == ObjectType::CONTAINER) {
-      obj = make_unique<WowContainer>(guid, obj_ptr);
-    } else if (obj_type == ObjectType::UNIT) {
-      obj = make_unique<WowUnit>(guid, obj_ptr);
-    } else if (obj_type == ObjectType::PLAYER) {
-      obj = make_unique<WowPlayer>(guid, obj_ptr);
-    } else if (obj_type == ObjectType::GAMEOBJ) {
-      obj = make_unique<WowGameObject>(guid, obj_ptr);
-    } else if (obj_type == ObjectType::DYNOBJ) {
-      // skip
-    } else if (obj_type == ObjectType::CORPSE) {
-      // skip
-    } else {
-      // unreachable
-    }
-
-    if (obj) {
-      // Retrieve the callback context
-      auto* objmgr = GetEnumVisibleCtxt();
-      HADESMEM_DETAIL_ASSERT(objmgr && "SetEnumVisibleCtxt must called before "
-                                       "calling into "
-                                       "ClntObjMgr__EnumVisibleObjects");
-      // cache takes ownership of handle
-      objmgr->guid_obj_cache.emplace(guid, std::move(obj));
-    }
-
-    // continue
-    return 1;
-  }
-};
-
-inline uint32_t ClntObjMgr__EnumVisibleObjects(uint32_t filter)
+// the position an ObjectSlot caches, for the types that have one
+vec3 ReadPosition(uintptr_t const obj_ptr, ObjectType const obj_type)
 {
-  auto const enumVisibleObjectsFn =
-    reinterpret_cast<ClntObjMgr__EnumVisibleObjects_Fn>(
-      FunctionOffsets::ClntObjMgr__EnumVisibleObjects);
-
-  auto original_callback_ptr = &ThisT::ClntObjMgr__EnumVisibleObjects_Callback;
-  auto const callback_ptr =
-    *reinterpret_cast<ClntObjMgr__EnumVisibleObjects_Callback_Fn*>(
-      &original_callback_ptr);
-
-  return (enumVisibleObjectsFn)(callback_ptr, filter);
+  switch (obj_type) {
+  case ObjectType::UNIT:
+  case ObjectType::PLAYER:
+    return WowUnit::MovementAt(obj_ptr)->position;
+  case ObjectType::GAMEOBJ:
+    return WowGameObject::PositionAt(obj_ptr);
+  default:
+    return vec3{0, 0, 0};
+  }
 }
 }
 
-
 namespace phlipbot
 {
 Guid ObjectManager::GetPlayerGuid() const
@@ -192,62 +100,424 @@ optional<WowPlayer*> ObjectManager::GetPlayer()
 
 void ObjectManager::EnumVisibleObjects()
 {
-  // reset the guid to obj cache
-  guid_obj_cache.clear();
+  BeginEnum();
 
   // Add all visible objects to the cache
-  SetEnumVisibleCtxt(this);
-  ClntObjMgr__EnumVisibleObjects(ObjectFilter::ALL);
-  SetEnumVisibleCtxt(nullptr);
+  uintptr_t const clnt_obj_mgr = ClntObjMgr();
+  if (clnt_obj_mgr) {
+    ForEachClientObject(
+      ReadRaw<uintptr_t>(clnt_obj_mgr + ObjectManagerOffsets::FirstObj),
+      [this](Guid const guid, uintptr_t const obj_ptr,
+             ObjectType const obj_type) {
+        SeeObject(guid, obj_ptr, obj_type);
+      });
+  }
+
+  EndEnum();
+}
+
+void ObjectManager::BeginEnum()
+{
+  ++enum_generation;
+  objs_created = 0;
+  objs_removed = 0;
+
+  if (!incremental_enum) {
+    objs_removed = static_cast<uint32_t>(slots.size());
+    slots.clear();
+    type_begin.fill(0);
+    slot_index.clear();
+  }
+}
+
+void ObjectManager::SeeObject(Guid const guid,
+                              uintptr_t const obj_ptr,
+                              ObjectType const obj_type)
+{
+  // still the same object in the client, nothing to do
+  auto const it = slot_index.find(guid);
+  if (it != slot_index.end() && slots[it->second].base_ptr == obj_ptr) {
+    ObjectSlot& slot = slots[it->second];
+    slot.generation = enum_generation;
+    slot.position = ReadPosition(obj_ptr, slot.type);
+    return;
+  }
+
+  std::unique_ptr<WowObject> obj = nullptr;
+
+  if (obj_type == ObjectType::NONE) {
+    obj = make_unique<WowObject>(guid, obj_ptr);
+  } else if (obj_type == ObjectType::ITEM) {
+    obj = make_unique<WowItem>(guid, obj_ptr);
+  } else if (obj_type == ObjectType::CONTAINER) {
+    obj = make_unique<WowContainer>(guid, obj_ptr);
+  } else if (obj_type == ObjectType::UNIT) {
+    obj = make_unique<WowUnit>(guid, obj_ptr);
+  } else if (obj_type == ObjectType::PLAYER) {
+    obj = make_unique<WowPlayer>(guid, obj_ptr);
+  } else if (obj_type == ObjectType::GAMEOBJ) {
+    obj = make_unique<WowGameObject>(guid, obj_ptr);
+  } else if (obj_type == ObjectType::DYNOBJ) {
+    // skip
+  } else if (obj_type == ObjectType::CORPSE) {
+    // skip
+  } else {
+    // unreachable
+  }
+
+  if (!obj) {
+    // skipped, and whatever was here before it is swept
+    return;
+  }
+
+  // cache takes ownership of handle
+  InsertSlot(ObjectSlot{guid, obj_ptr, obj_type, enum_generation,
+                        ReadPosition(obj_ptr, obj_type), std::move(obj)});
+  ++objs_created;
+}
+
+void ObjectManager::EndEnum()
+{
+  // from the back, so the slots EraseSlot moves down are ones already seen
+  for (size_t i = slots.size(); i-- > 0;) {
+    if (slots[i].generation != enum_generation) {
+      EraseSlot(i);
+      ++objs_removed;
+    }
+  }
+}
+
+void ObjectManager::AddObject(std::unique_ptr<WowObject> obj)
+{
+  Guid const guid = obj->guid;
+  uintptr_t const base_ptr = obj->base_ptr;
+  ObjectType const obj_type = obj->GetObjectType();
+  InsertSlot(ObjectSlot{guid, base_ptr, obj_type, enum_generation,
+                        ReadPosition(base_ptr, obj_type), std::move(obj)});
+}
+
+void ObjectManager::RefreshObjects()
+{
+  for (ObjectSlot& slot : slots) {
+    slot.position = ReadPosition(slot.base_ptr, slot.type);
+  }
+}
+
+void ObjectManager::RemoveObject(Guid const guid)
+{
+  auto const it = slot_index.find(guid);
+  if (it != slot_index.end()) {
+    EraseSlot(it->second);
+  }
+}
+
+void ObjectManager::InsertSlot(ObjectSlot slot)
+{
+  auto const it = slot_index.find(slot.guid);
+  if (it != slot_index.end()) {
+    EraseSlot(it->second);
+  }
+
+  // Make room at the end of the slot's group: the group after it gives up
+  // its first slot to the end of the one after that, and so on to the end.
+  size_t const type = static_cast<size_t>(slot.type);
+  slots.emplace_back();
+  for (size_t t = NumObjectTypes - 1; t > type; --t) {
+    if (type_begin[t] != type_begin[t + 1]) {
+      MoveSlot(type_begin[t], type_begin[t + 1]);
+    }
+    ++type_begin[t + 1];
+  }
+
+  size_t const index = type_begin[type + 1]++;
+  slot_index[slot.guid] = index;
+  slots[index] = std::move(slot);
+}
+
+void ObjectManager::EraseSlot(size_t const index)
+{
+  slot_index.erase(slots[index].guid);
+
+  // InsertSlot backwards: the hole's filled by the last slot of its group,
+  // that one's by the last of the next group, and so on to the end.
+  size_t hole = index;
+  for (size_t t = static_cast<size_t>(slots[index].type); t < NumObjectTypes;
+       ++t) {
+    size_t const last = --type_begin[t + 1];
+    if (last != hole) {
+      MoveSlot(last, hole);
+      hole = last;
+    }
+  }
+
+  HADESMEM_DETAIL_ASSERT(hole == slots.size() - 1);
+  slots.pop_back();
+}
+
+void ObjectManager::MoveSlot(size_t const from, size_t const to)
+{
+  slots[to] = std::move(slots[from]);
+  slot_index[slots[to].guid] = to;
 }
 
 optional<WowObject*> ObjectManager::GetObjByGuid(Guid const guid)
 {
   // check guid obj cache
-  auto obj_iter = guid_obj_cache.find(guid);
-  if (obj_iter != end(guid_obj_cache) && obj_iter->second) {
-    return obj_iter->second.get();
+  auto const it = slot_index.find(guid);
+  if (it != slot_index.end()) {
+    return slots[it->second].obj.get();
   }
 
   // no obj with this guid
   return none;
 }
 
-template <>
-bool ObjectManager::is_obj_type<WowObject>(WowObject const* obj)
+namespace test
+{
+namespace
 {
-  return obj->GetObjectType() == ObjectType::NONE;
+// a stand in for an object in the client's memory, and its link in the
+// object list
+struct FakeObj {
+  explicit FakeObj(ObjectType const type, Guid const guid = 0)
+  {
+    bytes[ObjectManagerOffsets::ObjType] = static_cast<unsigned char>(type);
+    memory::WriteRaw(ptr() + ObjectManagerOffsets::CurObjGuid, guid);
+    Link(nullptr);
+  }
+  uintptr_t ptr() const { return reinterpret_cast<uintptr_t>(bytes); }
+  void Link(FakeObj const* next)
+  {
+    // the client ends the list with a tagged pointer
+    uintptr_t const next_ptr = next ? next->ptr() : (ptr() | 1);
+    memory::WriteRaw(ptr() + ObjectManagerOffsets::NextObj, next_ptr);
+  }
+
+  // as far as a unit's movement data
+  alignas(8) unsigned char bytes[0x1000] = {};
+};
 }
 
-template <>
-bool ObjectManager::is_obj_type<WowGameObject>(WowObject const* obj)
+TEST_CASE("ForEachClientObject walks the client's object list")
 {
-  return obj->GetObjectType() == ObjectType::GAMEOBJ;
+  FakeObj player{ObjectType::PLAYER, 1};
+  FakeObj unit{ObjectType::UNIT, 2};
+  FakeObj const item{ObjectType::ITEM, 3};
+  player.Link(&unit);
+  unit.Link(&item);
+
+  std::vector<Guid> guids;
+  ForEachClientObject(player.ptr(), [&](Guid const guid,
+                                        uintptr_t const obj_ptr,
+                                        ObjectType const obj_type) {
+    guids.push_back(guid);
+    if (guid == 2) {
+      CHECK(obj_ptr == unit.ptr());
+      CHECK(obj_type == ObjectType::UNIT);
+    }
+  });
+  CHECK(guids == std::vector<Guid>{1, 2, 3});
+
+  ObjectManager objmgr;
+  objmgr.BeginEnum();
+  ForEachClientObject(unit.ptr(),
+                      [&](Guid const guid, uintptr_t const obj_ptr,
+                          ObjectType const obj_type) {
+                        objmgr.SeeObject(guid, obj_ptr, obj_type);
+                      });
+  objmgr.EndEnum();
+  CHECK(objmgr.GetObjectCount() == 2);
+  CHECK(objmgr.GetObjByGuid(3).value()->base_ptr == item.ptr());
+
+  size_t calls = 0;
+  ForEachClientObject(0, [&](Guid, uintptr_t, ObjectType) { ++calls; });
+  CHECK(calls == 0);
 }
 
-template <>
-bool ObjectManager::is_obj_type<WowItem>(WowObject const* obj)
+TEST_CASE("ObjectManager keeps objects across enumerations")
 {
-  return obj->GetObjectType() == ObjectType::ITEM;
+  ObjectManager objmgr;
+  FakeObj const unit{ObjectType::UNIT};
+  FakeObj const gameobj{ObjectType::GAMEOBJ};
+  FakeObj const dynobj{ObjectType::DYNOBJ};
+  FakeObj const respawned{ObjectType::UNIT};
+
+  objmgr.BeginEnum();
+  objmgr.SeeObject(10, unit.ptr(), ObjectType::UNIT);
+  objmgr.SeeObject(11, gameobj.ptr(), ObjectType::GAMEOBJ);
+  objmgr.SeeObject(12, dynobj.ptr(), ObjectType::DYNOBJ);
+  objmgr.EndEnum();
+  CHECK(objmgr.objs_created == 2);
+  CHECK(objmgr.GetObjectCount() == 2);
+  CHECK(!objmgr.GetObjByGuid(12));
+  WowObject* const obj = objmgr.GetObjByGuid(10).value();
+
+  // the same unit is the same pointer, the game object's gone
+  objmgr.BeginEnum();
+  objmgr.SeeObject(10, unit.ptr(), ObjectType::UNIT);
+  objmgr.EndEnum();
+  CHECK(objmgr.objs_created == 0);
+  CHECK(objmgr.objs_removed == 1);
+  CHECK(objmgr.GetObjByGuid(10).value() == obj);
+  CHECK(!objmgr.GetObjByGuid(11));
+
+  // a new object in the client is a new one here too
+  objmgr.BeginEnum();
+  objmgr.SeeObject(10, respawned.ptr(), ObjectType::UNIT);
+  objmgr.EndEnum();
+  CHECK(objmgr.objs_created == 1);
+  CHECK(objmgr.GetObjByGuid(10).value()->base_ptr == respawned.ptr());
+
+  size_t units = 0;
+  for (auto* u : objmgr.IterObjs<WowUnit>()) {
+    units += u->guid == 10;
+  }
+  CHECK(units == 1);
+
+  // or every time, without incremental_enum
+  objmgr.incremental_enum = false;
+  objmgr.BeginEnum();
+  objmgr.SeeObject(10, respawned.ptr(), ObjectType::UNIT);
+  objmgr.EndEnum();
+  CHECK(objmgr.objs_created == 1);
+  CHECK(objmgr.objs_removed == 1);
 }
 
-template <>
-bool ObjectManager::is_obj_type<WowContainer>(WowObject const* obj)
+TEST_CASE("ObjectManager groups objects by type")
 {
-  return obj->GetObjectType() == ObjectType::CONTAINER;
+  ObjectManager objmgr;
+  std::vector<std::unique_ptr<FakeObj>> fakes;
+  auto const see = [&](Guid const guid, ObjectType const type) {
+    fakes.push_back(std::make_unique<FakeObj>(type, guid));
+    objmgr.SeeObject(guid, fakes.back()->ptr(), type);
+  };
+  auto const see_again = [&](Guid const guid) {
+    FakeObj const& fake = *fakes[guid - 1];
+    objmgr.SeeObject(guid, fake.ptr(),
+                     static_cast<ObjectType>(
+                       fake.bytes[ObjectManagerOffsets::ObjType]));
+  };
+
+  // interleaved, as the client lists them
+  objmgr.BeginEnum();
+  for (Guid guid = 1; guid <= 30; ++guid) {
+    ObjectType const types[] = {ObjectType::ITEM, ObjectType::UNIT,
+                                ObjectType::GAMEOBJ, ObjectType::PLAYER,
+                                ObjectType::CONTAINER};
+    see(guid, types[guid % 5]);
+  }
+  objmgr.EndEnum();
+  CHECK(objmgr.GetObjectCount() == 30);
+
+  auto const check_groups = [&]() {
+    size_t count = 0;
+    for (auto type : {ObjectType::NONE, ObjectType::ITEM,
+                      ObjectType::CONTAINER, ObjectType::UNIT,
+                      ObjectType::PLAYER, ObjectType::GAMEOBJ}) {
+      for (auto const& slot : objmgr.GetSlots(type)) {
+        CHECK(slot.type == type);
+        CHECK(slot.obj->GetObjectType() == type);
+        CHECK(objmgr.GetObjByGuid(slot.guid).value() == slot.obj.get());
+        ++count;
+      }
+    }
+    CHECK(count == objmgr.GetObjectCount());
+  };
+  check_groups();
+
+  size_t units = 0;
+  for (WowUnit* unit : objmgr.IterObjs<WowUnit>()) {
+    CHECK(unit->guid % 5 == 1);
+    ++units;
+  }
+  CHECK(units == 6);
+
+  // every other object goes, from every group
+  objmgr.BeginEnum();
+  for (Guid guid = 2; guid <= 30; guid += 2) {
+    see_again(guid);
+  }
+  objmgr.EndEnum();
+  CHECK(objmgr.objs_removed == 15);
+  CHECK(objmgr.GetObjectCount() == 15);
+  CHECK(!objmgr.GetObjByGuid(1));
+  check_groups();
+
+  // and new ones join the right group
+  objmgr.BeginEnum();
+  for (Guid guid = 2; guid <= 30; guid += 2) {
+    see_again(guid);
+  }
+  see(31, ObjectType::UNIT);
+  see(32, ObjectType::NONE);
+  objmgr.EndEnum();
+  CHECK(objmgr.GetObjectCount() == 17);
+  check_groups();
 }
 
-template <>
-bool ObjectManager::is_obj_type<WowUnit>(WowObject const* obj)
+TEST_CASE("ObjectManager caches where objects are")
 {
-  return obj->GetObjectType() == ObjectType::UNIT;
+  ObjectManager objmgr;
+  FakeObj const unit{ObjectType::UNIT, 1};
+  FakeObj const item{ObjectType::ITEM, 2};
+  CMovementData* const movement = WowUnit::MovementAt(unit.ptr());
+  movement->position = vec3{1, 2, 3};
+
+  objmgr.BeginEnum();
+  objmgr.SeeObject(1, unit.ptr(), ObjectType::UNIT);
+  objmgr.SeeObject(2, item.ptr(), ObjectType::ITEM);
+  objmgr.EndEnum();
+  REQUIRE(objmgr.GetSlots(ObjectType::UNIT).size() == 1);
+  CHECK(objmgr.GetSlots(ObjectType::UNIT).front().position == vec3{1, 2, 3});
+  CHECK(objmgr.GetSlots(ObjectType::ITEM).front().position == vec3{0, 0, 0});
+
+  // as of the last enumeration
+  movement->position = vec3{4, 5, 6};
+  CHECK(objmgr.GetSlots(ObjectType::UNIT).front().position == vec3{1, 2, 3});
+  objmgr.BeginEnum();
+  objmgr.SeeObject(1, unit.ptr(), ObjectType::UNIT);
+  objmgr.EndEnum();
+  CHECK(objmgr.objs_created == 0);
+  CHECK(objmgr.GetSlots(ObjectType::UNIT).front().position == vec3{4, 5, 6});
+
+  // or a refresh
+  movement->position = vec3{7, 8, 9};
+  objmgr.RefreshObjects();
+  CHECK(objmgr.GetSlots(ObjectType::UNIT).front().position == vec3{7, 8, 9});
 }
 
-template <>
-bool ObjectManager::is_obj_type<WowPlayer>(WowObject const* obj)
+TEST_CASE("benchmark scanning units" * doctest::test_suite("benchmark") *
+          doctest::skip())
 {
-  return obj->GetObjectType() == ObjectType::PLAYER;
-}
+  // a busy town: as many items in bags as units around
+  ObjectManager objmgr;
+  std::vector<std::unique_ptr<FakeObj>> fakes;
+  objmgr.BeginEnum();
+  for (Guid guid = 1; guid <= 600; ++guid) {
+    ObjectType const type = guid % 2 ? ObjectType::UNIT : ObjectType::ITEM;
+    fakes.push_back(std::make_unique<FakeObj>(type, guid));
+    objmgr.SeeObject(guid, fakes.back()->ptr(), type);
+  }
+  objmgr.EndEnum();
 
-// TODO(phlip9): implement iterators specialized to units, gameobjects, etc...
+  double const us = bench::TimeMicros(100000, [&]() {
+    Guid sum = 0;
+    for (WowUnit* unit : objmgr.IterObjs<WowUnit>()) {
+      sum += unit->guid;
+    }
+    bench::DoNotOptimize(sum);
+  });
+  bench::Report("IterObjs<WowUnit> over 300 units", us);
+
+  double const enum_us = bench::TimeMicros(10000, [&]() {
+    objmgr.BeginEnum();
+    for (Guid guid = 1; guid <= 600; ++guid) {
+      ObjectType const type = guid % 2 ? ObjectType::UNIT : ObjectType::ITEM;
+      objmgr.SeeObject(guid, fakes[guid - 1]->ptr(), type);
+    }
+    objmgr.EndEnum();
+  });
+  bench::Report("enumerating 600 unchanged objects", enum_us);
+}
+}
 }
\ No newline at end of file
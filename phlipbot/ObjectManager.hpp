@@ -1,12 +1,16 @@
 #pragma once
 
-#include <unordered_map>
+#include <array>
+#include <memory>
+#include <stdint.h>
+#include <vector>
 
+#include <xmmintrin.h>
+
+#include <boost/container/flat_map.hpp>
 #include <boost/optional.hpp>
-#include <boost/range/adaptor/filtered.hpp>
-#include <boost/range/adaptor/map.hpp>
 #include <boost/range/adaptor/transformed.hpp>
-#include <boost/range/any_range.hpp>
+#include <boost/range/iterator_range.hpp>
 
 #include "WowContainer.hpp"
 #include "WowGameObject.hpp"
@@ -14,64 +18,184 @@
 #include "WowObject.hpp"
 #include "WowPlayer.hpp"
 #include "WowUnit.hpp"
+#include "memory.hpp"
 #include "wow_constants.hpp"
 
 namespace phlipbot
 {
+// Call f(guid, obj_ptr, obj_type) for every object in the client's object
+// list, starting from first_obj, the list's head in ClntObjMgr.
+//
+// Walks the list's links itself rather than calling into the client, with
+// the next object's header prefetched while f works on this one. Reentrant,
+// but the list's only safe to walk on the client's main thread.
+template <typename F>
+inline void ForEachClientObject(uintptr_t const first_obj, F&& f)
+{
+  namespace ObjectManagerOffsets = offsets::ObjectManagerOffsets;
+
+  // the end of the list is null, or a tagged pointer
+  uintptr_t obj_ptr = first_obj;
+  while (obj_ptr != 0 && (obj_ptr & 1) == 0) {
+    uintptr_t const next_ptr =
+      memory::ReadRaw<uintptr_t>(obj_ptr + ObjectManagerOffsets::NextObj);
+    if (next_ptr != 0 && (next_ptr & 1) == 0) {
+      _mm_prefetch(reinterpret_cast<char const*>(next_ptr), _MM_HINT_T0);
+      _mm_prefetch(reinterpret_cast<char const*>(
+                     next_ptr + ObjectManagerOffsets::NextObj),
+                   _MM_HINT_T0);
+    }
+
+    Guid const guid =
+      memory::ReadRaw<Guid>(obj_ptr + ObjectManagerOffsets::CurObjGuid);
+    uint8_t const obj_type_raw =
+      memory::ReadRaw<uint8_t>(obj_ptr + ObjectManagerOffsets::ObjType);
+    HADESMEM_DETAIL_ASSERT(obj_type_raw <=
+                           static_cast<uint8_t>(ObjectType::CORPSE));
+
+    if (guid != 0) {
+      f(guid, obj_ptr, static_cast<ObjectType>(obj_type_raw));
+    }
+    obj_ptr = next_ptr;
+  }
+}
+
+// The ObjectType of each Wow object class.
+template <typename WowT>
+struct ObjectTypeOf;
+
+template <>
+struct ObjectTypeOf<WowObject> {
+  static ObjectType constexpr value = ObjectType::NONE;
+};
+
+template <>
+struct ObjectTypeOf<WowItem> {
+  static ObjectType constexpr value = ObjectType::ITEM;
+};
+
+template <>
+struct ObjectTypeOf<WowContainer> {
+  static ObjectType constexpr value = ObjectType::CONTAINER;
+};
+
+template <>
+struct ObjectTypeOf<WowUnit> {
+  static ObjectType constexpr value = ObjectType::UNIT;
+};
+
+template <>
+struct ObjectTypeOf<WowPlayer> {
+  static ObjectType constexpr value = ObjectType::PLAYER;
+};
+
+template <>
+struct ObjectTypeOf<WowGameObject> {
+  static ObjectType constexpr value = ObjectType::GAMEOBJ;
+};
+
 struct ObjectManager {
 public:
   explicit ObjectManager() = default;
-  ~ObjectManager() = default;
+  virtual ~ObjectManager() = default;
   ObjectManager(const ObjectManager&) = delete;
   ObjectManager& operator=(const ObjectManager&) = delete;
 
   inline bool IsInGame() { return GetPlayerGuid() != 0; }
 
-  template <typename WowT>
-  static bool is_obj_type(WowObject const* obj);
-
-  template <typename WowT>
-  using Range = boost::any_range<WowT*, // value type
-                                 boost::forward_traversal_tag, // iterator type
-                                 WowT*, // reference type
-                                 std::ptrdiff_t>;
+  // An object in the cache, with what's needed to find and sweep it, and
+  // what scans over it most often want, kept alongside the object itself.
+  struct ObjectSlot {
+    Guid guid;
+    uintptr_t base_ptr;
+    ObjectType type;
+    // the enumeration it was last seen in
+    uint32_t generation;
+    // Where it was as of then, for units, players and game objects. Read
+    // straight off the client's object, so scans needn't touch obj.
+    vec3 position;
+    std::unique_ptr<WowObject> obj;
+  };
+
+  static size_t const NumObjectTypes =
+    static_cast<size_t>(ObjectType::CORPSE) + 1;
+
+  using Slots = boost::iterator_range<ObjectSlot*>;
+
+  // the slots of every object of type, next to each other
+  Slots GetSlots(ObjectType const type)
+  {
+    size_t const t = static_cast<size_t>(type);
+    return Slots{slots.data() + type_begin[t],
+                 slots.data() + type_begin[t + 1]};
+  }
+  Slots GetSlots() { return Slots{slots.data(), slots.data() + slots.size()}; }
 
+  // Every WowT, WowT's own type only, e.g. WowUnit doesn't include players.
   template <typename WowT>
-  inline Range<WowT> IterObjs()
+  inline auto IterObjs()
   {
-    using namespace boost::adaptors;
-
-    // clang-format off
-
-    return guid_obj_cache
-      | map_values
-      | transformed([](std::unique_ptr<WowObject>& obj) { return obj.get(); })
-      | filtered(is_obj_type<WowT>)
-      | transformed([](WowObject* obj) { return dynamic_cast<WowT*>(obj); });
-
-    // clang-format on
+    return GetSlots(ObjectTypeOf<WowT>::value) |
+           boost::adaptors::transformed([](ObjectSlot& slot) {
+             return static_cast<WowT*>(slot.obj.get());
+           });
   }
 
-  inline Range<WowObject> IterAllObjs()
+  inline auto IterAllObjs()
   {
-    using namespace boost::adaptors;
-
-    // clang-format off
-
-    return guid_obj_cache
-      | map_values
-      | transformed([](std::unique_ptr<WowObject>& obj) { return obj.get(); });
-
-    // clang-format on
+    return GetSlots() | boost::adaptors::transformed(
+                          [](ObjectSlot& slot) { return slot.obj.get(); });
   }
 
-  void EnumVisibleObjects();
-  Guid GetPlayerGuid() const;
-  uint32_t GetMapId() const;
+  // Refresh the cache with the client's visible objects.
+  //
+  // Incrementally, objects still at the same address in the client are kept
+  // from the last enumeration, so the pointers handed out for them stay
+  // good across frames, and only new objects are allocated. Objects that
+  // weren't seen this time are swept at the end. Otherwise the cache is
+  // rebuilt from scratch every time.
+  //
+  // virtual so a simulated world can stand in for the client's
+  virtual void EnumVisibleObjects();
+  virtual Guid GetPlayerGuid() const;
+  virtual uint32_t GetMapId() const;
 
   boost::optional<WowPlayer*> GetPlayer();
   boost::optional<WowObject*> GetObjByGuid(Guid const guid);
 
-  std::unordered_map<Guid, std::unique_ptr<WowObject>> guid_obj_cache{};
+  // An enumeration is BeginEnum, SeeObject for every visible object, then
+  // EndEnum.
+  void BeginEnum();
+  void SeeObject(Guid const guid,
+                 uintptr_t const obj_ptr,
+                 ObjectType const obj_type);
+  void EndEnum();
+
+  // Put obj in the cache, as if it had been seen. Replaces any object
+  // with the same guid.
+  void AddObject(std::unique_ptr<WowObject> obj);
+  void RemoveObject(Guid const guid);
+  // Re-read every slot's position without enumerating, for a world that
+  // isn't the client's.
+  void RefreshObjects();
+  size_t GetObjectCount() const { return slots.size(); }
+
+  bool incremental_enum{true};
+  uint32_t enum_generation{0};
+  // objects allocated and swept by the last enumeration
+  uint32_t objs_created{0};
+  uint32_t objs_removed{0};
+
+private:
+  void InsertSlot(ObjectSlot slot);
+  void EraseSlot(size_t const index);
+  void MoveSlot(size_t const from, size_t const to);
+
+  // Every object, grouped by type: type t's are slots[type_begin[t]] up to
+  // slots[type_begin[t + 1]]. Scanning one type is a walk over its group.
+  std::vector<ObjectSlot> slots;
+  std::array<size_t, NumObjectTypes + 1> type_begin{};
+  // guid to its index in slots
+  boost::container::flat_map<Guid, size_t> slot_index;
 };
 }
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include "PID.hpp"
 
+#include <algorithm>
+
 #include <doctest.h>
 
+using std::clamp;
+
 namespace phlipbot
 {
 PID::PID(float _gain_p, float _gain_i, float _gain_d) noexcept
@@ -9,23 +13,59 @@ PID::PID(float _gain_p, float _gain_i, float _gain_d) noexcept
 {
 }
 
+PID::PID(PIDGains const& gains) noexcept
+  : gain_p(gains.p), gain_i(gains.i), gain_d(gains.d)
+{
+}
+
 void PID::Reset()
 {
   prev_error = 0.0f;
-  prev_i = 0.0f;
+  integral = 0.0f;
+  derivative = 0.0f;
+  has_prev_error = false;
+}
+
+void PID::SetGains(PIDGains const& gains)
+{
+  gain_p = gains.p;
+  gain_i = gains.i;
+  gain_d = gains.d;
 }
 
 float PID::Update(float const error, float const dt)
 {
-  float p = error;
-  float i = (prev_i + error * dt) ? dt > 0.0f : 0.0f;
-  float d = ((error - prev_error) / dt) ? dt > 0.0f : 0.0f;
-  float output = gain_p * p + gain_i * i + gain_d * d;
+  // nothing to integrate or differentiate over
+  if (dt <= 0.0f) {
+    float const output =
+      gain_p * error + gain_i * integral + gain_d * derivative;
+    return clamp(output, -output_limit, output_limit);
+  }
 
+  if (has_prev_error) {
+    float const raw_d = (error - prev_error) / dt;
+    float const alpha = dt / (derivative_filter + dt);
+    derivative += alpha * (raw_d - derivative);
+  }
   prev_error = error;
-  prev_i = i;
+  has_prev_error = true;
+
+  float const next_integral =
+    clamp(integral + error * dt, -integral_limit, integral_limit);
+  float const output =
+    gain_p * error + gain_i * next_integral + gain_d * derivative;
+  float const clamped = clamp(output, -output_limit, output_limit);
 
-  return output;
+  // only wind the integral further into saturation if it's not saturated
+  bool const saturated = clamped != output;
+  bool const deeper = (next_integral - integral) * (output - clamped) > 0.0f;
+  if (!saturated || !deeper) {
+    integral = next_integral;
+    return clamped;
+  }
+
+  float const held = gain_p * error + gain_i * integral + gain_d * derivative;
+  return clamp(held, -output_limit, output_limit);
 }
 
 namespace test
@@ -45,5 +85,62 @@ TEST_CASE("PID works with dt = 0")
 
   CHECK(output > 0.0f);
 }
+
+TEST_CASE("PID integrates and differentiates the error")
+{
+  PID pid{0, 1, 0};
+  CHECK(pid.Update(2.0f, 0.5f) == doctest::Approx(1.0f));
+  CHECK(pid.Update(2.0f, 0.5f) == doctest::Approx(2.0f));
+  CHECK(pid.Update(-1.0f, 1.0f) == doctest::Approx(1.0f));
+
+  // no kick from the error jumping up from nothing on the first update
+  PID d_pid{0, 0, 1};
+  CHECK(d_pid.Update(5.0f, 0.1f) == doctest::Approx(0.0f));
+  CHECK(d_pid.Update(6.0f, 0.1f) == doctest::Approx(10.0f));
+  CHECK(d_pid.Update(6.0f, 0.1f) == doctest::Approx(0.0f));
+
+  // filtered, the derivative follows a step in the error's rate of change
+  // over about derivative_filter seconds
+  d_pid.Reset();
+  d_pid.derivative_filter = 0.3f;
+  d_pid.Update(0.0f, 0.1f);
+  float const first = d_pid.Update(1.0f, 0.1f);
+  CHECK(first == doctest::Approx(2.5f));
+  float last = first;
+  for (int i = 2; i < 20; ++i) {
+    last = d_pid.Update(float(i), 0.1f);
+  }
+  CHECK(last == doctest::Approx(10.0f).epsilon(0.01));
+}
+
+TEST_CASE("PID doesn't wind up while saturated")
+{
+  PID pid{1, 1, 0};
+  pid.output_limit = 2.0f;
+
+  // the proportional term alone saturates it, the integral can't help
+  for (int i = 0; i < 100; ++i) {
+    CHECK(pid.Update(5.0f, 0.1f) == doctest::Approx(2.0f));
+  }
+  CHECK(pid.Update(0.0f, 0.1f) == doctest::Approx(0.0f));
+
+  // the integral only takes up what the proportional term leaves, rather
+  // than growing to 15 and having to unwind once the error's gone
+  float last = 0.0f;
+  for (int i = 0; i < 100; ++i) {
+    last = pid.Update(1.5f, 0.1f);
+  }
+  CHECK(last <= 2.0f);
+  float const output = pid.Update(0.0f, 0.1f);
+  CHECK(output > 0.0f);
+  CHECK(output <= 0.5f);
+
+  PID clamped{0, 1, 0};
+  clamped.integral_limit = 0.5f;
+  for (int i = 0; i < 10; ++i) {
+    clamped.Update(1.0f, 1.0f);
+  }
+  CHECK(clamped.Update(0.0f, 1.0f) == doctest::Approx(0.5f));
+}
 }
 }
@@ -1,18 +1,30 @@
 #pragma once
 
+#include <limits>
+
 // A simple PID controller implementation
 
 namespace phlipbot
 {
+struct PIDGains {
+  float p{0.0f};
+  float i{0.0f};
+  float d{0.0f};
+};
+
 struct PID {
   explicit PID() noexcept = default;
   explicit PID(float gain_p, float gain_i, float gain_d) noexcept;
+  explicit PID(PIDGains const& gains) noexcept;
 
   PID(PID const&) = delete;
   PID& operator=(PID const&) = delete;
 
   void Reset();
 
+  void SetGains(PIDGains const& gains);
+  PIDGains GetGains() const { return PIDGains{gain_p, gain_i, gain_d}; }
+
   // Compute the control output from the process error and change in time.
   float Update(float const error, float const dt);
 
@@ -20,8 +32,20 @@ struct PID {
   float gain_i = 0.0f;
   float gain_d = 0.0f;
 
+  // The output's clamped to +- output_limit. While it is, the integral only
+  // changes if that would bring the output back in range (anti-windup).
+  float output_limit = std::numeric_limits<float>::infinity();
+  // the integral is clamped to +- integral_limit
+  float integral_limit = std::numeric_limits<float>::infinity();
+  // Time constant, in seconds, of the low pass filter on the derivative so
+  // noisy errors don't make it jump around. 0 for no filtering.
+  float derivative_filter = 0.0f;
+
 private:
   float prev_error = 0.0f;
-  float prev_i = 0.0f;
+  float integral = 0.0f;
+  float derivative = 0.0f;
+  // no derivative on the first update after a reset
+  bool has_prev_error = false;
 };
-}
\ No newline at end of file
+}
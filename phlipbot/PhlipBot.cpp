@@ -13,6 +13,9 @@ using std::chrono::duration_cast;
 
 namespace
 {
+// at most this many control steps a frame, e.g. 4 keeps up down to 7.5 fps
+uint32_t const MaxControlSteps = 4;
+
 D3DVIEWPORT9 BuildViewport(HWND const hwnd)
 {
   RECT rect = {};
@@ -32,9 +35,11 @@ namespace phlipbot
 PhlipBot::PhlipBot() noexcept
   : is_render_initialized(false),
     prev_frame_time(steady_clock::now()),
+    control_timestep(ControlStep, MaxControlSteps),
     objmgr(),
     input(),
-    player_controller(objmgr),
+    commands(objmgr),
+    player_controller(objmgr, commands),
     mmap_mgr("C:\\MaNGOS\\data\\__mmaps"),
     player_nav(objmgr, player_controller, mmap_mgr),
     gui(objmgr, player_controller, player_nav)
@@ -46,12 +51,24 @@ void PhlipBot::Init() { HADESMEM_DETAIL_TRACE_A("initializing bot"); }
 void PhlipBot::Update()
 {
   float const dt = UpdateClock();
+  uint32_t const steps = control_timestep.Advance(dt);
 
   if (objmgr.IsInGame()) {
+    // every frame, since the client can free objects any frame
     objmgr.EnumVisibleObjects();
 
-    player_nav.Update();
-    player_controller.Update(dt);
+    // all on this thread, since they call into the client
+    float const step = control_timestep.GetStep();
+    for (uint32_t i = 0; i < steps; ++i) {
+      player_nav.Update(step);
+      player_controller.Update(step);
+    }
+    player_controller.Interpolate(control_timestep.GetAlpha());
+
+    // everything the frame asked the player to do, in one go
+    commands.Flush(::GetTickCount());
+  } else {
+    commands.Clear();
   }
 }
 
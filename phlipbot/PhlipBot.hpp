@@ -4,8 +4,10 @@
 #include <chrono>
 #include <d3d9.h>
 
+#include "FixedTimestep.hpp"
 #include "Gui.hpp"
 #include "Input.hpp"
+#include "MovementCommands.hpp"
 #include "ObjectManager.hpp"
 #include "PlayerController.hpp"
 #include "navigation/MoveMap.hpp"
@@ -35,9 +37,12 @@ public:
 
   bool is_render_initialized;
   steady_clock::time_point prev_frame_time;
+  // the navigator and controller run at a fixed rate, not once a frame
+  FixedTimestep control_timestep;
 
   ObjectManager objmgr;
   Input input;
+  MovementCommands commands;
   PlayerController player_controller;
   MMapManager mmap_mgr;
   PlayerNavigator player_nav;
@@ -1,6 +1,8 @@
 #include "PlayerController.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 #include <glm/geometric.hpp>
 
@@ -8,11 +10,14 @@
 
 #include <hadesmem/detail/assert.hpp>
 
+#include <doctest.h>
+
 using std::abs;
 using std::atan2;
 using std::fmod;
 using std::min;
 
+using glm::dot;
 using glm::length;
 
 using boost::math::float_constants::pi;
@@ -35,12 +40,53 @@ float wow_angle_2d(vec3 const& a, vec3 const& b)
   vec2 d = (b - a).xy;
   return pi - atan2(d.y, -d.x);
 }
+
+float normalize_facing(float const facing)
+{
+  float const normal = fmod(facing, two_pi);
+  return normal < 0.0f ? normal + two_pi : normal;
+}
 }
 
 namespace phlipbot
 {
-// TODO(phlip9): take in some config thing to set PID gains
-PlayerController::PlayerController(ObjectManager& om) noexcept : objmgr(om) {}
+vec3 PursuitPoint(std::vector<vec3> const& path,
+                  size_t const segment,
+                  vec3 const& pos,
+                  float const lookahead)
+{
+  HADESMEM_DETAIL_ASSERT(path.size() >= 2);
+  size_t const first = min(segment, path.size() - 2);
+
+  // project onto the segment we're on
+  vec3 const& a = path[first];
+  vec3 const& b = path[first + 1];
+  vec2 const ab = (b - a).xy;
+  float const len_sqr = dot(ab, ab);
+  float const t = len_sqr > 0.0f
+                    ? std::clamp(dot((pos - a).xy, ab) / len_sqr, 0.0f, 1.0f)
+                    : 1.0f;
+  vec3 point = a + (b - a) * t;
+
+  // and walk lookahead along from there
+  float left = lookahead;
+  for (size_t i = first + 1; i < path.size(); ++i) {
+    vec3 const& next = path[i];
+    float const dist = length((next - point).xy);
+    if (dist >= left) {
+      return point + (next - point) * (left / dist);
+    }
+    left -= dist;
+    point = next;
+  }
+  return path.back();
+}
+
+PlayerController::PlayerController(ObjectManager& om,
+                                   MovementCommands& mc) noexcept
+  : objmgr(om), commands(mc)
+{
+}
 
 void PlayerController::Update(float const dt)
 {
@@ -55,7 +101,33 @@ void PlayerController::Update(float const dt)
   auto* player = o_player.get();
   auto* cmovement = player->GetMovement();
 
-  float const facing = cmovement->facing;
+  // all the way round the last turn before starting the next
+  if (turning) {
+    commands.SetFacing(normalize_facing(turn_from + turn_by));
+    turning = false;
+  }
+
+  // each way of moving has its own gains, and starts over with them
+  bool const pursuing = IsPursuing();
+  if (pursuing != was_pursuing) {
+    facing_controller.Reset();
+    was_pursuing = pursuing;
+  }
+  facing_controller.SetGains(pursuing ? pursuit_gains : position_gains);
+  facing_controller.output_limit =
+    pursuing ? max_turn_rate * dt : std::numeric_limits<float>::infinity();
+
+  vec3 const player_pos = cmovement->position;
+  if (pursuing) {
+    float const lookahead = std::clamp(
+      lookahead_time * cmovement->run_speed, min_lookahead, max_lookahead);
+    facing_setpoint =
+      PursuitPoint(pursuit_path, pursuit_segment, player_pos, lookahead);
+  }
+
+  // as this frame's commands will leave it
+  float const facing = commands.GetFacing(*player);
+  uint32_t const move_flags = commands.GetMoveFlags(*player);
   float _facing_setpoint = ComputeFacing(facing_setpoint);
 
   // Compute the shortest facing error, i.e., error turning cw vs error turning
@@ -67,24 +139,63 @@ void PlayerController::Update(float const dt)
   float const facing_error = min(error1, error2);
   float const facing_dir = (error1 < error2) ? error1_dir : error2_dir;
 
+  last_facing_error = 0.0f;
+  last_facing_output = 0.0f;
   if (fabs(facing_error) >= 1e-2) {
-    float const output = facing_controller.Update(facing_error, dt);
-    float const new_facing = fmod(facing + facing_dir * output, two_pi);
-    player->SetFacing(new_facing);
+    float const output =
+      facing_controller.Update(facing_dir * facing_error, dt);
+    last_facing_error = facing_dir * facing_error;
+    last_facing_output = output;
+    if (interpolate_facing) {
+      turn_from = facing;
+      turn_by = output;
+      turning = true;
+    } else {
+      commands.SetFacing(normalize_facing(facing + output));
+    }
   }
 
-  vec3 const player_pos = cmovement->position;
-  if (!InRange(player_pos, position_setpoint)) {
-    if ((cmovement->move_flags & MovementFlags::Forward) == 0) {
-      player->SetControlBits(InputControlFlags::Forward, ::GetTickCount());
+  // pursuit keeps running through the waypoints, unless it has to turn
+  // sharply first
+  bool const run =
+    pursuing
+      ? !InRange(player_pos, pursuit_path.back()) &&
+          facing_error <= max_running_turn
+      : !InRange(player_pos, position_setpoint);
+  if (run) {
+    if ((move_flags & MovementFlags::Forward) == 0) {
+      commands.SetControlBits(InputControlFlags::Forward);
+      ++forward_toggles;
     }
   } else {
-    if ((cmovement->move_flags & MovementFlags::Forward) != 0) {
-      player->UnsetControlBits(InputControlFlags::Forward, ::GetTickCount());
+    if ((move_flags & MovementFlags::Forward) != 0) {
+      commands.UnsetControlBits(InputControlFlags::Forward);
+      ++forward_toggles;
     }
   }
 }
 
+void PlayerController::Interpolate(float const alpha)
+{
+  if (!enabled || !turning) {
+    return;
+  }
+
+  auto const o_player = objmgr.GetPlayer();
+  if (!o_player.has_value()) {
+    return;
+  }
+  auto* player = o_player.get();
+
+  float const facing =
+    normalize_facing(turn_from + turn_by * std::clamp(alpha, 0.0f, 1.0f));
+  float const turn =
+    std::remainder(facing - commands.GetFacing(*player), two_pi);
+  if (abs(turn) >= min_interpolated_turn) {
+    commands.SetFacing(facing);
+  }
+}
+
 float PlayerController::ComputeFacing(FacingSetpoint const& setpoint) const
 {
   // clang-format off
@@ -116,14 +227,36 @@ float PlayerController::ComputeFacing(FacingSetpoint const& setpoint) const
 void PlayerController::Reset()
 {
   facing_controller.Reset();
+  turning = false;
 
   auto const o_player = objmgr.GetPlayer();
   if (!o_player.has_value()) {
     return;
   }
   auto* player = o_player.get();
-  if ((player->GetMovement()->move_flags & MovementFlags::Forward) != 0) {
-    player->UnsetControlBits(InputControlFlags::Forward, ::GetTickCount());
+  if ((commands.GetMoveFlags(*player) & MovementFlags::Forward) != 0) {
+    commands.UnsetControlBits(InputControlFlags::Forward);
   }
 }
-}
\ No newline at end of file
+
+namespace test
+{
+TEST_CASE("PursuitPoint looks ahead along the path")
+{
+  std::vector<vec3> const path{{0, 0, 0}, {10, 0, 0}, {10, 10, 5}};
+
+  // from the projection onto the segment, not the player
+  CHECK(PursuitPoint(path, 0, vec3{2, 1, 0}, 3.0f) == vec3{5, 0, 0});
+
+  // around the corner, heights follow the path
+  CHECK(PursuitPoint(path, 0, vec3{8, 0, 0}, 4.0f) == vec3{10, 2, 1});
+
+  // never past the end, or behind the segment's start
+  CHECK(PursuitPoint(path, 1, vec3{10, 8, 4}, 5.0f) == path.back());
+  CHECK(PursuitPoint(path, 0, vec3{-5, 0, 0}, 1.0f) == vec3{1, 0, 0});
+
+  // a segment past the end is the last one
+  CHECK(PursuitPoint(path, 7, vec3{10, 0, 0}, 2.0f) == vec3{10, 2, 1});
+}
+}
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <utility>
 #include <variant>
+#include <vector>
 
+#include "MovementCommands.hpp"
 #include "ObjectManager.hpp"
 #include "PID.hpp"
 #include "wow_constants.hpp"
@@ -11,11 +14,31 @@
 
 namespace phlipbot
 {
+// Facing gains for turning towards a position (on the spot, if it's a sharp
+// turn) and for pure pursuit. Found by the "tool tune facing gains" test in
+// navigation/GainTuner.cpp, rerun it after changing how the controller turns.
+namespace FacingGains
+{
+PIDGains const Position{1.000f, 0.000f, 0.000f};
+PIDGains const Pursuit{0.833f, 0.467f, 0.013f};
+}
+
+// PlayerController and PlayerNavigator update every ControlStep seconds,
+// whatever the frame rate, see FixedTimestep.
+float const ControlStep = 1.0f / 30.0f;
+
+// The point lookahead yards along path (2D) from where pos is projected onto
+// path[segment] -> path[segment + 1], or the end of the path if that's nearer.
+vec3 PursuitPoint(std::vector<vec3> const& path,
+                  size_t const segment,
+                  vec3 const& pos,
+                  float const lookahead);
+
 struct PlayerController {
   using FacingSetpoint = std::variant<float, vec3, Guid>;
   using PositionSetpoint = vec3;
 
-  explicit PlayerController(ObjectManager& om) noexcept;
+  explicit PlayerController(ObjectManager& om, MovementCommands& mc) noexcept;
   ~PlayerController() = default;
 
   PlayerController(PlayerController const&) = delete;
@@ -24,6 +47,11 @@ struct PlayerController {
   void Update(float const dt);
   void Reset();
 
+  // Between updates, turn towards the facing the last update asked for a
+  // little every frame rather than all at once. alpha is how far along it is
+  // to the next update, as FixedTimestep::GetAlpha().
+  void Interpolate(float const alpha);
+
   inline void SetFacing(float const target_dir)
   {
     facing_setpoint = target_dir;
@@ -43,7 +71,24 @@ struct PlayerController {
   inline void SetPosition(PositionSetpoint const& target_pos)
   {
     position_setpoint = target_pos;
+    pursuit_path.clear();
+  }
+
+  // Pure pursuit: run along path without stopping at its waypoints, facing a
+  // point a little further along it than the player is, until the end of
+  // the path is in range. The lookahead is run_speed * lookahead_time yards,
+  // so it grows with speed. SetPosition goes back to a single position.
+  inline void SetPath(std::vector<vec3> path, size_t const segment = 0)
+  {
+    pursuit_path = std::move(path);
+    pursuit_segment = segment;
+  }
+  // the player's on path[segment] -> path[segment + 1]
+  inline void SetPathSegment(size_t const segment)
+  {
+    pursuit_segment = segment;
   }
+  inline bool IsPursuing() const { return pursuit_path.size() >= 2; }
   inline void SetEnabled(bool const _enabled)
   {
     enabled = _enabled;
@@ -62,11 +107,45 @@ struct PlayerController {
   float const range_thresh_height = 3.0f;
 
   ObjectManager& objmgr;
+  // everything the controller does to the player goes through these
+  MovementCommands& commands;
   bool enabled{false};
 
   FacingSetpoint facing_setpoint{0.0f};
-  PID facing_controller{0.15f, 0.0f, 0.0f};
+  PID facing_controller{FacingGains::Position};
+  // the gains facing_controller uses for each way of moving
+  PIDGains position_gains{FacingGains::Position};
+  PIDGains pursuit_gains{FacingGains::Pursuit};
 
   PositionSetpoint position_setpoint{0, 0, 0};
+
+  std::vector<vec3> pursuit_path;
+  size_t pursuit_segment{0};
+  float lookahead_time = 0.5f;
+  float min_lookahead = 1.5f;
+  float max_lookahead = 8.0f;
+  // radians per second, so pursuit turns are smooth
+  float max_turn_rate = 3.14159265f;
+  // stop and turn on the spot for anything sharper
+  float max_running_turn = 1.5f;
+
+  // whether facing_controller was last used for pursuit
+  bool was_pursuing{false};
+
+  // Update leaves its turns to Interpolate, and finishes the last one first
+  bool interpolate_facing{true};
+  // the smallest turn Interpolate bothers the client with
+  float min_interpolated_turn{0.02f};
+  bool turning{false};
+  float turn_from{0.0f};
+  float turn_by{0.0f};
+
+  // every time the Forward control bit's been set or unset
+  uint32_t forward_toggles{0};
+
+  // the signed facing error and facing_controller's output of the last
+  // update, 0 if it was close enough not to turn
+  float last_facing_error{0.0f};
+  float last_facing_output{0.0f};
 };
 }
@@ -13,9 +13,15 @@ public:
   WowGameObject(const WowGameObject& obj) = default;
   virtual ~WowGameObject() = default;
 
-  inline vec3 GetPosition() const override
+  inline vec3 GetPosition() const override { return PositionAt(base_ptr); }
+
+  // the position of the game object at base_ptr, without a WowGameObject
+  // for it
+  static inline vec3 PositionAt(uintptr_t const base_ptr)
   {
-    return GetDescriptor<vec3>(offsets::Descriptor::GameObjPos);
+    return memory::ReadRaw<vec3>(
+      base_ptr + offsets::ObjectManagerOffsets::DescriptorOffset +
+      static_cast<ptrdiff_t>(offsets::Descriptor::GameObjPos));
   }
 
   // TODO(phlip9): don't think this is correct
@@ -17,17 +17,18 @@ public:
   virtual ObjectType GetObjectType() const override;
   virtual void PrintToStream(std::ostream& os) const override;
 
-  void SendUpdateMovement(uint32_t timestamp, MovementOpCode opcode);
+  // virtual so a simulated player can stand in for the client's
+  virtual void SendUpdateMovement(uint32_t timestamp, MovementOpCode opcode);
 
-  void SetFacing(float facing_radians);
+  virtual void SetFacing(float facing_radians);
   void SetFacing(vec3 const& target_pos);
 
-  bool ClickToMove(CtmType const ctm_type,
-                   Guid const target_guid,
-                   vec3 const& target_pos,
-                   float const precision = 2.0f);
+  virtual bool ClickToMove(CtmType const ctm_type,
+                           Guid const target_guid,
+                           vec3 const& target_pos,
+                           float const precision = 2.0f);
 
-  uint32_t SetControlBits(uint32_t flags, uint32_t timestamp);
-  uint32_t UnsetControlBits(uint32_t flags, uint32_t timestamp);
+  virtual uint32_t SetControlBits(uint32_t flags, uint32_t timestamp);
+  virtual uint32_t UnsetControlBits(uint32_t flags, uint32_t timestamp);
 };
 }
@@ -15,7 +15,10 @@ public:
   WowUnit(const WowUnit& obj) = default;
   virtual ~WowUnit() = default;
 
-  inline CMovementData* GetMovement() const
+  inline CMovementData* GetMovement() const { return MovementAt(base_ptr); }
+
+  // the movement data of the unit at base_ptr, without a WowUnit for it
+  static inline CMovementData* MovementAt(uintptr_t const base_ptr)
   {
     uintptr_t move_data_ptr =
       base_ptr +
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdint.h>
+#include <vector>
+
+#include <crtdbg.h>
+
+#include <hadesmem/detail/trace.hpp>
+
+// Small helpers for writing benchmarks as doctest test cases.
+//
+// Benchmarks live next to the code they measure, in the "benchmark" test suite,
+// and are skipped by default since they're slow and need a release build to
+// mean anything. Run them with:
+//
+//   phlipbot_unittest --no-skip --test-suite=benchmark
+
+namespace phlipbot
+{
+namespace bench
+{
+using clock = std::chrono::steady_clock;
+
+// Keep the optimizer from throwing away a benchmarked result.
+template <typename T>
+inline void DoNotOptimize(T const& value)
+{
+  static volatile char sink;
+  sink = *reinterpret_cast<char const volatile*>(&value);
+}
+
+// Run f() iters times and return the mean wall time per call in microseconds.
+template <typename F>
+double TimeMicros(uint32_t const iters, F&& f)
+{
+  auto const start = clock::now();
+  for (uint32_t i = 0; i < iters; ++i) {
+    f();
+  }
+  auto const elapsed = clock::now() - start;
+  auto const micros =
+    std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(
+      elapsed);
+  return micros.count() / (iters ? iters : 1);
+}
+
+// The p'th percentile (0 to 100) of samples, nearest rank. 0 if empty.
+template <typename T>
+T Percentile(std::vector<T> samples, double const p)
+{
+  if (samples.empty()) {
+    return T{};
+  }
+  size_t const rank = std::min(
+    samples.size() - 1, static_cast<size_t>(p / 100.0 * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank];
+}
+
+// Counts heap allocations, from any thread, while alive. Only the debug CRT
+// lets us hook allocations, so in release builds nothing is counted and
+// Supported() is false.
+struct AllocCounter {
+  AllocCounter()
+  {
+#ifdef _DEBUG
+    Count() = 0;
+    prev_hook = _CrtSetAllocHook(&Hook);
+#endif
+  }
+  ~AllocCounter()
+  {
+#ifdef _DEBUG
+    _CrtSetAllocHook(prev_hook);
+#endif
+  }
+  AllocCounter(AllocCounter const&) = delete;
+  AllocCounter& operator=(AllocCounter const&) = delete;
+
+  static constexpr bool Supported()
+  {
+#ifdef _DEBUG
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  uint32_t Allocations() const { return Count().load(); }
+
+private:
+  static std::atomic<uint32_t>& Count()
+  {
+    static std::atomic<uint32_t> count{0};
+    return count;
+  }
+
+#ifdef _DEBUG
+  static int __cdecl Hook(int alloc_type,
+                          void*,
+                          size_t,
+                          int,
+                          long,
+                          unsigned char const*,
+                          int)
+  {
+    if (alloc_type == _HOOK_ALLOC || alloc_type == _HOOK_REALLOC) {
+      ++Count();
+    }
+    return 1;
+  }
+
+  _CRT_ALLOC_HOOK prev_hook{nullptr};
+#endif
+};
+
+inline void Report(char const* name, double const micros_per_iter)
+{
+  std::printf("[bench] %-56s %12.3f us/iter\n", name, micros_per_iter);
+  HADESMEM_DETAIL_TRACE_FORMAT_A("[bench] %s %.3f us/iter", name,
+                                 micros_per_iter);
+}
+}
+}
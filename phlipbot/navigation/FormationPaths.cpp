@@ -0,0 +1,406 @@
+#include "FormationPaths.hpp"
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+#include <glm/geometric.hpp>
+
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+
+#include <doctest.h>
+
+#include "MoveMap.hpp"
+#include "NavWorker.hpp"
+#include "SyntheticMMap.hpp"
+
+namespace fs = std::filesystem;
+
+using glm::distance;
+using glm::dot;
+using glm::length;
+using glm::normalize;
+
+using hadesmem::ErrorCodeWinLast;
+using hadesmem::ErrorString;
+
+namespace
+{
+uint32_t const FORMATION_SECTION_MAGIC = 0x4d524f46; // 'FORM'
+uint32_t const FORMATION_SECTION_VERSION = 1;
+
+// how far a corner's offset point can be pushed out, in offsets
+float const MAX_MITER = 2.0f;
+
+// right of a 2D direction, facing is counter clockwise from +x
+phlipbot::vec2 RightOf(phlipbot::vec2 const& dir)
+{
+  return phlipbot::vec2{dir.y, -dir.x};
+}
+}
+
+namespace phlipbot
+{
+bool LocalFormationPathStore::Publish(FormationPath path)
+{
+  std::lock_guard<std::mutex> guard{lock};
+  path.sequence = published ? published->sequence + 1 : 1;
+  published = std::move(path);
+  return true;
+}
+
+boost::optional<FormationPath> LocalFormationPathStore::Fetch() const
+{
+  std::lock_guard<std::mutex> guard{lock};
+  return published;
+}
+
+uint32_t LocalFormationPathStore::GetSequence() const
+{
+  std::lock_guard<std::mutex> guard{lock};
+  return published ? published->sequence : 0;
+}
+
+// Laid out the same in every client, they're all the same build. sequence
+// is odd while a Publish is writing, and twice the number of publishes
+// otherwise.
+struct SharedFormationPathStore::Section {
+  uint32_t magic;
+  uint32_t version;
+  std::atomic<uint32_t> sequence;
+  uint32_t map_id;
+  float destination[3];
+  uint32_t point_count;
+  float points[MaxPoints][3];
+};
+
+struct SharedFormationPathStore::Mapping {
+  ~Mapping()
+  {
+    if (view) {
+      ::UnmapViewOfFile(view);
+    }
+    if (mapping) {
+      ::CloseHandle(mapping);
+    }
+  }
+
+  HANDLE mapping{nullptr};
+  void* view{nullptr};
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "the shared section's sequence has to work across processes");
+
+SharedFormationPathStore::SharedFormationPathStore(std::wstring const& name)
+  : mapping(new Mapping)
+{
+  std::wstring const section_name = L"Local\\phlipbot_formation_" + name;
+  mapping->mapping = ::CreateFileMappingW(
+    INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+    static_cast<DWORD>(sizeof(Section)), section_name.c_str());
+  if (!mapping->mapping) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to create formation section"}
+                        << ErrorCodeWinLast{::GetLastError()});
+  }
+  bool const created = ::GetLastError() != ERROR_ALREADY_EXISTS;
+
+  mapping->view = ::MapViewOfFile(mapping->mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+                                  sizeof(Section));
+  if (!mapping->view) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to map formation section"}
+                        << ErrorCodeWinLast{::GetLastError()});
+  }
+  section = static_cast<Section*>(mapping->view);
+
+  // new sections are zeroed, i.e. nothing published yet
+  if (created) {
+    section->magic = FORMATION_SECTION_MAGIC;
+    section->version = FORMATION_SECTION_VERSION;
+  } else if (section->magic != 0 &&
+             (section->magic != FORMATION_SECTION_MAGIC ||
+              section->version != FORMATION_SECTION_VERSION)) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << ErrorString{"Formation section is from another version"}
+      << ErrorHeaderMagic{section->magic}
+      << ErrorHeaderVersion{section->version});
+  }
+}
+
+SharedFormationPathStore::~SharedFormationPathStore() = default;
+
+bool SharedFormationPathStore::Publish(FormationPath path)
+{
+  if (path.path.size() > MaxPoints) {
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Not sharing a %zu point path, the formation section holds %u",
+      path.path.size(), MaxPoints);
+    return false;
+  }
+
+  // only the leader publishes, so nobody else moves the sequence
+  uint32_t const sequence = section->sequence.load(std::memory_order_relaxed);
+  section->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  section->map_id = path.map_id;
+  section->destination[0] = path.destination.x;
+  section->destination[1] = path.destination.y;
+  section->destination[2] = path.destination.z;
+  section->point_count = static_cast<uint32_t>(path.path.size());
+  for (size_t i = 0; i < path.path.size(); ++i) {
+    section->points[i][0] = path.path[i].x;
+    section->points[i][1] = path.path[i].y;
+    section->points[i][2] = path.path[i].z;
+  }
+
+  section->sequence.store(sequence + 2, std::memory_order_release);
+  return true;
+}
+
+boost::optional<FormationPath> SharedFormationPathStore::Fetch() const
+{
+  FormationPath fetched;
+  for (;;) {
+    uint32_t const sequence =
+      section->sequence.load(std::memory_order_acquire);
+    if (sequence == 0) {
+      return boost::none;
+    }
+    if (sequence & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    fetched.sequence = sequence / 2;
+    fetched.map_id = section->map_id;
+    fetched.destination = vec3{section->destination[0],
+                               section->destination[1],
+                               section->destination[2]};
+    uint32_t const count =
+      section->point_count <= MaxPoints ? section->point_count : MaxPoints;
+    fetched.path.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      fetched.path[i] = vec3{section->points[i][0], section->points[i][1],
+                             section->points[i][2]};
+    }
+
+    // a Publish started meanwhile, what we read may be half of each
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (section->sequence.load(std::memory_order_relaxed) == sequence) {
+      return fetched;
+    }
+  }
+}
+
+uint32_t SharedFormationPathStore::GetSequence() const
+{
+  // the last finished Publish's, if one's writing now
+  return section->sequence.load(std::memory_order_acquire) / 2;
+}
+
+PointsArray TrimPath(PointsArray const& path, float const back)
+{
+  if (path.empty()) {
+    return path;
+  }
+
+  float left = back;
+  for (size_t i = path.size() - 1; i > 0; --i) {
+    float const seg_len = distance(path[i - 1].xy, path[i].xy);
+    if (seg_len > left) {
+      PointsArray trimmed(path.begin(), path.begin() + i);
+      trimmed.push_back(path[i] +
+                        (path[i - 1] - path[i]) * (left / seg_len));
+      return trimmed;
+    }
+    left -= seg_len;
+  }
+  return PointsArray{path.front()};
+}
+
+PointsArray OffsetPath(PointsArray const& path, float const right)
+{
+  if (path.size() < 2) {
+    return path;
+  }
+
+  // each segment's direction, a point's length segments take the one before
+  // (or the first proper one, at the start)
+  size_t const segments = path.size() - 1;
+  std::vector<vec2> dirs(segments, vec2{1, 0});
+  boost::optional<vec2> last_dir;
+  for (size_t i = 0; i < segments; ++i) {
+    vec2 const d = path[i + 1].xy - path[i].xy;
+    if (length(d) > 1e-4f) {
+      dirs[i] = normalize(d);
+      if (!last_dir) {
+        std::fill(dirs.begin(), dirs.begin() + i, dirs[i]);
+      }
+      last_dir = dirs[i];
+    } else if (last_dir) {
+      dirs[i] = *last_dir;
+    }
+  }
+
+  PointsArray offset(path.size());
+  for (size_t i = 0; i < path.size(); ++i) {
+    vec2 const in = RightOf(dirs[i == 0 ? 0 : i - 1]);
+    vec2 const out = RightOf(dirs[i == segments ? segments - 1 : i]);
+
+    // the corner's bisector, pushed out so both segments stay right yards
+    // away from the path
+    vec2 normal = in + out;
+    float scale = 1.0f;
+    if (length(normal) < 1e-4f) {
+      normal = in; // a U turn
+    } else {
+      normal = normalize(normal);
+      scale = std::min(1.0f / std::max(dot(normal, in), 1e-4f), MAX_MITER);
+    }
+    offset[i] = path[i] + vec3{normal * (right * scale), 0.0f};
+  }
+  return offset;
+}
+
+namespace test
+{
+TEST_CASE("OffsetPath keeps parallel to the path")
+{
+  // east, then north
+  PointsArray const path{vec3{0, 0, 1}, vec3{10, 0, 2}, vec3{10, 10, 3}};
+
+  // two yards right of going east is south
+  PointsArray const right = OffsetPath(path, 2.0f);
+  REQUIRE(right.size() == 3);
+  CHECK(right[0].x == doctest::Approx(0.0f));
+  CHECK(right[0].y == doctest::Approx(-2.0f));
+  CHECK(right[0].z == doctest::Approx(1.0f));
+  // the outside of the corner
+  CHECK(right[1].x == doctest::Approx(12.0f));
+  CHECK(right[1].y == doctest::Approx(-2.0f));
+  CHECK(right[2].x == doctest::Approx(12.0f));
+  CHECK(right[2].y == doctest::Approx(10.0f));
+
+  // the inside of it
+  PointsArray const left = OffsetPath(path, -2.0f);
+  CHECK(left[1].x == doctest::Approx(8.0f));
+  CHECK(left[1].y == doctest::Approx(2.0f));
+
+  CHECK(OffsetPath(PointsArray{vec3{1, 2, 3}}, 2.0f).size() == 1);
+}
+
+TEST_CASE("TrimPath leaves off the end of the path")
+{
+  PointsArray const path{vec3{0, 0, 0}, vec3{10, 0, 0}, vec3{10, 10, 0}};
+
+  PointsArray trimmed = TrimPath(path, 4.0f);
+  REQUIRE(trimmed.size() == 3);
+  CHECK(trimmed[2].y == doctest::Approx(6.0f));
+
+  trimmed = TrimPath(path, 15.0f);
+  REQUIRE(trimmed.size() == 2);
+  CHECK(trimmed[1].x == doctest::Approx(5.0f));
+
+  trimmed = TrimPath(path, 25.0f);
+  REQUIRE(trimmed.size() == 1);
+  CHECK(trimmed[0] == path[0]);
+
+  CHECK(TrimPath(path, 0.0f) == path);
+}
+
+namespace
+{
+void CheckStore(FormationPathStore& leader, FormationPathStore const& follower)
+{
+  CHECK(!follower.Fetch());
+  CHECK(follower.GetSequence() == 0);
+
+  FormationPath published;
+  published.map_id = 1;
+  published.destination = vec3{10, 20, 30};
+  published.path = PointsArray{vec3{1, 2, 3}, vec3{4, 5, 6}};
+  REQUIRE(leader.Publish(published));
+
+  auto fetched = follower.Fetch();
+  REQUIRE(fetched);
+  CHECK(fetched->sequence == 1);
+  CHECK(follower.GetSequence() == 1);
+  CHECK(fetched->map_id == 1);
+  CHECK(fetched->destination == published.destination);
+  CHECK(fetched->path == published.path);
+
+  published.path.push_back(vec3{7, 8, 9});
+  REQUIRE(leader.Publish(published));
+  fetched = follower.Fetch();
+  REQUIRE(fetched);
+  CHECK(fetched->sequence == 2);
+  CHECK(follower.GetSequence() == 2);
+  CHECK(fetched->path == published.path);
+}
+}
+
+TEST_CASE("LocalFormationPathStore hands out the last path published")
+{
+  LocalFormationPathStore store;
+  CheckStore(store, store);
+}
+
+TEST_CASE("SharedFormationPathStore shares paths between stores")
+{
+  // unique to this process, so nobody else is using it
+  std::wstring const name = std::to_wstring(::GetCurrentProcessId());
+  SharedFormationPathStore leader{name};
+  SharedFormationPathStore const follower{name};
+  CheckStore(leader, follower);
+
+  FormationPath too_long;
+  too_long.path.resize(SharedFormationPathStore::MaxPoints + 1);
+  CHECK(!leader.Publish(too_long));
+  CHECK(follower.Fetch()->sequence == 2);
+  CHECK(follower.GetSequence() == 2);
+}
+
+TEST_CASE("NavWorker::FormationPathAsync walks alongside the leader")
+{
+  // a wall across x = -G / 2 with a gap around y = -G / 2
+  SyntheticTerrain terrain;
+  terrain.walls_per_tile = 1;
+  fs::path const dir = SyntheticMMapDir("formation");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  NavWorker worker{mmap};
+
+  // the leader goes straight through the middle of the gap
+  float const gap_y = -MMAP_GRID_SIZE / 2;
+  PointsArray const leader{vec3{-350.0f, gap_y, terrain.ground_height},
+                           vec3{-MMAP_GRID_SIZE / 2, gap_y,
+                                terrain.ground_height},
+                           vec3{-180.0f, gap_y, terrain.ground_height}};
+
+  // 8 yards to its right is in the wall, 20 behind is short of its end
+  vec3 const src{-352.0f, gap_y - 9.0f, terrain.ground_height};
+  PathResult const result =
+    worker.FormationPathAsync(terrain.map_id, src, leader, vec2{8.0f, 20.0f})
+      .get();
+  REQUIRE(result.type.test(PathFlag::PATHFIND_NORMAL));
+  REQUIRE(result.path.size() == 3);
+
+  CHECK(result.path[0] == src);
+  // squeezed through the gap
+  CHECK(result.path[1].x == doctest::Approx(leader[1].x));
+  CHECK(gap_y - result.path[1].y > 2.0f);
+  CHECK(gap_y - result.path[1].y < terrain.wall_gap / 2);
+  CHECK(result.path[2].x == doctest::Approx(-200.0f));
+  CHECK(result.path[2].y == doctest::Approx(gap_y - 8.0f));
+}
+}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+#include <boost/optional.hpp>
+
+#include "PathFinder.hpp"
+
+namespace phlipbot
+{
+// The path a party's leader is following, for its followers to walk
+// alongside instead of each searching for their own.
+struct FormationPath {
+  // bumped by the store every Publish, so followers can tell a new path
+  uint32_t sequence{0};
+  uint32_t map_id{0};
+  vec3 destination{0, 0, 0};
+  PointsArray path;
+};
+
+// Where a leader publishes its paths and its followers fetch them from.
+struct FormationPathStore {
+  virtual ~FormationPathStore() = default;
+
+  // Replace the published path. False if the store can't hold it.
+  virtual bool Publish(FormationPath path) = 0;
+  // The last path published, none if nothing has been yet.
+  virtual boost::optional<FormationPath> Fetch() const = 0;
+  // The last path published's sequence, 0 if nothing has been yet. Much
+  // cheaper than Fetch, for checking whether there's anything new to fetch.
+  virtual uint32_t GetSequence() const = 0;
+};
+
+// A store for a party in one process, e.g. tests or the simulator.
+struct LocalFormationPathStore : FormationPathStore {
+  bool Publish(FormationPath path) override;
+  boost::optional<FormationPath> Fetch() const override;
+  uint32_t GetSequence() const override;
+
+private:
+  mutable std::mutex lock;
+  boost::optional<FormationPath> published;
+};
+
+// A store shared by every client on the machine that opens it with the same
+// name, in a named shared memory section. Publish and Fetch never block each
+// other: Fetch retries if it overlapped a Publish.
+struct SharedFormationPathStore : FormationPathStore {
+  // the most points a shared path can have
+  static uint32_t const MaxPoints = 1024;
+
+  explicit SharedFormationPathStore(std::wstring const& name);
+  ~SharedFormationPathStore();
+  SharedFormationPathStore(SharedFormationPathStore const&) = delete;
+  SharedFormationPathStore&
+  operator=(SharedFormationPathStore const&) = delete;
+
+  bool Publish(FormationPath path) override;
+  boost::optional<FormationPath> Fetch() const override;
+  uint32_t GetSequence() const override;
+
+private:
+  struct Mapping;
+  struct Section;
+
+  std::unique_ptr<Mapping> mapping;
+  Section* section{nullptr};
+};
+
+// path without its last back yards. Just its first point if it's shorter
+// than that.
+PointsArray TrimPath(PointsArray const& path, float const back);
+
+// path moved right yards to its right (left if negative), point by point,
+// keeping each new segment parallel to the old one.
+PointsArray OffsetPath(PointsArray const& path, float const right);
+}
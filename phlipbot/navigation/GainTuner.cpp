@@ -0,0 +1,401 @@
+#include "GainTuner.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <thread>
+
+#include <boost/math/constants/constants.hpp>
+
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+
+#include <doctest.h>
+
+#include "PathFollower.hpp"
+#include "PathKernels.hpp"
+
+namespace fs = std::filesystem;
+
+using std::abs;
+using std::max;
+using std::min;
+
+using boost::math::float_constants::two_pi;
+
+using hadesmem::ErrorString;
+
+namespace
+{
+// facings a position episode turns to from 0, both ways and up to about
+// half a turn
+float const TestFacings[] = {0.3f, 1.2f, 3.0f, 4.4f, 5.6f};
+
+// headings of the pursuit episode's legs, so its corners run from about 60
+// to 140 degrees
+float const ZigZagHeadings[] = {0.0f, 1.0f, -0.3f, 1.6f, -0.8f, 0.4f};
+float const ZigZagLeg = 20.0f;
+
+float const NoCost = std::numeric_limits<float>::max();
+
+float phlipbot::PIDGains::*const GainTerms[] = {
+  &phlipbot::PIDGains::p, &phlipbot::PIDGains::i, &phlipbot::PIDGains::d};
+
+// the signed shortest turn from facing to setpoint
+float FacingError(float const setpoint, float const facing)
+{
+  return std::remainder(setpoint - facing, two_pi);
+}
+
+phlipbot::PointsArray ZigZag(phlipbot::vec3 const& start)
+{
+  phlipbot::PointsArray path{start};
+  for (float const heading : ZigZagHeadings) {
+    phlipbot::vec3 next = path.back();
+    next.x += ZigZagLeg * std::cos(heading);
+    next.y += ZigZagLeg * std::sin(heading);
+    path.push_back(next);
+  }
+  return path;
+}
+}
+
+namespace phlipbot
+{
+GainTuner::GainTuner(fs::path const& _mmap_dir,
+                     SyntheticTerrain const& terrain)
+  : mmap_dir(_mmap_dir), map_id(terrain.map_id), tile(terrain.first_tile)
+{
+  // the middle of the first tile, see SyntheticTerrain
+  vec2 const center{(31.5f - tile.x) * MMAP_GRID_SIZE,
+                    (31.5f - tile.y) * MMAP_GRID_SIZE};
+  origin = vec3{center.x, center.y, SyntheticGroundHeight(terrain, center)};
+
+  // fail here rather than on every thread
+  MMapManager mmap{mmap_dir};
+  if (!mmap.loadMap(map_id, tile)) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to load the tuning nav mesh"});
+  }
+}
+
+FacingScore GainTuner::Evaluate(MovementSim& sim,
+                                FacingMode const mode,
+                                PIDGains const& gains) const
+{
+  PlayerController& controller = sim.player_controller;
+  FacingScore score;
+  if (mode == FacingMode::Position) {
+    controller.position_gains = gains;
+    score = EvaluatePosition(sim);
+  } else {
+    controller.pursuit_gains = gains;
+    score = EvaluatePursuit(sim);
+  }
+  controller.SetEnabled(false);
+
+  score.cost = score.time_to_heading + overshoot_weight * score.overshoot +
+               call_weight * score.set_facing_calls +
+               (score.settled ? 0.0f : unsettled_penalty);
+  return score;
+}
+
+FacingScore GainTuner::EvaluatePosition(MovementSim& sim) const
+{
+  PlayerController& controller = sim.player_controller;
+  SimPlayer& player = sim.objmgr.GetSimPlayer();
+  CMovementData& movement = *player.GetMovement();
+  uint32_t const calls = player.set_facing_calls;
+
+  FacingScore score;
+  for (float const setpoint : TestFacings) {
+    sim.commands.Clear();
+    movement.position = origin;
+    movement.move_flags = 0;
+    movement.facing = 0.0f;
+    // already there, so it only turns
+    controller.SetPosition(origin);
+    controller.SetFacing(setpoint);
+    controller.SetEnabled(true);
+
+    float const start_error = FacingError(setpoint, movement.facing);
+    float settle_time = 0.0f;
+    float error = start_error;
+    float time = 0.0f;
+    while (time < position_time) {
+      controller.Update(sim.tick_dt);
+      sim.Tick(sim.tick_dt);
+      time += sim.tick_dt;
+
+      error = FacingError(setpoint, movement.facing);
+      if (abs(error) > settle_tolerance) {
+        settle_time = time;
+      }
+      if (error * start_error < 0.0f) {
+        score.overshoot = max(score.overshoot, abs(error));
+      }
+    }
+
+    if (abs(error) > settle_tolerance) {
+      score.settled = false;
+    }
+    // it settled the tick after it was last out of tolerance
+    score.time_to_heading += settle_time + sim.tick_dt;
+  }
+
+  float const episodes = float(std::size(TestFacings));
+  score.time_to_heading /= episodes;
+  score.set_facing_calls = (player.set_facing_calls - calls) / episodes;
+  return score;
+}
+
+FacingScore GainTuner::EvaluatePursuit(MovementSim& sim) const
+{
+  PlayerController& controller = sim.player_controller;
+  SimPlayer& player = sim.objmgr.GetSimPlayer();
+  CMovementData& movement = *player.GetMovement();
+  uint32_t const calls = player.set_facing_calls;
+
+  PointsArray const path = ZigZag(origin);
+  PathFollower follower;
+  follower.SetPath(path);
+
+  sim.commands.Clear();
+  movement.position = path.front();
+  movement.move_flags = 0;
+  movement.facing = ZigZagHeadings[0];
+  movement.run_speed = sim.run_speed;
+  controller.SetPath(path);
+  controller.SetEnabled(true);
+
+  FacingScore score;
+  score.settled = false;
+  float time = 0.0f;
+  while (time < pursuit_time) {
+    controller.SetPathSegment(follower.GetSegment());
+    controller.Update(sim.tick_dt);
+    sim.Tick(sim.tick_dt);
+    time += sim.tick_dt;
+
+    PathFollower::Action const action =
+      follower.Update(movement.position, sim.tick_dt);
+    score.overshoot = max(score.overshoot, follower.GetCrossTrack());
+    if (action == PathFollower::Action::Arrived) {
+      score.settled = true;
+      break;
+    }
+  }
+
+  float const run_time = PathLength(path.data(), path.size()) / sim.run_speed;
+  score.time_to_heading = time - run_time;
+  score.set_facing_calls = float(player.set_facing_calls - calls);
+  return score;
+}
+
+std::vector<FacingScore> GainTuner::EvaluateAll(
+  FacingMode const mode, std::vector<PIDGains> const& candidates) const
+{
+  std::vector<FacingScore> scores(candidates.size());
+  std::atomic<size_t> next{0};
+  auto const work = [&]() {
+    MMapManager mmap{mmap_dir};
+    mmap.loadMap(map_id, tile);
+    MovementSim sim{mmap, map_id};
+    for (size_t i; (i = next++) < candidates.size();) {
+      scores[i] = Evaluate(sim, mode, candidates[i]);
+    }
+  };
+
+  uint32_t const count =
+    threads ? threads : max(std::thread::hardware_concurrency(), 1u);
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < count; ++i) {
+    workers.emplace_back(work);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return scores;
+}
+
+PIDGains GainTuner::Tune(FacingMode const mode, FacingScore* score) const
+{
+  PIDGains lo = min_gains;
+  PIDGains hi = max_gains;
+  PIDGains best = min_gains;
+  FacingScore best_score;
+  best_score.cost = NoCost;
+
+  uint32_t const steps = max(grid_steps, 2u);
+  for (uint32_t round = 0; round <= refinements; ++round) {
+    std::vector<PIDGains> candidates;
+    for (uint32_t p = 0; p < steps; ++p) {
+      for (uint32_t i = 0; i < steps; ++i) {
+        for (uint32_t d = 0; d < steps; ++d) {
+          uint32_t const idx[] = {p, i, d};
+          PIDGains gains;
+          for (size_t t = 0; t < std::size(GainTerms); ++t) {
+            float const step = (hi.*GainTerms[t] - lo.*GainTerms[t]) /
+                               float(steps - 1);
+            gains.*GainTerms[t] = lo.*GainTerms[t] + step * idx[t];
+          }
+          candidates.push_back(gains);
+        }
+      }
+    }
+
+    std::vector<FacingScore> const scores = EvaluateAll(mode, candidates);
+    for (size_t c = 0; c < candidates.size(); ++c) {
+      if (scores[c].cost < best_score.cost) {
+        best = candidates[c];
+        best_score = scores[c];
+      }
+    }
+
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "round %u: best %.3f %.3f %.3f, cost %.3f", round, best.p, best.i,
+      best.d, best_score.cost);
+
+    // a third of the size, around the best, and still in range
+    for (float PIDGains::*const term : GainTerms) {
+      float const span = (hi.*term - lo.*term) / 3.0f;
+      lo.*term = max(best.*term - span / 2.0f, min_gains.*term);
+      hi.*term = min(lo.*term + span, max_gains.*term);
+    }
+  }
+
+  if (score) {
+    *score = best_score;
+  }
+  return best;
+}
+
+std::string GainTuner::FormatPresets(PIDGains const& position,
+                                     PIDGains const& pursuit)
+{
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "namespace FacingGains\n"
+           "{\n"
+           "PIDGains const Position{%.3ff, %.3ff, %.3ff};\n"
+           "PIDGains const Pursuit{%.3ff, %.3ff, %.3ff};\n"
+           "}\n",
+           position.p, position.i, position.d, pursuit.p, pursuit.i,
+           pursuit.d);
+  return buf;
+}
+
+namespace test
+{
+TEST_CASE("GainTuner scores facing gains")
+{
+  SyntheticTerrain const terrain;
+  fs::path const dir = SyntheticMMapDir("tuning");
+  GenerateSyntheticMMaps(dir, terrain);
+  GainTuner const tuner{dir, terrain};
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMap(terrain.map_id, terrain.first_tile));
+  MovementSim sim{mmap, terrain.map_id};
+
+  // all the way there at once
+  FacingScore const snap =
+    tuner.Evaluate(sim, FacingMode::Position, PIDGains{1.0f, 0.0f, 0.0f});
+  CHECK(snap.settled);
+  CHECK(snap.time_to_heading == doctest::Approx(sim.tick_dt));
+  CHECK(snap.overshoot == doctest::Approx(0.0f));
+  CHECK(snap.set_facing_calls == doctest::Approx(1.0f));
+
+  // part of the way each tick
+  FacingScore const smooth =
+    tuner.Evaluate(sim, FacingMode::Position, PIDGains{0.15f, 0.0f, 0.0f});
+  CHECK(smooth.settled);
+  CHECK(smooth.time_to_heading > snap.time_to_heading);
+  CHECK(smooth.overshoot == doctest::Approx(0.0f));
+  CHECK(smooth.set_facing_calls > snap.set_facing_calls);
+
+  // past it and back again, every tick
+  FacingScore const over =
+    tuner.Evaluate(sim, FacingMode::Position, PIDGains{1.8f, 0.0f, 0.0f});
+  CHECK(over.overshoot > 0.5f);
+  CHECK(over.cost > smooth.cost);
+
+  FacingScore const none =
+    tuner.Evaluate(sim, FacingMode::Position, PIDGains{0.0f, 0.0f, 0.0f});
+  CHECK(!none.settled);
+  CHECK(none.cost > over.cost);
+
+  // the presets get round the zig zag's corners without needing a repair
+  FacingScore const pursuit =
+    tuner.Evaluate(sim, FacingMode::Pursuit, FacingGains::Pursuit);
+  CHECK(pursuit.settled);
+  CHECK(pursuit.overshoot < sim.player_nav.follower.repair_thresh);
+
+  // where a turn rate limited to a crawl doesn't
+  sim.player_controller.max_turn_rate = 0.3f;
+  FacingScore const sluggish =
+    tuner.Evaluate(sim, FacingMode::Pursuit, FacingGains::Pursuit);
+  CHECK(sluggish.overshoot > pursuit.overshoot);
+  CHECK(sluggish.cost > pursuit.cost);
+}
+
+TEST_CASE("GainTuner finds better gains than it starts with")
+{
+  SyntheticTerrain const terrain;
+  fs::path const dir = SyntheticMMapDir("tuning");
+  GenerateSyntheticMMaps(dir, terrain);
+  GainTuner tuner{dir, terrain};
+  tuner.grid_steps = 3;
+  tuner.refinements = 1;
+  tuner.threads = 2;
+  tuner.max_gains = PIDGains{0.6f, 0.0f, 0.0f};
+
+  FacingScore score;
+  PIDGains const gains = tuner.Tune(FacingMode::Position, &score);
+  CHECK(gains.p > 0.0f);
+  CHECK(gains.p <= 0.6f);
+  CHECK(gains.i == 0.0f);
+  CHECK(score.settled);
+
+  std::vector<FacingScore> const grid = tuner.EvaluateAll(
+    FacingMode::Position, {PIDGains{0.0f, 0.0f, 0.0f}, gains});
+  REQUIRE(grid.size() == 2);
+  CHECK(grid[1].cost == doctest::Approx(score.cost));
+  CHECK(grid[1].cost < grid[0].cost);
+}
+
+// The offline tuner, run with
+//
+//   phlipbot_unittest --no-skip --test-suite=tool
+//
+// and paste the presets it traces into PlayerController.hpp.
+TEST_CASE("tool tune facing gains" * doctest::test_suite("tool") *
+          doctest::skip())
+{
+  SyntheticTerrain const terrain;
+  fs::path const dir = SyntheticMMapDir("tuning");
+  GenerateSyntheticMMaps(dir, terrain);
+  GainTuner const tuner{dir, terrain};
+
+  FacingScore position_score;
+  FacingScore pursuit_score;
+  PIDGains const position =
+    tuner.Tune(FacingMode::Position, &position_score);
+  PIDGains const pursuit = tuner.Tune(FacingMode::Pursuit, &pursuit_score);
+
+  for (FacingScore const* score : {&position_score, &pursuit_score}) {
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "%s: %.3fs to heading, %.3f overshoot, %.1f SetFacing calls",
+      score == &position_score ? "position" : "pursuit",
+      score->time_to_heading, score->overshoot, score->set_facing_calls);
+  }
+  HADESMEM_DETAIL_TRACE_A(GainTuner::FormatPresets(position, pursuit).c_str());
+
+  CHECK(position_score.settled);
+  CHECK(pursuit_score.settled);
+}
+}
+}
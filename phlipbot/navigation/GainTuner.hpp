@@ -0,0 +1,89 @@
+#pragma once
+
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../PID.hpp"
+#include "MovementSim.hpp"
+#include "SyntheticMMap.hpp"
+
+namespace phlipbot
+{
+// The ways PlayerController moves, each with its own facing gains.
+enum class FacingMode {
+  Position, // turn towards a position, on the spot if it's a sharp turn
+  Pursuit,  // pure pursuit along a path
+};
+
+// How well a set of facing gains did over a mode's episodes.
+//
+// Position episodes turn the player on the spot to a handful of facings:
+// time_to_heading is the mean time until the facing settles within
+// settle_tolerance of the setpoint, and overshoot the furthest it turns past
+// it, in radians.
+//
+// The pursuit episode runs a zig zag path: time_to_heading is the time lost
+// to its corners compared to running its length at run speed (negative if
+// cutting them saved more), and overshoot the furthest the player ends up
+// off the path, in yards.
+struct FacingScore {
+  float time_to_heading{0.0f};
+  float overshoot{0.0f};
+  float set_facing_calls{0.0f}; // per episode
+  bool settled{true};           // every episode settled in time
+  float cost{0.0f};
+};
+
+// Tunes PlayerController's facing gains offline by a grid search over
+// episodes in the MovementSim, on the flat nav mesh in mmap_dir (as
+// generated by GenerateSyntheticMMaps from a default SyntheticTerrain).
+//
+// Each thread has its own MMapManager and MovementSim, so episodes run in
+// parallel without sharing anything but the candidate gains.
+struct GainTuner {
+  explicit GainTuner(std::filesystem::path const& mmap_dir,
+                     SyntheticTerrain const& terrain);
+
+  FacingScore Evaluate(MovementSim& sim,
+                       FacingMode const mode,
+                       PIDGains const& gains) const;
+  std::vector<FacingScore> EvaluateAll(
+    FacingMode const mode, std::vector<PIDGains> const& candidates) const;
+
+  // Search a grid_steps^3 grid over the gain ranges, then refinements more
+  // grids, each a third the size, around the best so far.
+  PIDGains Tune(FacingMode const mode, FacingScore* score = nullptr) const;
+
+  // the presets as they're written in PlayerController.hpp
+  static std::string FormatPresets(PIDGains const& position,
+                                   PIDGains const& pursuit);
+
+  // cost = time_to_heading + overshoot_weight * overshoot +
+  //        call_weight * set_facing_calls (+ unsettled_penalty)
+  float overshoot_weight{2.0f};
+  float call_weight{0.005f};
+  float unsettled_penalty{10.0f};
+
+  float settle_tolerance{0.05f};
+  // how long a position episode runs, and a pursuit one at most
+  float position_time{4.0f};
+  float pursuit_time{60.0f};
+
+  PIDGains min_gains{0.0f, 0.0f, 0.0f};
+  PIDGains max_gains{1.0f, 2.0f, 0.2f};
+  uint32_t grid_steps{6};
+  uint32_t refinements{2};
+  uint32_t threads{0}; // 0 for one per core
+
+private:
+  FacingScore EvaluatePosition(MovementSim& sim) const;
+  FacingScore EvaluatePursuit(MovementSim& sim) const;
+
+  std::filesystem::path mmap_dir;
+  uint32_t map_id;
+  vec2i tile;
+  vec3 origin;
+};
+}
@@ -0,0 +1,182 @@
+#include "LineOfWalk.hpp"
+
+#include <cmath>
+
+#include <boost/math/constants/constants.hpp>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+#include "NavQueryFilter.hpp"
+#include "NavWorker.hpp"
+#include "SyntheticMMap.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+// a target further than this above or below the mesh at its feet is on
+// another level
+float const WALK_RAY_MAX_DZ = 2.0f;
+}
+
+namespace phlipbot
+{
+void RaycastWalks(dtNavMeshQuery const& query,
+                  dtQueryFilter const& filter,
+                  dtPolyRef const startRef,
+                  vec3 const& start,
+                  std::vector<vec3> const& targets,
+                  std::vector<WalkRayHit>& hits)
+{
+  hits.assign(targets.size(), WalkRayHit{});
+  if (!startRef) {
+    return;
+  }
+
+  float const startYZX[3] = {start.y, start.z, start.x};
+  dtPolyRef polys[MAX_WALK_RAY_POLYS];
+
+  for (size_t i = 0; i < targets.size(); ++i) {
+    vec3 const& target = targets[i];
+    float const endYZX[3] = {target.y, target.z, target.x};
+
+    float t = 0.0f;
+    float hitNormal[3];
+    int polyCount = 0;
+    dtStatus const res =
+      query.raycast(startRef, startYZX, endYZX, &filter, &t, hitNormal, polys,
+                    &polyCount, MAX_WALK_RAY_POLYS);
+    if (dtStatusFailed(res)) {
+      continue;
+    }
+
+    // t is FLT_MAX if the ray got to the end
+    if (t < 1.0f) {
+      hits[i].fraction = t;
+      continue;
+    }
+
+    hits[i].fraction = 1.0f;
+    hits[i].walkable = true;
+
+    // The ray's 2D, so it also "gets to" targets up on a platform above the
+    // end of its corridor. If the corridor got cut short we can't tell.
+    float height;
+    if (!dtStatusDetail(res, DT_BUFFER_TOO_SMALL) && polyCount > 0 &&
+        dtStatusSucceed(
+          query.getPolyHeight(polys[polyCount - 1], endYZX, &height))) {
+      hits[i].walkable = std::abs(height - target.z) <= WALK_RAY_MAX_DZ;
+    }
+  }
+}
+
+namespace test
+{
+namespace
+{
+// a wall across x = -G / 2 with a gap around y = -G / 2, and a platform at
+// {-G * 3 / 4, -G * 3 / 4} west of it
+SyntheticTerrain WallAndPlatform()
+{
+  SyntheticTerrain terrain;
+  terrain.walls_per_tile = 1;
+  terrain.platforms = true;
+  return terrain;
+}
+}
+
+TEST_CASE("NavWorker::RaycastAsync finds the targets we can walk straight to")
+{
+  SyntheticTerrain const terrain = WallAndPlatform();
+  fs::path const dir = SyntheticMMapDir("line_of_walk");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  NavWorker worker{mmap};
+
+  vec3 const top = SyntheticPlatformCenter(terrain, terrain.first_tile);
+  vec3 const start{-450.0f, -200.0f, terrain.ground_height};
+  std::vector<vec3> const targets{
+    // same side of the wall
+    vec3{-480.0f, -120.0f, terrain.ground_height},
+    // the other side
+    vec3{-150.0f, -200.0f, terrain.ground_height},
+    // beneath the platform, and on top of it
+    vec3{top.xy, terrain.ground_height},
+    top,
+  };
+
+  WalkRayResult const result =
+    worker.RaycastAsync(terrain.map_id, start, targets).get();
+  CHECK(result.map_id == terrain.map_id);
+  REQUIRE(result.hits.size() == targets.size());
+
+  CHECK(result.hits[0].walkable);
+  CHECK(result.hits[0].fraction == 1.0f);
+
+  CHECK(!result.hits[1].walkable);
+  // stopped at the wall
+  CHECK(result.hits[1].fraction > 0.5f);
+  CHECK(result.hits[1].fraction < 0.7f);
+
+  CHECK(result.hits[2].walkable);
+
+  CHECK(!result.hits[3].walkable);
+  CHECK(result.hits[3].fraction == 1.0f);
+
+  // no tiles out here at all
+  WalkRayResult const nowhere =
+    worker.RaycastAsync(terrain.map_id, vec3{5000.0f, 5000.0f, 0.0f}, targets)
+      .get();
+  CHECK(nowhere.hits.empty());
+
+  // or nothing under us, jumping high over the ground
+  WalkRayResult const airborne =
+    worker.RaycastAsync(terrain.map_id, start + vec3{0, 0, 30.0f}, targets)
+      .get();
+  CHECK(airborne.map_id == terrain.map_id);
+  CHECK(airborne.hits.empty());
+}
+
+TEST_CASE("benchmark RaycastWalks to 64 units around the player" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  SyntheticTerrain terrain = WallAndPlatform();
+  terrain.hill_height = 6.0f;
+  fs::path const dir = SyntheticMMapDir("line_of_walk");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMap(terrain.map_id, terrain.first_tile));
+  dtNavMeshQuery const* query = mmap.GetNavMeshQuery(terrain.map_id);
+  REQUIRE(query != nullptr);
+
+  dtQueryFilter const filter = PlayerPathFilter::toQueryFilter();
+  vec2 const center{-300.0f, -250.0f};
+  vec3 const start{center, SyntheticGroundHeight(terrain, center)};
+  float const startYZX[3] = {start.y, start.z, start.x};
+  float const extents[3] = {3.0f, 5.0f, 3.0f};
+  float nearest[3];
+  dtPolyRef startRef = 0;
+  query->findNearestPoly(startYZX, extents, &filter, &startRef, nearest);
+  REQUIRE(startRef != 0);
+
+  // a ring of units at aggro-ish range, some of them behind the wall
+  std::vector<vec3> targets;
+  for (int i = 0; i < 64; ++i) {
+    float const angle = boost::math::float_constants::two_pi * i / 64;
+    vec2 const p =
+      center + vec2{std::cos(angle), std::sin(angle)} * (20.0f + i % 4 * 10);
+    targets.push_back(vec3{p, SyntheticGroundHeight(terrain, p)});
+  }
+
+  std::vector<WalkRayHit> hits;
+  bench::Report("RaycastWalks 64 targets",
+                bench::TimeMicros(1000, [&]() {
+                  RaycastWalks(*query, filter, startRef, start, targets, hits);
+                  bench::DoNotOptimize(hits[0]);
+                }));
+}
+}
+}
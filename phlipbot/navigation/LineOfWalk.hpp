@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include <DetourNavMesh.h>
+#include <DetourNavMeshQuery.h>
+
+#include "../wow_constants.hpp"
+
+namespace phlipbot
+{
+// polys a single walk ray can cross before we stop tracking its corridor
+int const MAX_WALK_RAY_POLYS = 256;
+
+// How a straight walk from the start towards one target went.
+struct WalkRayHit {
+  // how far along the ray we got before hitting a wall or the edge of the
+  // mesh, 1 if we got all the way there
+  float fraction{0.0f};
+  // got all the way there, and on the target's level rather than under or
+  // over it
+  bool walkable{false};
+};
+
+// Raycast along the mesh from start (on startRef) to every target, with
+// dtNavMeshQuery::raycast. hits is resized to match targets. Not thread safe,
+// like the query.
+void RaycastWalks(dtNavMeshQuery const& query,
+                  dtQueryFilter const& filter,
+                  dtPolyRef const startRef,
+                  vec3 const& start,
+                  std::vector<vec3> const& targets,
+                  std::vector<WalkRayHit>& hits);
+}
@@ -0,0 +1,151 @@
+#include "LineOfWalkCache.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include <glm/geometric.hpp>
+
+#include <hadesmem/detail/trace.hpp>
+
+using glm::distance;
+
+namespace phlipbot
+{
+LineOfWalkCache::LineOfWalkCache(ObjectManager& objmgr, NavWorker& nav_worker)
+  : objmgr(objmgr), nav_worker(nav_worker)
+{
+}
+
+void LineOfWalkCache::Update()
+{
+  ++frame;
+
+  auto oplayer = objmgr.GetPlayer();
+  if (!oplayer.has_value()) {
+    units.clear();
+    return;
+  }
+
+  auto const* player = oplayer.get();
+  player_pos = player->GetPosition();
+
+  // nothing we know about the old map is any use
+  uint32_t const current_map_id = objmgr.GetMapId();
+  if (current_map_id != map_id) {
+    map_id = current_map_id;
+    units.clear();
+  }
+
+  // where they were as of this frame's enumeration, straight out of the
+  // cache without touching the units themselves
+  for (auto const& slot : objmgr.GetSlots(ObjectType::UNIT)) {
+    if (slot.guid == player->guid) {
+      continue;
+    }
+    Unit& entry = units[slot.guid];
+    entry.position = slot.position;
+    entry.seen_frame = frame;
+  }
+
+  // forget the units that went out of sight
+  for (auto it = units.begin(); it != units.end();) {
+    if (it->second.seen_frame != frame) {
+      it = units.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  PickUpBatch();
+
+  // one batch at a time, whatever went stale meanwhile goes in the next one
+  if (!batch.valid()) {
+    SendBatch();
+  }
+}
+
+boost::optional<bool> LineOfWalkCache::CanWalkTo(Guid const guid) const
+{
+  auto it = units.find(guid);
+  if (it == units.end() || !IsFresh(it->second)) {
+    return boost::none;
+  }
+  return it->second.hit.walkable;
+}
+
+boost::optional<float> LineOfWalkCache::GetWalkFraction(Guid const guid) const
+{
+  auto it = units.find(guid);
+  if (it == units.end() || !IsFresh(it->second)) {
+    return boost::none;
+  }
+  return it->second.hit.fraction;
+}
+
+size_t LineOfWalkCache::GetWalkableCount() const
+{
+  return size_t(
+    std::count_if(units.begin(), units.end(), [this](auto const& pair) {
+      return IsFresh(pair.second) && pair.second.hit.walkable;
+    }));
+}
+
+bool LineOfWalkCache::IsFresh(Unit const& unit) const
+{
+  return unit.has_hit &&
+         distance(unit.ray_target, unit.position) <= move_threshold &&
+         distance(unit.ray_src, player_pos) <= move_threshold;
+}
+
+void LineOfWalkCache::PickUpBatch()
+{
+  if (!batch.valid() ||
+      batch.wait_for(std::chrono::seconds{0}) != std::future_status::ready) {
+    return;
+  }
+
+  WalkRayResult const result = batch.get();
+
+  // empty if the worker couldn't load any tiles around the player, or
+  // find the mesh under them
+  if (result.map_id != map_id || result.hits.size() != batch_guids.size()) {
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Dropping line of walk batch, %zu hits for %zu units on map %u",
+      result.hits.size(), batch_guids.size(), result.map_id);
+    return;
+  }
+
+  for (size_t i = 0; i < batch_guids.size(); ++i) {
+    auto it = units.find(batch_guids[i]);
+    if (it == units.end()) {
+      continue;
+    }
+
+    Unit& unit = it->second;
+    unit.has_hit = true;
+    unit.hit = result.hits[i];
+    unit.ray_src = batch_src;
+    unit.ray_target = batch_targets[i];
+  }
+}
+
+void LineOfWalkCache::SendBatch()
+{
+  batch_guids.clear();
+  batch_targets.clear();
+  for (auto const& pair : units) {
+    if (!IsFresh(pair.second)) {
+      batch_guids.push_back(pair.first);
+      batch_targets.push_back(pair.second.position);
+    }
+  }
+
+  if (batch_guids.empty()) {
+    return;
+  }
+
+  batch_src = player_pos;
+  raycasts += uint32_t(batch_guids.size());
+  batch = nav_worker.RaycastAsync(map_id, batch_src, batch_targets);
+}
+}
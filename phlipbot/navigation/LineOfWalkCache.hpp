@@ -0,0 +1,81 @@
+#pragma once
+
+#include <future>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "../ObjectManager.hpp"
+#include "LineOfWalk.hpp"
+#include "NavWorker.hpp"
+
+namespace phlipbot
+{
+// Which visible units the player could walk to in a straight line, for
+// kiting and picking pull targets.
+//
+// Update() once a frame. Units whose answer has gone stale (they, or the
+// player, moved more than the move threshold since it was raycast) are sent
+// to the nav worker as one batch, and the answers are picked up on a later
+// frame. Lookups only read the cache, and have no answer for a unit until
+// its batch is back.
+struct LineOfWalkCache {
+  explicit LineOfWalkCache(ObjectManager& objmgr, NavWorker& nav_worker);
+
+  void Update();
+
+  boost::optional<bool> CanWalkTo(Guid const guid) const;
+  // how far along the straight walk to guid we'd get before hitting a wall
+  boost::optional<float> GetWalkFraction(Guid const guid) const;
+
+  void SetMoveThreshold(float const threshold) { move_threshold = threshold; }
+
+  size_t GetUnitCount() const { return units.size(); }
+  size_t GetWalkableCount() const;
+  uint32_t GetRaycastCount() const { return raycasts; }
+
+  // Block until the batch the worker's on, if any, is back. For the movement
+  // sim, which doesn't want the worker running while it steps the player.
+  void WaitForBatch() const
+  {
+    if (batch.valid()) {
+      batch.wait();
+    }
+  }
+
+private:
+  struct Unit {
+    vec3 position; // as of the last Update
+    uint32_t seen_frame{0};
+
+    // the last answer, and where the player and the unit were for it
+    bool has_hit{false};
+    WalkRayHit hit;
+    vec3 ray_src;
+    vec3 ray_target;
+  };
+
+  bool IsFresh(Unit const& unit) const;
+  void PickUpBatch();
+  void SendBatch();
+
+  ObjectManager& objmgr;
+  NavWorker& nav_worker;
+
+  float move_threshold{1.0f};
+
+  uint32_t frame{0};
+  uint32_t map_id{0};
+  vec3 player_pos{0, 0, 0};
+  std::unordered_map<Guid, Unit> units;
+
+  // the batch the worker's working on
+  std::future<WalkRayResult> batch;
+  vec3 batch_src;
+  std::vector<Guid> batch_guids;
+  std::vector<vec3> batch_targets;
+
+  uint32_t raycasts{0};
+};
+}
@@ -18,7 +18,9 @@
 
 #include "MoveMap.hpp"
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
 #include <sstream>
 #include <string>
 
@@ -30,6 +32,7 @@
 
 #include "../wow_constants.hpp"
 
+using std::lock_guard;
 using std::mutex;
 using std::shared_lock;
 using std::shared_mutex;
@@ -42,6 +45,7 @@ using std::make_unique;
 using std::move;
 using std::unique_ptr;
 using std::unordered_map;
+using std::vector;
 
 using std::string;
 using std::stringstream;
@@ -136,6 +140,7 @@ bool MMapManager::loadMapData(uint32_t mapId)
     // acquire writer lock
     unique_lock<shared_mutex> lock(loadedMMaps_lock);
     if (loadedMMaps.find(mapId) == loadedMMaps.end()) {
+      mmap_data->instance = ++lastMapInstance;
       loadedMMaps.insert({mapId, move(mmap_data)});
     }
   }
@@ -270,37 +275,48 @@ bool MMapManager::unloadMap(uint32_t mapId, vec2i const& tile)
 
   MMapData* mmap = loadedMMaps[mapId].get();
 
-  // check if we have this tile loaded
-  uint32_t packedGridPos = packTileID(tile);
-  if (mmap->mmapLoadedTiles.find(packedGridPos) ==
-      mmap->mmapLoadedTiles.end()) {
-    // file may not exist, therefore not loaded
-    HADESMEM_DETAIL_TRACE_FORMAT_A(
-      "Trying to unload mmap tile that hasn't been loaded. %03u%02d%02d.mmtile",
-      mapId, tile.x, tile.y);
-    return false;
-  }
+  {
+    // exclusively acquire the loading lock, getHeightGrid may be reading the
+    // tile
+    unique_lock<mutex> lock{mmap->tilesLoading_lock};
+
+    // check if we have this tile loaded
+    uint32_t packedGridPos = packTileID(tile);
+    if (mmap->mmapLoadedTiles.find(packedGridPos) ==
+        mmap->mmapLoadedTiles.end()) {
+      // file may not exist, therefore not loaded
+      HADESMEM_DETAIL_TRACE_FORMAT_A("Trying to unload mmap tile that hasn't "
+                                     "been loaded. %03u%02d%02d.mmtile",
+                                     mapId, tile.x, tile.y);
+      return false;
+    }
 
-  dtTileRef tileRef = mmap->mmapLoadedTiles[packedGridPos];
+    dtTileRef tileRef = mmap->mmapLoadedTiles[packedGridPos];
 
-  // unload, and mark as non loaded
-  dtStatus res = mmap->navMesh->removeTile(tileRef, nullptr, nullptr);
-  if (dtStatusFailed(res)) {
-    // this is technically a memory leak
-    // if the grid is later reloaded, dtNavMesh::addTile will return error but
-    // no extra memory is used we cannot recover from this error
-    HADESMEM_DETAIL_THROW_EXCEPTION(
-      hadesmem::Error{}
-      << ErrorString{"Failed to unload mmap tile from navmesh"}
-      << ErrorMapId{mapId} << ErrorMapTile{tile});
-  }
+    // unload, and mark as non loaded
+    dtStatus res = mmap->navMesh->removeTile(tileRef, nullptr, nullptr);
+    if (dtStatusFailed(res)) {
+      // this is technically a memory leak
+      // if the grid is later reloaded, dtNavMesh::addTile will return error
+      // but no extra memory is used we cannot recover from this error
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error{}
+        << ErrorString{"Failed to unload mmap tile from navmesh"}
+        << ErrorMapId{mapId} << ErrorMapTile{tile});
+    }
 
-  mmap->mmapLoadedTiles.erase(packedGridPos);
-  --loadedTiles;
+    mmap->mmapLoadedTiles.erase(packedGridPos);
+    --loadedTiles;
+
+    lock_guard<mutex> grids_lock{mmap->heightGrids_lock};
+    mmap->heightGrids.erase(packedGridPos);
+  }
 
   HADESMEM_DETAIL_TRACE_FORMAT_A("Unloaded mmap tile %03u%02d%02d.mmtile",
                                  mapId, tile.x, tile.y);
 
+  notifyTileUnloaded(mapId, tile);
+
   return true;
 }
 
@@ -314,26 +330,44 @@ bool MMapManager::unloadMap(uint32_t mapId)
   }
 
   bool success_flag = true;
+  vector<vec2i> tiles;
 
   // unload all tiles from given map
   MMapData* mmap = loadedMMaps[mapId].get();
-  for (auto& pair : mmap->mmapLoadedTiles) {
-    vec2i const tile{pair.first >> 16, pair.first & 0x0000FFFF};
-
-    dtStatus res = mmap->navMesh->removeTile(pair.second, nullptr, nullptr);
-    if (dtStatusFailed(res)) {
-      HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "Could not unload %03u%02i%02i.mmtile from navmesh", mapId, tile.x,
-        tile.x);
-      success_flag = false;
-    } else {
-      HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "Unloaded %03u%02i%02i.mmtile from navmesh", mapId, tile.x, tile.y);
-      --loadedTiles;
+  {
+    // exclusively acquire the loading lock, getHeightGrid may be reading a
+    // tile. It has to be released before the map, and the lock with it, goes.
+    unique_lock<mutex> lock{mmap->tilesLoading_lock};
+
+    for (auto& pair : mmap->mmapLoadedTiles) {
+      vec2i const tile{pair.first >> 16, pair.first & 0x0000FFFF};
+      tiles.push_back(tile);
+
+      dtStatus res = mmap->navMesh->removeTile(pair.second, nullptr, nullptr);
+      if (dtStatusFailed(res)) {
+        HADESMEM_DETAIL_TRACE_FORMAT_A(
+          "Could not unload %03u%02i%02i.mmtile from navmesh", mapId, tile.x,
+          tile.x);
+        success_flag = false;
+      } else {
+        HADESMEM_DETAIL_TRACE_FORMAT_A(
+          "Unloaded %03u%02i%02i.mmtile from navmesh", mapId, tile.x, tile.y);
+        --loadedTiles;
+      }
     }
   }
 
-  loadedMMaps.erase(mapId);
+  {
+    // acquire writer lock, GetNavMesh may be looking the map up
+    unique_lock<shared_mutex> lock{loadedMMaps_lock};
+    loadedMMaps.erase(mapId);
+  }
+
+  // the nav mesh is gone, so refs into any of its tiles are stale, including
+  // the ones that failed to unload
+  for (auto const& tile : tiles) {
+    notifyTileUnloaded(mapId, tile);
+  }
 
   if (success_flag) {
     HADESMEM_DETAIL_TRACE_FORMAT_A("Unloaded %03u.mmap from navmesh", mapId);
@@ -369,24 +403,239 @@ bool MMapManager::unloadMapInstance(uint32_t mapId, thread::id tid)
   return true;
 }
 
+uint32_t MMapManager::getTileGeneration(uint32_t mapId)
+{
+  lock_guard<mutex> lock{tileUnloads_lock};
+  auto it = tileGenerations.find(mapId);
+  return it != tileGenerations.end() ? it->second : 0;
+}
+
+uint32_t MMapManager::addTileUnloadListener(TileUnloadListener listener)
+{
+  lock_guard<mutex> lock{tileUnloads_lock};
+  uint32_t const id = nextTileUnloadListenerId++;
+  tileUnloadListeners.emplace_back(id, std::move(listener));
+  return id;
+}
+
+void MMapManager::removeTileUnloadListener(uint32_t id)
+{
+  lock_guard<mutex> lock{tileUnloads_lock};
+  auto it = std::find_if(tileUnloadListeners.begin(), tileUnloadListeners.end(),
+                         [id](auto const& pair) { return pair.first == id; });
+  if (it != tileUnloadListeners.end()) {
+    tileUnloadListeners.erase(it);
+  }
+}
+
+void MMapManager::notifyTileUnloaded(uint32_t mapId, vec2i const& tile)
+{
+  uint32_t generation;
+  vector<TileUnloadListener> listeners;
+  {
+    lock_guard<mutex> lock{tileUnloads_lock};
+    generation = ++tileGenerations[mapId];
+    for (auto const& pair : tileUnloadListeners) {
+      listeners.push_back(pair.second);
+    }
+  }
+
+  // outside the lock, so listeners can remove themselves
+  for (auto const& listener : listeners) {
+    listener(mapId, tile, generation);
+  }
+}
+
+std::shared_ptr<TileHeightGrid const>
+MMapManager::getHeightGrid(uint32_t mapId, vec2i const& tile)
+{
+  MMapData* mmap;
+  {
+    // acquire reader lock
+    shared_lock<shared_mutex> lock{loadedMMaps_lock};
+
+    auto it = loadedMMaps.find(mapId);
+    if (it == loadedMMaps.end()) {
+      return nullptr;
+    }
+    mmap = it->second.get();
+  }
+
+  uint32_t const packedGridPos = packTileID(tile);
+  {
+    lock_guard<mutex> lock{mmap->heightGrids_lock};
+    auto it = mmap->heightGrids.find(packedGridPos);
+    if (it != mmap->heightGrids.end()) {
+      return it->second;
+    }
+  }
+
+  // hold the loading lock while we read the tile, so it can't be unloaded out
+  // from under us
+  unique_lock<mutex> lock{mmap->tilesLoading_lock};
+
+  auto tile_it = mmap->mmapLoadedTiles.find(packedGridPos);
+  if (tile_it == mmap->mmapLoadedTiles.end()) {
+    return nullptr;
+  }
+
+  {
+    // another thread may have built it while we waited
+    lock_guard<mutex> grids_lock{mmap->heightGrids_lock};
+    auto it = mmap->heightGrids.find(packedGridPos);
+    if (it != mmap->heightGrids.end()) {
+      return it->second;
+    }
+  }
+
+  dtMeshTile const* meshTile = mmap->navMesh->getTileByRef(tile_it->second);
+  HADESMEM_DETAIL_ASSERT(meshTile && meshTile->header);
+  auto grid = std::make_shared<TileHeightGrid const>(*meshTile);
+
+  HADESMEM_DETAIL_TRACE_FORMAT_A(
+    "Built height grid for %03u%02d%02d.mmtile, %d walkable %d ambiguous",
+    mapId, tile.x, tile.y, grid->GetWalkableCells(),
+    grid->GetAmbiguousCells());
+
+  lock_guard<mutex> grids_lock{mmap->heightGrids_lock};
+  mmap->heightGrids.insert({packedGridPos, grid});
+  return grid;
+}
+
+bool MMapManager::sampleGroundHeight(uint32_t mapId,
+                                     TileHeightGrid const* grid,
+                                     vec3 const& pos,
+                                     float& height)
+{
+  if (!grid) {
+    return false;
+  }
+  return grid->Sample(pos.xy, height) ||
+         getExactGroundHeight(mapId, pos, height);
+}
+
+bool MMapManager::getGroundHeight(uint32_t mapId,
+                                  vec3 const& pos,
+                                  float& height)
+{
+  auto const grid = getHeightGrid(mapId, tileFromPos(pos.xy));
+  return sampleGroundHeight(mapId, grid.get(), pos, height);
+}
+
+size_t MMapManager::getGroundHeights(uint32_t mapId,
+                                     vector<vec3> const& positions,
+                                     vector<float>& heights)
+{
+  heights.resize(positions.size());
+
+  size_t found = 0;
+  std::shared_ptr<TileHeightGrid const> grid;
+  vec2i gridTile{-1, -1};
+  for (size_t i = 0; i < positions.size(); ++i) {
+    vec3 const& pos = positions[i];
+
+    // positions usually come clustered, so this is rarely a lookup
+    vec2i const tile = tileFromPos(pos.xy);
+    if (tile != gridTile) {
+      grid = getHeightGrid(mapId, tile);
+      gridTile = tile;
+    }
+
+    if (sampleGroundHeight(mapId, grid.get(), pos, heights[i])) {
+      ++found;
+    } else {
+      heights[i] = std::numeric_limits<float>::quiet_NaN();
+    }
+  }
+
+  return found;
+}
+
+bool MMapManager::getExactGroundHeight(uint32_t mapId,
+                                       vec3 const& pos,
+                                       float& height)
+{
+  MMapData* mmap;
+  {
+    // acquire reader lock
+    shared_lock<shared_mutex> lock{loadedMMaps_lock};
+
+    auto it = loadedMMaps.find(mapId);
+    if (it == loadedMMaps.end()) {
+      return false;
+    }
+    mmap = it->second.get();
+  }
+
+  dtNavMeshQuery const* query = GetNavMeshQuery(mapId);
+  if (!query) {
+    return false;
+  }
+
+  // everything walkable, swimmable included
+  dtQueryFilter filter;
+  filter.setIncludeFlags(0xFFFF);
+  filter.setExcludeFlags(0x0);
+
+  float const center[3] = {pos.y, pos.z, pos.x};
+  float const extents[3] = {1.0f, HEIGHT_SEARCH_DIST, 1.0f};
+  float nearest[3];
+  dtPolyRef ref = 0;
+
+  // another thread may be loading or unloading the tiles we're reading
+  unique_lock<mutex> lock{mmap->tilesLoading_lock};
+  dtStatus res =
+    query->findNearestPoly(center, extents, &filter, &ref, nearest);
+  if (dtStatusFailed(res) || !ref) {
+    return false;
+  }
+
+  // nearest is on the poly, even if pos was just off its edge
+  return dtStatusSucceed(query->getPolyHeight(ref, nearest, &height));
+}
+
 dtNavMesh const* MMapManager::GetNavMesh(uint32_t mapId)
 {
-  if (loadedMMaps.find(mapId) == loadedMMaps.end()) {
+  // acquire reader lock
+  shared_lock<shared_mutex> lock{loadedMMaps_lock};
+
+  auto it = loadedMMaps.find(mapId);
+  if (it == loadedMMaps.end()) {
     return nullptr;
   }
 
-  return loadedMMaps[mapId].get()->navMesh.get();
+  return it->second->navMesh.get();
+}
+
+uint32_t MMapManager::getMapInstance(uint32_t mapId)
+{
+  // acquire reader lock
+  shared_lock<shared_mutex> lock{loadedMMaps_lock};
+
+  auto it = loadedMMaps.find(mapId);
+  if (it == loadedMMaps.end()) {
+    return 0;
+  }
+
+  return it->second->instance;
 }
 
 dtNavMeshQuery const* MMapManager::GetNavMeshQuery(uint32_t mapId)
 {
-  if (loadedMMaps.find(mapId) == loadedMMaps.end()) {
-    return nullptr;
+  MMapData* mmap;
+  {
+    // acquire reader lock, another thread may be loading a map
+    shared_lock<shared_mutex> lock{loadedMMaps_lock};
+
+    auto it = loadedMMaps.find(mapId);
+    if (it == loadedMMaps.end()) {
+      return nullptr;
+    }
+    mmap = it->second.get();
   }
 
   // uint32_t tid = ACE_Based::Thread::currentId();
   thread::id tid{this_thread::get_id()};
-  MMapData* mmap = loadedMMaps[mapId].get();
 
   // acquire reader lock
   mmap->navMeshQueries_lock.lock_shared();
@@ -424,6 +673,28 @@ dtNavMeshQuery const* MMapManager::GetNavMeshQuery(uint32_t mapId)
   return navMeshQuery;
 }
 
+// TODO(phlip9): for now, assume destination is close, but we will eventually
+//               have to load more intelligently
+bool MMapManager::loadMapAround(uint32_t mapId, vec2 const& pos)
+{
+  vec2i const tile = tileFromPos(pos);
+
+  bool any_success = false;
+  for (int i = -1; i <= 1; ++i) {
+    for (int j = -1; j <= 1; ++j) {
+      vec2i const offset{i, j};
+      any_success |= loadMap(mapId, tile + offset);
+    }
+  }
+
+  if (!any_success) {
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Failed to load any tiles around tile {%d, %d}", tile.x, tile.y);
+  }
+
+  return any_success;
+}
+
 bool MMapManager::loadGameObject(uint32_t displayId)
 {
   // we already have this map loaded?
@@ -19,11 +19,14 @@
  */
 
 #include <filesystem>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <boost/exception/error_info.hpp>
 
@@ -33,6 +36,7 @@
 
 #include "../wow_constants.hpp"
 #include "MoveMapSharedDefines.hpp"
+#include "TileHeightGrid.hpp"
 
 // TODO(phlip9): make MMapManager::mmapDir configurable
 
@@ -51,7 +55,12 @@ using ErrorDTResult = boost::error_info<struct TagErrorDTResult, uint32_t>;
 using ErrorGODisplayId =
   boost::error_info<struct TagErrorGODisplayId, uint32_t>;
 
+// how far up and down getExactGroundHeight looks for a poly
+float const HEIGHT_SEARCH_DIST = 50.0f;
+
 using MMapTileSet = std::unordered_map<uint32_t, dtTileRef>;
+using HeightGridSet =
+  std::unordered_map<uint32_t, std::shared_ptr<TileHeightGrid const>>;
 using NavMeshQuerySet =
   std::unordered_map<std::thread::id, std::unique_ptr<dtNavMeshQuery>>;
 
@@ -60,6 +69,8 @@ struct MMapData {
   MMapData(std::unique_ptr<dtNavMesh>&& mesh) : navMesh(std::move(mesh)) {}
 
   std::unique_ptr<dtNavMesh> navMesh;
+  // which load of the map this is, see MMapManager::getMapInstance
+  uint32_t instance{0};
 
   // we have to use single dtNavMeshQuery for every instance, since those are
   // not thread safe
@@ -67,10 +78,19 @@ struct MMapData {
   std::shared_mutex navMeshQueries_lock;
   MMapTileSet mmapLoadedTiles; // maps [map grid coords] to [dtTile]
   std::mutex tilesLoading_lock;
+
+  // built the first time one of a tile's heights is asked for, and dropped
+  // with the tile
+  HeightGridSet heightGrids; // maps [map grid coords] to grid
+  std::mutex heightGrids_lock;
 };
 
 using MMapDataSet = std::unordered_map<uint32_t, std::unique_ptr<MMapData>>;
 
+// (mapId, tile, tile generation after the unload)
+using TileUnloadListener =
+  std::function<void(uint32_t mapId, vec2i const& tile, uint32_t generation)>;
+
 // singelton class
 // holds all all access to mmap loading unloading and meshes
 struct MMapManager {
@@ -96,6 +116,8 @@ struct MMapManager {
 
   bool loadMapData(uint32_t mapId);
   bool loadMap(uint32_t mapId, vec2i const& tile);
+  // load the 3x3 tiles around pos, true if any of them loaded
+  bool loadMapAround(uint32_t mapId, vec2 const& pos);
   bool loadGameObject(uint32_t displayId);
   bool unloadMap(uint32_t mapId, vec2i const& tile);
   bool unloadMap(uint32_t mapId);
@@ -107,6 +129,37 @@ struct MMapManager {
   dtNavMeshQuery const* GetModelNavMeshQuery(uint32_t displayId);
   dtNavMesh const* GetNavMesh(uint32_t mapId);
 
+  // Bumped every time one of mapId's tiles is unloaded, including by
+  // unloading the whole map. Poly refs into mapId can only have gone stale if
+  // this changed since they were found.
+  uint32_t getTileGeneration(uint32_t mapId);
+
+  // Different every time mapId's nav mesh is loaded, 0 while it isn't. A
+  // reloaded map's dtNavMesh can be allocated where the old one was, and its
+  // tiles' salts start over, so this is what tells the two apart.
+  uint32_t getMapInstance(uint32_t mapId);
+
+  // Call listener after every tile unload, on the unloading thread, once the
+  // tile is gone from the nav mesh. Returns an id for removing it.
+  uint32_t addTileUnloadListener(TileUnloadListener listener);
+  void removeTileUnloadListener(uint32_t id);
+
+  // Walkable height at pos.xy, from the level nearest pos.z where there's
+  // more than one. Reads the tile's height grid, and falls back to
+  // getExactGroundHeight where the grid can't tell (several levels, ledges,
+  // the edge of the mesh). False if there's no loaded mesh under pos.
+  bool getGroundHeight(uint32_t mapId, vec3 const& pos, float& height);
+  // getGroundHeight for every position at once, which only looks each tile's
+  // grid up once per run of positions in it. heights is resized to match,
+  // with NaN where there's no ground. Returns how many heights were found.
+  size_t getGroundHeights(uint32_t mapId,
+                          std::vector<vec3> const& positions,
+                          std::vector<float>& heights);
+  // Height of the nearest poly to pos, searching HEIGHT_SEARCH_DIST up and
+  // down. Uses the current thread's dtNavMeshQuery, under the map's tile
+  // loading lock.
+  bool getExactGroundHeight(uint32_t mapId, vec3 const& pos, float& height);
+
   uint32_t getLoadedTilesCount() const { return loadedTiles; }
   uint32_t getLoadedMapsCount() const { return loadedMMaps.size(); }
 
@@ -115,8 +168,24 @@ private:
 
   MMapDataSet loadedMMaps;
   std::shared_mutex loadedMMaps_lock;
+  uint32_t lastMapInstance{0}; // guarded by loadedMMaps_lock
   MMapDataSet loadedModels;
   uint32_t loadedTiles;
   std::mutex lockForModels;
+
+  void notifyTileUnloaded(uint32_t mapId, vec2i const& tile);
+
+  // nullptr if the tile isn't loaded
+  std::shared_ptr<TileHeightGrid const> getHeightGrid(uint32_t mapId,
+                                                      vec2i const& tile);
+  bool sampleGroundHeight(uint32_t mapId,
+                          TileHeightGrid const* grid,
+                          vec3 const& pos,
+                          float& height);
+
+  std::unordered_map<uint32_t, uint32_t> tileGenerations; // mapId to gen
+  std::vector<std::pair<uint32_t, TileUnloadListener>> tileUnloadListeners;
+  uint32_t nextTileUnloadListenerId{1};
+  std::mutex tileUnloads_lock;
 };
 }
@@ -0,0 +1,411 @@
+#include "MovementSim.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+
+#include <boost/math/constants/constants.hpp>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+#include "SyntheticMMap.hpp"
+
+namespace fs = std::filesystem;
+
+using boost::math::float_constants::half_pi;
+using boost::math::float_constants::two_pi;
+
+using glm::distance;
+using glm::length;
+
+namespace
+{
+float NormalizeFacing(float const facing)
+{
+  float const normal = std::fmod(facing, two_pi);
+  return normal < 0.0f ? normal + two_pi : normal;
+}
+
+// facing 0 is +x, increasing counter clockwise
+phlipbot::vec2 FacingDir(float const facing)
+{
+  return phlipbot::vec2{std::cos(facing), std::sin(facing)};
+}
+}
+
+namespace phlipbot
+{
+SimPlayer::SimPlayer(Guid const guid)
+  : WowPlayer(guid, reinterpret_cast<uintptr_t>(bytes.get()))
+{
+  bytes[offsets::ObjectManagerOffsets::ObjType] =
+    static_cast<unsigned char>(ObjectType::PLAYER);
+  CMovementData* movement = GetMovement();
+  movement->guid = guid;
+  movement->run_speed = 7.0f;
+}
+
+void SimPlayer::SendUpdateMovement(uint32_t, MovementOpCode)
+{
+  ++movement_packets;
+}
+
+void SimPlayer::SetFacing(float const facing_radians)
+{
+  GetMovement()->facing = NormalizeFacing(facing_radians);
+  ++set_facing_calls;
+}
+
+bool SimPlayer::ClickToMove(CtmType const,
+                            Guid const,
+                            vec3 const& target_pos,
+                            float const)
+{
+  WowPlayer::SetFacing(target_pos);
+  return true;
+}
+
+uint32_t SimPlayer::SetControlBits(uint32_t const flags, uint32_t)
+{
+  GetMovement()->move_flags |= ControlMoveFlags(flags);
+  return 1;
+}
+
+uint32_t SimPlayer::UnsetControlBits(uint32_t const flags, uint32_t)
+{
+  GetMovement()->move_flags &= ~ControlMoveFlags(flags);
+  return 1;
+}
+
+SimUnit::SimUnit(Guid const guid)
+  : WowUnit(guid, reinterpret_cast<uintptr_t>(bytes.get()))
+{
+  bytes[offsets::ObjectManagerOffsets::ObjType] =
+    static_cast<unsigned char>(ObjectType::UNIT);
+  GetMovement()->guid = guid;
+}
+
+SimObjectManager::SimObjectManager(uint32_t const map_id) : map_id(map_id)
+{
+  auto sim_player = std::make_unique<SimPlayer>(player_guid);
+  player = sim_player.get();
+  AddObject(std::move(sim_player));
+}
+
+SimUnit& SimObjectManager::AddSimUnit(Guid const guid)
+{
+  auto sim_unit = std::make_unique<SimUnit>(guid);
+  SimUnit& unit = *sim_unit;
+  AddObject(std::move(sim_unit));
+  return unit;
+}
+
+void SimObjectManager::RemoveSimUnit(Guid const guid)
+{
+  RemoveObject(guid);
+}
+
+MovementSim::MovementSim(MMapManager& mmap, uint32_t const map_id)
+  : mmap(mmap),
+    objmgr(map_id),
+    commands(objmgr),
+    player_controller(objmgr, commands),
+    player_nav(objmgr, player_controller, mmap)
+{
+  // every tick's a control step, there are no frames in between
+  player_controller.interpolate_facing = false;
+}
+
+SimEpisodeResult MovementSim::Run(SimEpisode const& episode)
+{
+  SimPlayer& player = objmgr.GetSimPlayer();
+  CMovementData& movement = *player.GetMovement();
+  commands.Clear();
+  movement.position = episode.start;
+  movement.move_flags = 0;
+  movement.run_speed = run_speed;
+
+  SimEpisodeResult result;
+  player_nav.SetDestination(episode.dest);
+  player_nav.SetEnabled(true);
+
+  uint32_t const repairs = player_nav.repairs;
+  uint32_t const replans = player_nav.replans;
+  uint32_t const forward_toggles = player_controller.forward_toggles;
+  uint32_t const set_facing_calls = player.set_facing_calls;
+
+  double cross_track_sum = 0.0;
+  double cpu_us = 0.0;
+  bool knocked = false;
+  float time = 0.0f;
+  while (time < episode.time_limit) {
+    if (!knocked && episode.knockback_time >= 0.0f &&
+        time >= episode.knockback_time) {
+      movement.position += episode.knockback;
+      knocked = true;
+    }
+
+    vec3 const prev_pos = movement.position;
+
+    auto start = std::chrono::steady_clock::now();
+    player_nav.Update(tick_dt);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    cpu_us += std::chrono::duration<double, std::micro>{elapsed}.count();
+
+    // Planning doesn't count. It's done before Tick, so no worker job is
+    // reading the nav mesh while Tick samples the ground height.
+    WaitForWorker();
+
+    start = std::chrono::steady_clock::now();
+    player_controller.Update(tick_dt);
+    Tick(tick_dt);
+    elapsed = std::chrono::steady_clock::now() - start;
+    cpu_us += std::chrono::duration<double, std::micro>{elapsed}.count();
+
+    time += tick_dt;
+    ++result.ticks;
+    result.distance_walked += distance(prev_pos, movement.position);
+    float const cross_track = player_nav.follower.GetCrossTrack();
+    result.max_cross_track = std::max(result.max_cross_track, cross_track);
+    cross_track_sum += cross_track;
+
+    bool const running = (movement.move_flags & MovementFlags::Forward) != 0;
+    if (!running &&
+        length((movement.position - episode.dest).xy) <= arrive_radius) {
+      result.arrived = true;
+      break;
+    }
+  }
+
+  player_nav.SetEnabled(false);
+
+  result.arrival_time = time;
+  result.mean_cross_track =
+    result.ticks ? float(cross_track_sum / result.ticks) : 0.0f;
+  result.cpu_us_per_tick = result.ticks ? cpu_us / result.ticks : 0.0;
+  result.repairs = player_nav.repairs - repairs;
+  result.replans = player_nav.replans - replans;
+  result.forward_toggles = player_controller.forward_toggles - forward_toggles;
+  result.set_facing_calls = player.set_facing_calls - set_facing_calls;
+  return result;
+}
+
+void MovementSim::Tick(float const dt)
+{
+  // what the controller asked for this tick, like at the end of a frame
+  clock += dt;
+  commands.Flush(static_cast<uint32_t>(clock * 1000.0f));
+
+  CMovementData& movement = *objmgr.GetSimPlayer().GetMovement();
+  uint32_t const flags = movement.move_flags;
+
+  float facing = movement.facing;
+  if (flags & MovementFlags::TurnLeft) {
+    facing += turn_rate * dt;
+  }
+  if (flags & MovementFlags::TurnRight) {
+    facing -= turn_rate * dt;
+  }
+  facing = NormalizeFacing(facing);
+  movement.facing = facing;
+
+  vec2 dir{0.0f, 0.0f};
+  float speed = movement.run_speed;
+  if (flags & MovementFlags::Forward) {
+    dir += FacingDir(facing);
+  } else if (flags & MovementFlags::Backward) {
+    dir -= FacingDir(facing);
+    speed = back_speed;
+  }
+  if (flags & MovementFlags::StrafeLeft) {
+    dir += FacingDir(facing + half_pi);
+  }
+  if (flags & MovementFlags::StrafeRight) {
+    dir -= FacingDir(facing + half_pi);
+  }
+
+  movement.current_speed = 0.0f;
+  if (length(dir) < 1e-3f) {
+    return;
+  }
+
+  vec3 next = movement.position;
+  next.xy += glm::normalize(dir) * speed * dt;
+
+  // walls and ledges too high to climb stop us, drops don't
+  float height;
+  if (!mmap.getGroundHeight(objmgr.GetMapId(), next, height) ||
+      height - movement.position.z > max_climb) {
+    return;
+  }
+
+  next.z = height;
+  movement.position = next;
+  movement.current_speed = speed;
+}
+
+void MovementSim::WaitForWorker()
+{
+  if (player_nav.path_request.valid()) {
+    player_nav.path_request.wait();
+  }
+  if (player_nav.repair_request.valid()) {
+    player_nav.repair_request.wait();
+  }
+  player_nav.walk_cache.WaitForBatch();
+}
+
+namespace test
+{
+namespace
+{
+// tile {32, 32} covers game x and y in [-G, 0], with a wall across x = -G/2
+// that has a gap around y = -G/2
+SyntheticTerrain WallTerrain()
+{
+  SyntheticTerrain terrain;
+  terrain.walls_per_tile = 1;
+  return terrain;
+}
+
+vec3 const WallStart{-MMAP_GRID_SIZE * 0.75f, -MMAP_GRID_SIZE * 0.3f, 0.0f};
+vec3 const WallDest{-MMAP_GRID_SIZE * 0.25f, -MMAP_GRID_SIZE * 0.7f, 0.0f};
+}
+
+TEST_CASE("SimPlayer moves by its control bits")
+{
+  SyntheticTerrain const terrain;
+  fs::path const dir = SyntheticMMapDir("sim_flat");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMap(terrain.map_id, terrain.first_tile));
+  MovementSim sim{mmap, terrain.map_id};
+
+  SimPlayer& player = sim.objmgr.GetSimPlayer();
+  REQUIRE(sim.objmgr.GetPlayer().has_value());
+  CHECK(sim.objmgr.GetPlayer().get() == &player);
+
+  CMovementData& movement = *player.GetMovement();
+  vec3 const start{-200.0f, -200.0f, 0.0f};
+  movement.position = start;
+  player.SetFacing(0.0f);
+
+  // standing still
+  sim.Tick(1.0f);
+  CHECK(movement.position == start);
+
+  player.SetControlBits(InputControlFlags::Forward, 0);
+  CHECK((movement.move_flags & MovementFlags::Forward) != 0);
+  sim.Tick(1.0f);
+  CHECK(movement.position.x == doctest::Approx(start.x + sim.run_speed));
+  CHECK(movement.position.y == doctest::Approx(start.y));
+  CHECK(std::abs(movement.position.z - terrain.ground_height) < 0.5f);
+
+  player.UnsetControlBits(InputControlFlags::Forward, 0);
+  player.SetControlBits(InputControlFlags::TurnLeft, 0);
+  sim.Tick(0.5f);
+  CHECK(movement.facing == doctest::Approx(sim.turn_rate * 0.5f));
+  CHECK(movement.position.x == doctest::Approx(start.x + sim.run_speed));
+
+  // nowhere to stand off the edge of the loaded tiles
+  player.UnsetControlBits(InputControlFlags::TurnLeft, 0);
+  movement.position = vec3{-2.0f, -200.0f, 0.0f};
+  player.SetFacing(0.0f);
+  player.SetControlBits(InputControlFlags::Forward, 0);
+  sim.Tick(1.0f);
+  CHECK(movement.position.x == doctest::Approx(-2.0f));
+}
+
+TEST_CASE("MovementSim runs the navigator through a wall's gap")
+{
+  SyntheticTerrain const terrain = WallTerrain();
+  fs::path const dir = SyntheticMMapDir("sim_walls");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  MovementSim sim{mmap, terrain.map_id};
+
+  SimEpisode episode;
+  episode.start = WallStart;
+  episode.dest = WallDest;
+  SimEpisodeResult const pursuit = sim.Run(episode);
+  CHECK(pursuit.arrived);
+  // further than straight there, since it has to go through the gap
+  CHECK(pursuit.distance_walked > distance(WallStart, WallDest));
+  CHECK(pursuit.max_cross_track < sim.player_nav.follower.repair_thresh);
+  CHECK(pursuit.replans == 0);
+
+  sim.player_nav.SetPursuit(false);
+  SimEpisodeResult const waypoints = sim.Run(episode);
+  CHECK(waypoints.arrived);
+  // no stopping at the waypoints
+  CHECK(pursuit.arrival_time < waypoints.arrival_time + 1.0f);
+  CHECK(pursuit.forward_toggles <= waypoints.forward_toggles);
+}
+
+TEST_CASE("MovementSim recovers from a knockback")
+{
+  SyntheticTerrain const terrain = WallTerrain();
+  fs::path const dir = SyntheticMMapDir("sim_walls");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  MovementSim sim{mmap, terrain.map_id};
+
+  SimEpisode episode;
+  episode.start = WallStart;
+  episode.dest = WallDest;
+  episode.knockback_time = 5.0f;
+  // about 9 yards sideways off the way to the gap
+  episode.knockback = vec3{-4.0f, -8.0f, 0.0f};
+  SimEpisodeResult const result = sim.Run(episode);
+  CHECK(result.arrived);
+  CHECK(result.max_cross_track > sim.player_nav.follower.repair_thresh);
+  CHECK(result.repairs + result.replans > 0);
+}
+
+TEST_CASE("benchmark movement sim episodes" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  SyntheticTerrain terrain = WallTerrain();
+  terrain.hill_height = 6.0f;
+  fs::path const dir = SyntheticMMapDir("sim_bench");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  MovementSim sim{mmap, terrain.map_id};
+
+  SimEpisode episode;
+  episode.start = WallStart;
+  episode.dest = WallDest;
+
+  for (bool const pursuit : {true, false}) {
+    sim.player_nav.SetPursuit(pursuit);
+
+    std::vector<double> cpu;
+    float sim_time = 0.0f;
+    uint32_t arrived = 0;
+    auto const start = bench::clock::now();
+    for (int i = 0; i < 20; ++i) {
+      SimEpisodeResult const result = sim.Run(episode);
+      cpu.push_back(result.cpu_us_per_tick);
+      sim_time += result.arrival_time;
+      arrived += result.arrived ? 1 : 0;
+    }
+    double const wall_s =
+      std::chrono::duration<double>{bench::clock::now() - start}.count();
+
+    bench::Report(pursuit ? "pursuit tick" : "waypoint tick",
+                  bench::Percentile(cpu, 50));
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "%s: %u of 20 arrived, %.1fs simulated in %.3fs (%.0fx real time)",
+      pursuit ? "pursuit" : "waypoints", arrived, sim_time, wall_s,
+      sim_time / wall_s);
+  }
+}
+}
+}
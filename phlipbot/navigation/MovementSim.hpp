@@ -0,0 +1,145 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../MovementCommands.hpp"
+#include "../ObjectManager.hpp"
+#include "../PlayerController.hpp"
+#include "../WowPlayer.hpp"
+#include "MoveMap.hpp"
+#include "PlayerNavigator.hpp"
+
+namespace phlipbot
+{
+namespace detail
+{
+// Zeroed stand in for the client's memory behind a player object. A base of
+// SimPlayer so it exists before WowPlayer is handed its address.
+struct SimObjectMemory {
+  static size_t const Size = 0x1000;
+  std::unique_ptr<unsigned char[]> bytes{new unsigned char[Size]()};
+};
+}
+
+// A player that only exists in memory. WowPlayer reads its movement data out
+// of SimObjectMemory like it would the client's, and the calls it'd make into
+// the client just update it. MovementSim moves it.
+struct SimPlayer : private detail::SimObjectMemory, WowPlayer {
+  explicit SimPlayer(Guid const guid);
+
+  std::string GetName() const override { return "SimPlayer"; }
+
+  void SendUpdateMovement(uint32_t timestamp, MovementOpCode opcode) override;
+  using WowPlayer::SetFacing;
+  void SetFacing(float facing_radians) override;
+  // turns towards target_pos, and goes nowhere
+  bool ClickToMove(CtmType const ctm_type,
+                   Guid const target_guid,
+                   vec3 const& target_pos,
+                   float const precision = 2.0f) override;
+  uint32_t SetControlBits(uint32_t flags, uint32_t timestamp) override;
+  uint32_t UnsetControlBits(uint32_t flags, uint32_t timestamp) override;
+
+  // how many times SetFacing's been called
+  uint32_t set_facing_calls{0};
+  // and how many packets would've been sent to the server
+  uint32_t movement_packets{0};
+};
+
+// A unit that only exists in memory, moved by whoever's moving it.
+struct SimUnit : private detail::SimObjectMemory, WowUnit {
+  explicit SimUnit(Guid const guid);
+
+  std::string GetName() const override { return "SimUnit"; }
+};
+
+// An ObjectManager over a world with nothing in it but a SimPlayer, and
+// whatever SimUnits are added to it.
+struct SimObjectManager : ObjectManager {
+  explicit SimObjectManager(uint32_t const map_id);
+
+  // nothing comes or goes but what's added, just keep up with where it is
+  void EnumVisibleObjects() override { RefreshObjects(); }
+  Guid GetPlayerGuid() const override { return player_guid; }
+  uint32_t GetMapId() const override { return map_id; }
+
+  SimPlayer& GetSimPlayer() { return *player; }
+  SimUnit& AddSimUnit(Guid const guid);
+  void RemoveSimUnit(Guid const guid);
+
+private:
+  Guid const player_guid{1};
+  uint32_t const map_id;
+  SimPlayer* player;
+};
+
+struct SimEpisode {
+  vec3 start;
+  vec3 dest;
+  // give up after this long, in simulated seconds
+  float time_limit{120.0f};
+  // knock the player by knockback at knockback_time, e.g. to test recovery
+  float knockback_time{-1.0f};
+  vec3 knockback{0, 0, 0};
+};
+
+struct SimEpisodeResult {
+  bool arrived{false};
+  float arrival_time{0.0f}; // or the time limit
+  float distance_walked{0.0f};
+  float max_cross_track{0.0f};
+  float mean_cross_track{0.0f};
+  uint32_t ticks{0};
+  double cpu_us_per_tick{0.0};
+  uint32_t repairs{0};
+  uint32_t replans{0};
+  uint32_t forward_toggles{0};
+  uint32_t set_facing_calls{0};
+};
+
+// Runs PlayerNavigator and PlayerController against a SimPlayer on a nav
+// mesh without the client, as fast as the CPU allows. The player follows the
+// control bits like the client would: it turns at turn_rate on the turn
+// bits, runs at its run_speed on Forward (back_speed on Backward), and
+// keeps to the ground by MMapManager::getGroundHeight, stopping wherever
+// there isn't any within max_climb. SetFacing turns it instantly, as
+// CMovement::SetFacing does.
+//
+// Path requests still go to the NavWorker thread, but every tick waits for
+// them, so an episode plays out the same way however fast the CPU is.
+struct MovementSim {
+  explicit MovementSim(MMapManager& mmap, uint32_t const map_id);
+  MovementSim(MovementSim const&) = delete;
+  MovementSim& operator=(MovementSim const&) = delete;
+
+  SimEpisodeResult Run(SimEpisode const& episode);
+
+  // Flush the commands, then move the player dt seconds on by its control
+  // bits.
+  void Tick(float const dt);
+
+  // a control step per tick, as PhlipBot runs them
+  float tick_dt{ControlStep};
+  float run_speed{7.0f};
+  float back_speed{4.5f};
+  float turn_rate{3.14159265f};
+  float max_climb{1.0f};
+  // the navigator stops within reach of the end of the path
+  float arrive_radius{1.0f};
+
+  MMapManager& mmap;
+  SimObjectManager objmgr;
+  MovementCommands commands;
+  PlayerController player_controller;
+  PlayerNavigator player_nav;
+
+private:
+  void WaitForWorker();
+
+  // simulated seconds, for the commands' timestamps
+  float clock{0.0f};
+};
+}
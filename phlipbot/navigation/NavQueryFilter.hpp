@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <DetourCommon.h>
+#include <DetourNavMesh.h>
+#include <DetourNavMeshQuery.h>
+
+#include "MoveMapSharedDefines.hpp"
+
+// Compile-time specialized navmesh query filters.
+//
+// dtQueryFilter keeps its include/exclude flags and a 64 entry area cost table
+// as runtime state, so every node expansion in dtNavMeshQuery::findPath pays
+// for a table lookup through the filter object. The filters here bake the
+// flags and the per-NavTerrain costs into the type, which lets
+// PolyPathSearch::findPath<Filter> inline both passFilter and getCost into the
+// search loop.
+//
+// The mmaps generator stores the NavTerrain of a polygon both in its flags and
+// in its area id, so the costs are keyed on NavTerrain as well.
+
+namespace phlipbot
+{
+// Traversal cost multipliers per NavTerrain. A Costs type just needs these
+// static members, so new presets can be added without touching TerrainFilter.
+struct DefaultTerrainCosts {
+  static constexpr float ground = 1.0f;
+  static constexpr float water = 1.0f;
+  static constexpr float magma = 1.0f;
+  static constexpr float slime = 1.0f;
+  static constexpr float steep_slopes = 1.0f;
+};
+
+// Swimming is slower than running and magma/slime hurt, so prefer a longer dry
+// route unless the detour is several times longer.
+struct AvoidLiquidsTerrainCosts {
+  static constexpr float ground = 1.0f;
+  static constexpr float water = 3.0f;
+  static constexpr float magma = 50.0f;
+  static constexpr float slime = 20.0f;
+  static constexpr float steep_slopes = 1.0f;
+};
+
+// Swimming is slower than running, so take a dry route unless it's several
+// times longer.
+struct AvoidWaterTerrainCosts {
+  static constexpr float ground = 1.0f;
+  static constexpr float water = 3.0f;
+  static constexpr float magma = 1.0f;
+  static constexpr float slime = 1.0f;
+  static constexpr float steep_slopes = 1.0f;
+};
+
+template <typename Costs>
+constexpr float TerrainCost(unsigned char const area)
+{
+  // clang-format off
+  return (area == NAV_GROUND)       ? Costs::ground :
+         (area == NAV_WATER)        ? Costs::water :
+         (area == NAV_MAGMA)        ? Costs::magma :
+         (area == NAV_SLIME)        ? Costs::slime :
+         (area == NAV_STEEP_SLOPES) ? Costs::steep_slopes :
+                                      1.0f;
+  // clang-format on
+}
+
+template <uint16_t IncludeFlags,
+          uint16_t ExcludeFlags = 0,
+          typename Costs = DefaultTerrainCosts>
+struct TerrainFilter {
+  static constexpr uint16_t include_flags = IncludeFlags;
+  static constexpr uint16_t exclude_flags = ExcludeFlags;
+  using costs = Costs;
+
+  // Same semantics as dtQueryFilter::passFilter
+  static inline bool passFilter(dtPolyRef const /* ref */,
+                                dtMeshTile const* /* tile */,
+                                dtPoly const* poly)
+  {
+    return (poly->flags & IncludeFlags) != 0 &&
+           (poly->flags & ExcludeFlags) == 0;
+  }
+
+  // Same semantics as dtQueryFilter::getCost, which only looks at the polygon
+  // we're currently moving across.
+  static inline float
+  getCost(float const* pa, float const* pb, dtPoly const* curPoly)
+  {
+    return dtVdist(pa, pb) * TerrainCost<Costs>(curPoly->getArea());
+  }
+
+  // An equivalent runtime filter for the dtNavMeshQuery calls that only accept
+  // a dtQueryFilter, e.g. findNearestPoly or moveAlongSurface.
+  static dtQueryFilter toQueryFilter()
+  {
+    dtQueryFilter filter;
+    filter.setIncludeFlags(IncludeFlags);
+    filter.setExcludeFlags(ExcludeFlags);
+    for (int area = 0; area < DT_MAX_AREAS; ++area) {
+      filter.setAreaCost(area,
+                         TerrainCost<Costs>(static_cast<unsigned char>(area)));
+    }
+    return filter;
+  }
+};
+
+// The terrain a player can actually walk or swim across.
+using PlayerFilter = TerrainFilter<NAV_GROUND | NAV_WATER>;
+
+// What a player's paths and the queries about them use: the same terrain as
+// PlayerFilter, but keeping out of the water where there's a reasonable way
+// around.
+using PlayerPathFilter =
+  TerrainFilter<NAV_GROUND | NAV_WATER, 0, AvoidWaterTerrainCosts>;
+
+// Allow the pathfinder to cross liquids, but only if there's no reasonable dry
+// route. Steep slopes are never walkable for a player.
+using PlayerAvoidLiquidsFilter =
+  TerrainFilter<NAV_GROUND | NAV_WATER | NAV_MAGMA | NAV_SLIME,
+                NAV_STEEP_SLOPES,
+                AvoidLiquidsTerrainCosts>;
+}
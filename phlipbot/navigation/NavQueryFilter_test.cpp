@@ -0,0 +1,81 @@
+#include "NavQueryFilter.hpp"
+
+#include <initializer_list>
+
+#include <doctest.h>
+
+namespace phlipbot
+{
+namespace test
+{
+namespace
+{
+dtPoly MakePoly(int const flags, int const area)
+{
+  dtPoly poly{};
+  poly.flags = static_cast<unsigned short>(flags);
+  poly.setArea(static_cast<unsigned char>(area));
+  poly.setType(DT_POLYTYPE_GROUND);
+  return poly;
+}
+}
+
+TEST_CASE("TerrainFilter::passFilter matches dtQueryFilter::passFilter")
+{
+  dtQueryFilter const generic = PlayerAvoidLiquidsFilter::toQueryFilter();
+
+  for (unsigned short flags = 0; flags <= 0xFF; ++flags) {
+    dtPoly const poly = MakePoly(flags, NAV_GROUND);
+    CHECK(PlayerAvoidLiquidsFilter::passFilter(0, nullptr, &poly) ==
+          generic.passFilter(0, nullptr, &poly));
+  }
+}
+
+TEST_CASE("TerrainFilter::getCost matches dtQueryFilter::getCost")
+{
+  dtQueryFilter const generic = PlayerAvoidLiquidsFilter::toQueryFilter();
+  float const pa[3] = {0.0f, 0.0f, 0.0f};
+  float const pb[3] = {3.0f, 0.0f, 4.0f};
+
+  for (auto const terrain :
+       {NAV_GROUND, NAV_WATER, NAV_MAGMA, NAV_SLIME, NAV_STEEP_SLOPES}) {
+    dtPoly const poly = MakePoly(terrain, terrain);
+    CHECK(PlayerAvoidLiquidsFilter::getCost(pa, pb, &poly) ==
+          doctest::Approx(generic.getCost(pa, pb, 0, nullptr, nullptr, 0,
+                                          nullptr, &poly, 0, nullptr,
+                                          nullptr)));
+  }
+}
+
+TEST_CASE("PlayerAvoidLiquidsFilter prefers dry land")
+{
+  float const pa[3] = {0.0f, 0.0f, 0.0f};
+  float const pb[3] = {10.0f, 0.0f, 0.0f};
+
+  dtPoly const ground = MakePoly(NAV_GROUND, NAV_GROUND);
+  dtPoly const water = MakePoly(NAV_WATER, NAV_WATER);
+  dtPoly const magma = MakePoly(NAV_MAGMA, NAV_MAGMA);
+
+  float const ground_cost = PlayerAvoidLiquidsFilter::getCost(pa, pb, &ground);
+  float const water_cost = PlayerAvoidLiquidsFilter::getCost(pa, pb, &water);
+  float const magma_cost = PlayerAvoidLiquidsFilter::getCost(pa, pb, &magma);
+
+  CHECK(ground_cost == doctest::Approx(10.0f));
+  CHECK(water_cost > ground_cost);
+  CHECK(magma_cost > water_cost);
+
+  // the plain player filter doesn't care what it's walking on
+  CHECK(PlayerFilter::getCost(pa, pb, &water) == doctest::Approx(10.0f));
+}
+
+TEST_CASE("PlayerFilter excludes liquids the player can't stand in")
+{
+  dtPoly const magma = MakePoly(NAV_MAGMA, NAV_MAGMA);
+  dtPoly const steep = MakePoly(NAV_GROUND | NAV_STEEP_SLOPES, NAV_GROUND);
+
+  CHECK(!PlayerFilter::passFilter(0, nullptr, &magma));
+  CHECK(PlayerAvoidLiquidsFilter::passFilter(0, nullptr, &magma));
+  CHECK(!PlayerAvoidLiquidsFilter::passFilter(0, nullptr, &steep));
+}
+}
+}
@@ -0,0 +1,295 @@
+#include "NavTelemetry.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+#include <hadesmem/error.hpp>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+#include "MoveMap.hpp"
+
+namespace fs = std::filesystem;
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace
+{
+uint32_t const NAV_TELEMETRY_MAGIC = 0x544e4250; // 'PBNT'
+uint32_t const NAV_TELEMETRY_VERSION = 1;
+
+struct NavTelemetryHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+};
+
+// on disk layout of a NavSample, independent of vec3's padding
+struct NavSampleRecord {
+  float time;
+  float position[3];
+  float target[3];
+  float cross_track;
+  float facing_error;
+  float facing_output;
+  float tick_us;
+  uint32_t segment;
+  uint32_t action;
+};
+static_assert(sizeof(NavSampleRecord) == 52,
+              "NavSampleRecord should have no padding");
+}
+
+namespace phlipbot
+{
+NavTelemetry::NavTelemetry()
+  : samples(new NavSample[Slots]()), start(steady_clock::now())
+{
+}
+
+void NavTelemetry::Push(NavSample sample)
+{
+  sample.time = duration<float>{steady_clock::now() - start}.count();
+
+  // only this thread writes head, so it can't have moved since
+  uint64_t const idx = head.load(std::memory_order_relaxed);
+  samples[idx % Slots] = sample;
+  head.store(idx + 1, std::memory_order_release);
+}
+
+std::vector<NavSample> NavTelemetry::Snapshot(size_t const max_count) const
+{
+  uint64_t const end = head.load(std::memory_order_acquire);
+  uint64_t const count = std::min<uint64_t>({end, Capacity, max_count});
+  uint64_t first = end - count;
+
+  std::vector<NavSample> copy;
+  copy.reserve(static_cast<size_t>(count));
+  for (uint64_t i = first; i < end; ++i) {
+    copy.push_back(samples[i % Slots]);
+  }
+
+  // Push may have lapped us while we copied, drop whatever it overwrote
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t const now = head.load(std::memory_order_relaxed);
+  // sample i was safe to read if Push hasn't started on i + Slots, and it
+  // might be writing sample now
+  uint64_t const overwritten = now + 1 > Slots ? now + 1 - Slots : 0;
+  if (overwritten > first) {
+    size_t const drop =
+      static_cast<size_t>(std::min<uint64_t>(overwritten - first, count));
+    copy.erase(copy.begin(), copy.begin() + drop);
+  }
+  return copy;
+}
+
+void NavTelemetry::Dump(fs::path const& path) const
+{
+  std::vector<NavSample> const snapshot = Snapshot();
+
+  std::ofstream out{path, std::ios::binary | std::ios::trunc};
+  if (!out) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Failed to open nav telemetry dump"}
+      << ErrorFile{path});
+  }
+
+  NavTelemetryHeader const header{NAV_TELEMETRY_MAGIC, NAV_TELEMETRY_VERSION,
+                                  static_cast<uint32_t>(snapshot.size())};
+  out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+  for (NavSample const& sample : snapshot) {
+    NavSampleRecord const record{
+      sample.time,
+      {sample.position.x, sample.position.y, sample.position.z},
+      {sample.target.x, sample.target.y, sample.target.z},
+      sample.cross_track,
+      sample.facing_error,
+      sample.facing_output,
+      sample.tick_us,
+      sample.segment,
+      sample.action};
+    out.write(reinterpret_cast<char const*>(&record), sizeof(record));
+  }
+
+  if (!out) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Failed to write nav telemetry dump"}
+      << ErrorFile{path});
+  }
+}
+
+std::vector<NavSample> LoadNavTelemetry(fs::path const& path)
+{
+  std::ifstream in{path, std::ios::binary};
+  if (!in) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Failed to open nav telemetry dump"}
+      << ErrorFile{path});
+  }
+
+  NavTelemetryHeader header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Failed to read nav telemetry header"}
+      << ErrorFile{path});
+  }
+  if (header.magic != NAV_TELEMETRY_MAGIC) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Nav telemetry dump has the wrong magic"}
+      << ErrorHeaderMagic{header.magic} << ErrorFile{path});
+  }
+  if (header.version != NAV_TELEMETRY_VERSION) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Nav telemetry dump has the wrong version"}
+      << ErrorHeaderVersion{header.version} << ErrorFile{path});
+  }
+
+  std::vector<NavSample> samples;
+  samples.reserve(header.count);
+  NavSampleRecord record;
+  for (uint32_t i = 0; i < header.count; ++i) {
+    if (!in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error{}
+        << hadesmem::ErrorString{"Nav telemetry dump is truncated"}
+        << ErrorFile{path});
+    }
+    samples.push_back(NavSample{
+      record.time,
+      vec3{record.position[0], record.position[1], record.position[2]},
+      vec3{record.target[0], record.target[1], record.target[2]},
+      record.cross_track, record.facing_error, record.facing_output,
+      record.tick_us, record.segment, record.action});
+  }
+  return samples;
+}
+
+namespace test
+{
+namespace
+{
+NavSample TestSample(uint32_t const i)
+{
+  NavSample sample{};
+  sample.position = vec3{float(i), 2.0f * i, 3.0f};
+  sample.cross_track = 0.01f * i;
+  sample.segment = i;
+  return sample;
+}
+}
+
+TEST_CASE("NavTelemetry keeps the last Capacity samples")
+{
+  NavTelemetry telemetry;
+  CHECK(telemetry.Snapshot().empty());
+
+  for (uint32_t i = 0; i < 10; ++i) {
+    telemetry.Push(TestSample(i));
+  }
+  auto few = telemetry.Snapshot();
+  REQUIRE(few.size() == 10);
+  CHECK(few.front().segment == 0);
+  CHECK(few.back().segment == 9);
+  CHECK(few.back().time >= few.front().time);
+
+  auto const last = telemetry.Snapshot(3);
+  REQUIRE(last.size() == 3);
+  CHECK(last.front().segment == 7);
+
+  for (uint32_t i = 10; i < NavTelemetry::Capacity + 100; ++i) {
+    telemetry.Push(TestSample(i));
+  }
+  CHECK(telemetry.GetCount() == NavTelemetry::Capacity + 100);
+  auto const all = telemetry.Snapshot();
+  REQUIRE(all.size() == NavTelemetry::Capacity);
+  CHECK(all.front().segment == 100);
+  CHECK(all.back().segment == NavTelemetry::Capacity + 99);
+}
+
+TEST_CASE("NavTelemetry snapshots while it's pushed to")
+{
+  NavTelemetry telemetry;
+  std::atomic<bool> done{false};
+  std::thread pusher{[&]() {
+    for (uint32_t i = 0; i < 20 * NavTelemetry::Capacity; ++i) {
+      telemetry.Push(TestSample(i));
+    }
+    done = true;
+  }};
+
+  // whatever's in a snapshot is in order, and what was pushed
+  bool ok = true;
+  while (!done) {
+    auto const snapshot = telemetry.Snapshot(256);
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+      NavSample const& sample = snapshot[i];
+      ok &= sample.position.x == float(sample.segment);
+      ok &= i == 0 || sample.segment == snapshot[i - 1].segment + 1;
+    }
+  }
+  pusher.join();
+  CHECK(ok);
+}
+
+TEST_CASE("NavTelemetry round trips through LoadNavTelemetry")
+{
+  fs::path const path =
+    fs::temp_directory_path() / "phlipbot_nav_telemetry_test.bin";
+
+  NavTelemetry telemetry;
+  for (uint32_t i = 0; i < 5; ++i) {
+    NavSample sample = TestSample(i);
+    sample.target = vec3{-1.0f, -2.0f, -3.0f};
+    sample.tick_us = 12.5f;
+    sample.action = 2;
+    telemetry.Push(sample);
+  }
+  telemetry.Dump(path);
+
+  auto const loaded = LoadNavTelemetry(path);
+  auto const snapshot = telemetry.Snapshot();
+  REQUIRE(loaded.size() == snapshot.size());
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    CHECK(loaded[i].time == snapshot[i].time);
+    CHECK(loaded[i].position == snapshot[i].position);
+    CHECK(loaded[i].target == snapshot[i].target);
+    CHECK(loaded[i].cross_track == snapshot[i].cross_track);
+    CHECK(loaded[i].tick_us == snapshot[i].tick_us);
+    CHECK(loaded[i].segment == snapshot[i].segment);
+    CHECK(loaded[i].action == snapshot[i].action);
+  }
+
+  {
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out << "definitely not nav telemetry";
+  }
+  CHECK_THROWS_AS(LoadNavTelemetry(path), hadesmem::Error);
+
+  fs::remove(path);
+}
+
+TEST_CASE("benchmark nav telemetry push" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  NavTelemetry telemetry;
+  NavSample const sample = TestSample(1);
+  double const push_us =
+    bench::TimeMicros(1000000, [&]() { telemetry.Push(sample); });
+  bench::Report("NavTelemetry::Push", push_us);
+
+  double const snapshot_us = bench::TimeMicros(
+    1000, [&]() { bench::DoNotOptimize(telemetry.Snapshot(300)); });
+  bench::Report("NavTelemetry::Snapshot(300)", snapshot_us);
+}
+}
+}
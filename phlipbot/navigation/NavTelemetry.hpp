@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "../wow_constants.hpp"
+
+namespace phlipbot
+{
+// How well one PlayerNavigator tick followed the path.
+struct NavSample {
+  float time; // seconds since the NavTelemetry was made
+  vec3 position;
+  vec3 target; // the follower's steer target
+  float cross_track;
+  // the facing error and output of the controller's last update, radians
+  float facing_error;
+  float facing_output;
+  float tick_us; // how long the navigator's tick took
+  uint32_t segment;
+  uint32_t action; // PathFollower::Action
+};
+
+// The last Capacity NavSamples, cheap enough to always leave on so slow or
+// stuck navigation can be looked into after the fact.
+//
+// Lock free: one thread Push'es, and any thread can take a Snapshot or Dump
+// at the same time. Push never blocks or allocates, it just overwrites the
+// oldest sample, and a Snapshot leaves out any sample that was overwritten
+// while it was being copied.
+struct NavTelemetry {
+  // a bit over two minutes at PlayerController's ControlStep
+  static size_t const Capacity = 4096;
+
+  NavTelemetry();
+  NavTelemetry(NavTelemetry const&) = delete;
+  NavTelemetry& operator=(NavTelemetry const&) = delete;
+
+  // Stamps sample's time.
+  void Push(NavSample sample);
+
+  // Up to the last max_count samples, oldest first.
+  std::vector<NavSample> Snapshot(size_t const max_count = Capacity) const;
+
+  // Write a Snapshot to path, see LoadNavTelemetry.
+  void Dump(std::filesystem::path const& path) const;
+
+  // samples pushed ever
+  uint64_t GetCount() const { return head.load(std::memory_order_acquire); }
+
+private:
+  // a spare slot for Push to write to while the last Capacity are read
+  static size_t const Slots = Capacity + 1;
+
+  std::unique_ptr<NavSample[]> samples;
+  std::atomic<uint64_t> head{0};
+  std::chrono::steady_clock::time_point start;
+};
+
+// Read back every sample in a file written by NavTelemetry::Dump.
+std::vector<NavSample> LoadNavTelemetry(std::filesystem::path const& path);
+}
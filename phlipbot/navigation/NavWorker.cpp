@@ -0,0 +1,412 @@
+#include "NavWorker.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <utility>
+#include <vector>
+
+#include <glm/geometric.hpp>
+
+#include <hadesmem/detail/assert.hpp>
+
+#include <doctest.h>
+
+#include "FormationPaths.hpp"
+#include "NavQueryFilter.hpp"
+
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+namespace
+{
+phlipbot::PathResult CancelledResult()
+{
+  phlipbot::PathResult result;
+  result.type.set(phlipbot::PathFlag::PATHFIND_BLANK);
+  return result;
+}
+
+phlipbot::PathResult NoPathResult()
+{
+  phlipbot::PathResult result;
+  result.type.set(phlipbot::PathFlag::PATHFIND_NOPATH);
+  return result;
+}
+}
+
+namespace phlipbot
+{
+NavWorker::NavWorker(MMapManager& mmap_mgr)
+  : mmap_mgr(mmap_mgr), path_info(mmap_mgr, 0, &start_poly_cache)
+{
+  path_info.setRecorder(&recorder);
+  worker = std::thread{&NavWorker::Run, this};
+}
+
+NavWorker::~NavWorker()
+{
+  {
+    lock_guard<mutex> lock{requests_lock};
+    stopping = true;
+  }
+  requests_cv.notify_one();
+  worker.join();
+
+  // nobody's going to calculate these anymore
+  for (auto& req : requests) {
+    req.result.set_value(CancelledResult());
+  }
+  for (auto& req : raycast_requests) {
+    req.result.set_value(WalkRayResult{});
+  }
+}
+
+std::future<PathResult> NavWorker::CalculateAsync(uint32_t const map_id,
+                                                  vec3 const& src,
+                                                  vec3 const& dest)
+{
+  std::promise<PathResult> result;
+  auto future = result.get_future();
+
+  {
+    lock_guard<mutex> lock{requests_lock};
+    requests.push_back(Request{generation.load(), map_id, src, dest,
+                               std::move(result), PointsArray{},
+                               vec2{0, 0}});
+  }
+  requests_cv.notify_one();
+
+  return future;
+}
+
+std::future<PathResult> NavWorker::FormationPathAsync(uint32_t const map_id,
+                                                      vec3 const& src,
+                                                      PointsArray leader_path,
+                                                      vec2 const& offset)
+{
+  std::promise<PathResult> result;
+  auto future = result.get_future();
+
+  // nothing to follow, and the worker would take it for a plain path request
+  if (leader_path.empty()) {
+    result.set_value(NoPathResult());
+    return future;
+  }
+
+  {
+    lock_guard<mutex> lock{requests_lock};
+    requests.push_back(Request{generation.load(), map_id, src,
+                               leader_path.back(), std::move(result),
+                               std::move(leader_path), offset});
+  }
+  requests_cv.notify_one();
+
+  return future;
+}
+
+std::future<WalkRayResult> NavWorker::RaycastAsync(uint32_t const map_id,
+                                                   vec3 const& src,
+                                                   std::vector<vec3> targets)
+{
+  std::promise<WalkRayResult> result;
+  auto future = result.get_future();
+
+  {
+    lock_guard<mutex> lock{requests_lock};
+    raycast_requests.push_back(
+      RaycastRequest{map_id, src, std::move(targets), std::move(result)});
+  }
+  requests_cv.notify_one();
+
+  return future;
+}
+
+void NavWorker::Cancel()
+{
+  std::deque<Request> cancelled;
+  {
+    lock_guard<mutex> lock{requests_lock};
+    ++generation;
+    cancelled.swap(requests);
+  }
+
+  for (auto& req : cancelled) {
+    req.result.set_value(CancelledResult());
+  }
+}
+
+void NavWorker::Run()
+{
+  for (;;) {
+    Request req;
+    RaycastRequest raycast_req;
+    bool is_raycast;
+    {
+      unique_lock<mutex> lock{requests_lock};
+      requests_cv.wait(lock, [&] {
+        return stopping || !requests.empty() || !raycast_requests.empty();
+      });
+      if (stopping) {
+        return;
+      }
+
+      is_raycast = !raycast_requests.empty();
+      if (is_raycast) {
+        raycast_req = std::move(raycast_requests.front());
+        raycast_requests.pop_front();
+      } else {
+        req = std::move(requests.front());
+        requests.pop_front();
+      }
+    }
+
+    if (is_raycast) {
+      try {
+        raycast_req.result.set_value(Raycast(raycast_req));
+      } catch (...) {
+        raycast_req.result.set_exception(std::current_exception());
+      }
+      continue;
+    }
+
+    try {
+      req.result.set_value(Calculate(req));
+    } catch (...) {
+      // e.g., a corrupt mmtile, let whoever's waiting on the result see it
+      req.result.set_exception(std::current_exception());
+    }
+  }
+}
+
+PathResult NavWorker::Calculate(Request const& req)
+{
+  if (req.generation != generation) {
+    return CancelledResult();
+  }
+
+  if (!mmap_mgr.loadMapAround(req.map_id, req.src.xy)) {
+    return NoPathResult();
+  }
+
+  if (!req.leader_path.empty()) {
+    return CalculateFormation(req);
+  }
+
+  path_info.reset(req.map_id);
+
+  // zero search (almost) if we're travelling between POIs
+  if (auto const routes = GetRouteTable(req.map_id)) {
+    PointsArray path;
+    if (ConnectRoute(*routes, path_info, req.src, req.dest, path)) {
+      ++route_hits;
+      if (req.generation != generation) {
+        return CancelledResult();
+      }
+
+      PathResult result{std::move(path), {}, req.map_id,
+                        path_info.getTileGeneration()};
+      result.type.set(PathFlag::PATHFIND_NORMAL);
+      return result;
+    }
+  }
+
+  path_info.calculate(req.src, req.dest);
+
+  poly_cache_hits = start_poly_cache.getHits();
+  poly_cache_misses = start_poly_cache.getMisses();
+
+  // SetDestination was called while we were busy
+  if (req.generation != generation) {
+    return CancelledResult();
+  }
+
+  return PathResult{path_info.getPath(), path_info.getPathType(), req.map_id,
+                    path_info.getTileGeneration()};
+}
+
+size_t NavWorker::LoadRouteTables(std::filesystem::path const& dir)
+{
+  size_t loaded = 0;
+  for (auto const& entry : std::filesystem::directory_iterator{dir}) {
+    if (entry.path().extension() != ".routes") {
+      continue;
+    }
+
+    auto table = std::make_shared<RouteTable const>(entry.path());
+    lock_guard<mutex> lock{route_tables_lock};
+    route_tables[table->GetMapId()] = std::move(table);
+    ++loaded;
+  }
+  return loaded;
+}
+
+size_t NavWorker::GetRouteTableCount()
+{
+  lock_guard<mutex> lock{route_tables_lock};
+  return route_tables.size();
+}
+
+std::shared_ptr<RouteTable const>
+NavWorker::GetRouteTable(uint32_t const map_id)
+{
+  lock_guard<mutex> lock{route_tables_lock};
+  auto it = route_tables.find(map_id);
+  return it != route_tables.end() ? it->second : nullptr;
+}
+
+PathResult NavWorker::CalculateFormation(Request const& req)
+{
+  dtNavMeshQuery const* query = mmap_mgr.GetNavMeshQuery(req.map_id);
+  if (query == nullptr || req.leader_path.empty()) {
+    return NoPathResult();
+  }
+  dtQueryFilter const filter = PlayerPathFilter::toQueryFilter();
+  float const extents[3] = {3.0f, 5.0f, 3.0f};
+
+  PointsArray const leader = TrimPath(req.leader_path, req.offset.y);
+  PointsArray path = OffsetPath(leader, req.offset.x);
+  if (path.empty()) {
+    return NoPathResult();
+  }
+
+  // Pull each point back to wherever the walk out to it from the leader's
+  // path stops, less a little so it's not against the wall. Points off the
+  // loaded tiles stay on the leader's path, it's walkable.
+  std::vector<vec3> target(1);
+  std::vector<WalkRayHit> hits;
+  for (size_t i = 0; i < path.size(); ++i) {
+    float const leaderYZX[3] = {leader[i].y, leader[i].z, leader[i].x};
+    float nearest[3];
+    dtPolyRef ref = 0;
+    query->findNearestPoly(leaderYZX, extents, &filter, &ref, nearest);
+    if (ref == 0) {
+      path[i] = leader[i];
+      continue;
+    }
+
+    target[0] = path[i];
+    RaycastWalks(*query, filter, ref, leader[i], target, hits);
+    if (hits[0].fraction < 1.0f) {
+      float const pulled = std::max(hits[0].fraction - 0.1f, 0.0f);
+      path[i] = leader[i] + (path[i] - leader[i]) * pulled;
+    }
+  }
+
+  // join it from src, at the nearest point past which it goes on
+  size_t join = 0;
+  for (size_t i = 1; i < path.size(); ++i) {
+    if (glm::distance(path[i].xy, req.src.xy) <
+        glm::distance(path[join].xy, req.src.xy)) {
+      join = i;
+    }
+  }
+  path.erase(path.begin(),
+             path.begin() + std::min(join + 1, path.size() - 1));
+  path.insert(path.begin(), req.src);
+
+  if (req.generation != generation) {
+    return CancelledResult();
+  }
+
+  PathResult result{std::move(path), {}, req.map_id,
+                    mmap_mgr.getTileGeneration(req.map_id)};
+  result.type.set(PathFlag::PATHFIND_NORMAL);
+  return result;
+}
+
+WalkRayResult NavWorker::Raycast(RaycastRequest const& req)
+{
+  WalkRayResult result;
+  result.map_id = req.map_id;
+
+  if (!mmap_mgr.loadMapAround(req.map_id, req.src.xy)) {
+    return result;
+  }
+
+  dtNavMeshQuery const* query = mmap_mgr.GetNavMeshQuery(req.map_id);
+  HADESMEM_DETAIL_ASSERT(query != nullptr);
+
+  // its own poly cache, so the path start's hit rate is just paths'
+  dtQueryFilter const filter = PlayerPathFilter::toQueryFilter();
+  float const srcYZX[3] = {req.src.y, req.src.z, req.src.x};
+  float const extents[3] = {3.0f, 5.0f, 3.0f};
+  float start[3] = {0.0f, 0.0f, 0.0f};
+  dtPolyRef startRef = 0;
+  raycast_poly_cache.findNearestPoly(*query, srcYZX, extents, filter,
+                                     &startRef, start);
+
+  // swimming, jumping, or off the mesh, there's nothing to say about any of
+  // the targets
+  if (startRef == 0) {
+    return result;
+  }
+
+  RaycastWalks(*query, filter, startRef, vec3{start[2], start[0], start[1]},
+               req.targets, result.hits);
+  return result;
+}
+
+namespace test
+{
+TEST_CASE("NavWorker should compute a path in Elwynn Forest")
+{
+  uint32_t const map_id = 0;
+  vec3 start{-8949.95f, -132.493f, 83.5312f};
+  vec3 end{-9046.507f, -45.71962f, 88.33186f};
+
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+  NavWorker worker{mmap};
+
+  auto request = worker.CalculateAsync(map_id, start, end);
+  REQUIRE(request.wait_for(std::chrono::seconds{10}) ==
+          std::future_status::ready);
+
+  PathResult const result = request.get();
+  CHECK(result.type.test(PathFlag::PATHFIND_NORMAL));
+  CHECK(result.path.size() >= 2);
+}
+
+TEST_CASE("NavWorker::Cancel drops outstanding requests")
+{
+  uint32_t const map_id = 0;
+  vec3 start{-8949.95f, -132.493f, 83.5312f};
+  vec3 end{-9046.507f, -45.71962f, 88.33186f};
+
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+  NavWorker worker{mmap};
+
+  std::vector<std::future<PathResult>> requests;
+  for (int i = 0; i < 8; ++i) {
+    requests.push_back(worker.CalculateAsync(map_id, start, end));
+  }
+  worker.Cancel();
+
+  // anything that finished before Cancel has a path, everything else is empty
+  for (auto& request : requests) {
+    PathResult const result = request.get();
+    if (!result.type.test(PathFlag::PATHFIND_NORMAL)) {
+      CHECK(result.type.test(PathFlag::PATHFIND_BLANK));
+      CHECK(result.path.empty());
+    }
+  }
+
+  // the worker is still usable afterwards
+  auto request = worker.CalculateAsync(map_id, start, end);
+  CHECK(request.get().type.test(PathFlag::PATHFIND_NORMAL));
+}
+
+TEST_CASE("NavWorker has no formation path without a leader path")
+{
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+  NavWorker worker{mmap};
+
+  auto request = worker.FormationPathAsync(0, vec3{1.0f, 2.0f, 3.0f},
+                                           PointsArray{}, vec2{2.0f, 1.0f});
+  PathResult const result = request.get();
+  CHECK(result.type.test(PathFlag::PATHFIND_NOPATH));
+  CHECK(result.path.empty());
+}
+}
+}
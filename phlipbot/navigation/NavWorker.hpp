@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "LineOfWalk.hpp"
+#include "MoveMap.hpp"
+#include "PathFinder.hpp"
+#include "PathQueryLog.hpp"
+#include "PolyLocalityCache.hpp"
+#include "RouteTable.hpp"
+
+namespace phlipbot
+{
+struct PathResult {
+  PointsArray path;
+  std::bitset<10> type; // only PATHFIND_BLANK if the request was cancelled
+  uint32_t map_id{0};
+  // MMapManager::getTileGeneration when the path was calculated, tiles
+  // unloaded at a later generation may have been under it
+  uint32_t tile_generation{0};
+};
+
+struct WalkRayResult {
+  std::vector<WalkRayHit> hits; // one per target, empty if no tiles loaded
+  uint32_t map_id{0};
+};
+
+// Runs PathFinder::calculate on a background thread, so computing a path
+// overlaps with rendering instead of stalling EndScene.
+//
+// Detour can't add or remove tiles while another thread is reading the nav
+// mesh. Loading and unloading tiles always holds the map's tilesLoading_lock,
+// and so do the MMapManager reads other threads use while a worker runs:
+// getGroundHeight, getGroundHeights, getExactGroundHeight and getHeightGrid.
+// The worker loads the tiles a request needs itself and then queries the
+// mesh without that lock, so while it runs no other thread may unload tiles
+// or query the mesh through its own dtNavMeshQuery or PathFinder.
+struct NavWorker {
+  explicit NavWorker(MMapManager& mmap_mgr);
+  ~NavWorker();
+  NavWorker(NavWorker const&) = delete;
+  NavWorker& operator=(NavWorker const&) = delete;
+
+  // Load the tiles around src and find a path from src to dest on map_id.
+  std::future<PathResult>
+  CalculateAsync(uint32_t const map_id, vec3 const& src, vec3 const& dest);
+
+  // Walk alongside a party leader's path rather than searching for our own:
+  // leader_path moved offset.x yards to its right and ending offset.y yards
+  // short of its end, from about where src is on it onwards. Points the
+  // offset would put through a wall, or off the mesh, are pulled back
+  // towards the leader's path. No path if leader_path is empty. Cancelled by
+  // Cancel like CalculateAsync.
+  std::future<PathResult> FormationPathAsync(uint32_t const map_id,
+                                             vec3 const& src,
+                                             PointsArray leader_path,
+                                             vec2 const& offset);
+
+  // Load the tiles around src and raycast from src to every target on
+  // map_id, in one go. No hits if src isn't on the mesh. Answered before
+  // any waiting path requests, since they're much cheaper. Not affected by
+  // Cancel.
+  std::future<WalkRayResult> RaycastAsync(uint32_t const map_id,
+                                          vec3 const& src,
+                                          std::vector<vec3> targets);
+
+  // Cancel every path request made so far. Requests still waiting complete
+  // right away, a request that's already being calculated completes when
+  // it's done. Either way the result is empty.
+  void Cancel();
+
+  // Map every MMM.routes table in dir, replacing any already loaded for the
+  // same map. Path requests to one of a table's POIs from near another one
+  // follow the precomputed route instead of searching. Returns how many
+  // tables were loaded.
+  size_t LoadRouteTables(std::filesystem::path const& dir);
+  size_t GetRouteTableCount();
+  uint32_t GetRouteHits() const { return route_hits; }
+
+  uint32_t GetStartPolyCacheHits() const { return poly_cache_hits; }
+  uint32_t GetStartPolyCacheMisses() const { return poly_cache_misses; }
+
+  // Every query the worker calculates is recorded while this is open.
+  PathQueryRecorder& GetRecorder() { return recorder; }
+  PathQueryRecorder const& GetRecorder() const { return recorder; }
+
+private:
+  struct Request {
+    uint64_t generation;
+    uint32_t map_id;
+    vec3 src;
+    vec3 dest;
+    std::promise<PathResult> result;
+    // a formation path request if not empty
+    PointsArray leader_path;
+    vec2 offset{0, 0};
+  };
+
+  struct RaycastRequest {
+    uint32_t map_id;
+    vec3 src;
+    std::vector<vec3> targets;
+    std::promise<WalkRayResult> result;
+  };
+
+  void Run();
+  PathResult Calculate(Request const& req);
+  PathResult CalculateFormation(Request const& req);
+  WalkRayResult Raycast(RaycastRequest const& req);
+  std::shared_ptr<RouteTable const> GetRouteTable(uint32_t const map_id);
+
+  MMapManager& mmap_mgr;
+  PathQueryRecorder recorder;
+
+  // only touched by the worker thread
+  PolyLocalityCache start_poly_cache;
+  PolyLocalityCache raycast_poly_cache;
+  PathFinder path_info;
+
+  std::mutex requests_lock;
+  std::condition_variable requests_cv;
+  std::deque<Request> requests;
+  std::deque<RaycastRequest> raycast_requests;
+  bool stopping{false};
+
+  // bumped on Cancel, requests from an older generation are dropped
+  std::atomic<uint64_t> generation{0};
+
+  // map_id to table, loaded on the caller's thread and read on the worker's
+  std::unordered_map<uint32_t, std::shared_ptr<RouteTable const>>
+    route_tables;
+  std::mutex route_tables_lock;
+  std::atomic<uint32_t> route_hits{0};
+
+  std::atomic<uint32_t> poly_cache_hits{0};
+  std::atomic<uint32_t> poly_cache_misses{0};
+
+  // started last, once everything it uses is constructed
+  std::thread worker;
+};
+}
@@ -30,8 +30,16 @@
 
 #include <doctest.h>
 
+#include "../bench_helpers.hpp"
+#include "PathKernels.hpp"
+#include "PolyPathSearch.hpp"
+#include "SyntheticMMap.hpp"
+
 #define SMOOTH_PATH_STEP_SIZE 4.0f
 #define SMOOTH_PATH_SLOP 0.3f
+#define PATH_SEARCH_MAX_NODES 2048
+// search nodes to allow per corridor poly, 2048 / MAX_PATH_LENGTH
+#define PATH_SEARCH_NODES_PER_POLY 8
 
 using glm::distance;
 using glm::dot;
@@ -44,28 +52,29 @@ namespace fs = std::filesystem;
 
 namespace
 {
-dtQueryFilter createFilter()
+// dtNavMeshQuery isn't thread safe and neither is our search, so keep one
+// search node pool per thread, sized like the MMapManager's queries. Longer
+// corridors need more nodes, so it grows to fit the longest one asked for.
+phlipbot::PolyPathSearch& GetPathSearch(uint32_t const maxPathLength)
 {
-  dtQueryFilter filter;
-  unsigned short includeFlags = 0x0;
-  unsigned short excludeFlags = 0x0;
-
-  // Assuming player navigation
-  includeFlags |= NAV_GROUND;
-  includeFlags |= NAV_WATER;
-
-  filter.setIncludeFlags(includeFlags);
-  filter.setExcludeFlags(excludeFlags);
-  return filter;
+  thread_local phlipbot::PolyPathSearch search{PATH_SEARCH_MAX_NODES};
+  uint32_t const maxPolys = std::min<uint32_t>(
+    maxPathLength, DT_NULL_IDX / PATH_SEARCH_NODES_PER_POLY);
+  search.reserve(int(maxPolys * PATH_SEARCH_NODES_PER_POLY));
+  return search;
 }
 }
 
 namespace phlipbot
 {
-PathFinder::PathFinder(MMapManager& m_mmap, uint32_t const m_mapId) noexcept
+PathFinder::PathFinder(MMapManager& m_mmap,
+                       uint32_t const m_mapId,
+                       PolyLocalityCache* startPolyCache) noexcept
   : m_mmap(m_mmap),
     m_mapId(m_mapId),
     m_polyLength(0),
+    m_maxPathLength(0),
+    m_maxPointPathLength(0),
     m_type(),
     m_useStraightPath(false),
     m_forceDestination(false),
@@ -73,21 +82,131 @@ PathFinder::PathFinder(MMapManager& m_mmap, uint32_t const m_mapId) noexcept
     m_navMesh(nullptr),
     m_navMeshQuery(nullptr),
     m_targetAllowedFlags(0),
-    m_filter(createFilter())
+    m_startPolyCache(startPolyCache),
+    m_recorder(nullptr),
+    m_searchExpansions(0),
+    m_tileGeneration(0),
+    m_mapInstance(0),
+    m_filter(PlayerPathFilter::toQueryFilter())
 {
   m_type.set(PathFlag::PATHFIND_BLANK);
+  setMaxPathLength(MAX_PATH_LENGTH, MAX_POINT_PATH_LENGTH);
+}
+
+void PathFinder::reset(uint32_t const mapId)
+{
+  clear();
+  m_mapId = mapId;
+  m_navMesh = nullptr;
+  m_navMeshQuery = nullptr;
+  m_startPosition = vec3{0, 0, 0};
+  m_endPosition = vec3{0, 0, 0};
+  m_actualEndPosition = vec3{0, 0, 0};
+  m_type.reset();
+  m_type.set(PathFlag::PATHFIND_BLANK);
 }
 
 void PathFinder::setPathLengthLimit(float dist)
 {
-  m_pointPathLimit = std::min<uint32_t>(MAX_POINT_PATH_LENGTH,
-                                        uint32_t(dist / SMOOTH_PATH_STEP_SIZE));
+  uint32_t const points =
+    std::max<uint32_t>(2, uint32_t(dist / SMOOTH_PATH_STEP_SIZE));
+  if (points > m_maxPointPathLength) {
+    // polys are almost always longer than a smoothing step
+    setMaxPathLength(std::max(m_maxPathLength, points), points);
+  }
+  m_pointPathLimit = points;
+}
+
+void PathFinder::setMaxPathLength(uint32_t const maxPolys,
+                                  uint32_t const maxPoints)
+{
+  HADESMEM_DETAIL_ASSERT(maxPolys > 0 && maxPoints >= 2);
+
+  if (maxPolys > m_pathPolyRefs.size()) {
+    m_pathPolyRefs.resize(maxPolys);
+    m_smoothPolyRefs.resize(maxPolys);
+  }
+  if (3 * maxPoints > m_pointPathBuffer.size()) {
+    m_pointPathBuffer.resize(3 * maxPoints);
+    m_pathPoints.reserve(maxPoints);
+  }
+
+  m_maxPathLength = maxPolys;
+  m_maxPointPathLength = maxPoints;
+  m_pointPathLimit = maxPoints;
 }
 
 bool PathFinder::calculate(vec3 const& src,
                            vec3 const& dest,
                            bool const forceDest)
 {
+  if (m_recorder) {
+    uint32_t flags = 0;
+    if (forceDest) flags |= PathQueryFlags::ForceDest;
+    if (m_useStraightPath) flags |= PathQueryFlags::StraightPath;
+    m_recorder->Record(PathQuery{m_mapId, src, dest, flags});
+  }
+
+  if (prepareQuery(src, dest, forceDest)) {
+    BuildPolyPath(src, dest);
+  }
+  return true;
+}
+
+bool PathFinder::isPathValid() const
+{
+  if (m_polyLength == 0 ||
+      m_mmap.getTileGeneration(m_mapId) == m_tileGeneration) {
+    return true;
+  }
+
+  // the map was unloaded, m_navMesh may be gone, and a reloaded one may be
+  // at the same address
+  if (m_mmap.getMapInstance(m_mapId) != m_mapInstance) {
+    return false;
+  }
+  dtNavMesh const* navMesh = m_mmap.GetNavMesh(m_mapId);
+  if (navMesh == nullptr) {
+    return false;
+  }
+
+  // removing a tile bumps its salt, so refs into it no longer validate
+  for (uint32_t i = 0; i < m_polyLength; ++i) {
+    if (!navMesh->isValidPolyRef(m_pathPolyRefs[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+PathEstimate PathFinder::estimate(vec3 const& src, vec3 const& dest)
+{
+  if (!prepareQuery(src, dest, false)) {
+    return {Length(), m_type};
+  }
+
+  BuildPolyPath(src, dest, false);
+
+  // no corridor, we built a shortcut instead
+  if (!m_polyLength || !m_pathPoints.empty()) {
+    return {Length(), m_type};
+  }
+
+  float startPoint[3] = {src.y, src.z, src.x};
+  float endPoint[3] = {dest.y, dest.z, dest.x};
+  return {corridorLength(startPoint, endPoint), m_type};
+}
+
+// return value : false if there's no nav mesh to search, in which case we've
+//                already built a shortcut path
+bool PathFinder::prepareQuery(vec3 const& src,
+                              vec3 const& dest,
+                              bool const forceDest)
+{
+  // before we find any refs, so an unload while we're busy is noticed
+  m_tileGeneration = m_mmap.getTileGeneration(m_mapId);
+  m_mapInstance = m_mmap.getMapInstance(m_mapId);
+
   // A m_navMeshQuery object is not thread safe, but a same PathFinder can be
   // shared between threads. So need to get a new one.
   m_navMeshQuery = m_mmap.GetNavMeshQuery(m_mapId);
@@ -114,28 +233,75 @@ bool PathFinder::calculate(vec3 const& src,
     m_type.reset();
     m_type.set(PathFlag::PATHFIND_NORMAL);
     m_type.set(PathFlag::PATHFIND_NOT_USING_PATH);
-    return true;
+    return false;
   }
 
-  BuildPolyPath(src, dest);
   return true;
 }
 
+float PathFinder::corridorLength(float const* startPoint,
+                                 float const* endPoint)
+{
+  HADESMEM_DETAIL_ASSERT(m_polyLength > 0);
+
+  float prev[3];
+  dtVcopy(prev, startPoint);
+  float length = 0.0f;
+
+  for (uint32_t i = 0; i + 1 < m_polyLength; ++i) {
+    dtMeshTile const* fromTile = nullptr;
+    dtPoly const* fromPoly = nullptr;
+    dtMeshTile const* toTile = nullptr;
+    dtPoly const* toPoly = nullptr;
+    m_navMesh->getTileAndPolyByRefUnsafe(m_pathPolyRefs[i], &fromTile,
+                                         &fromPoly);
+    m_navMesh->getTileAndPolyByRefUnsafe(m_pathPolyRefs[i + 1], &toTile,
+                                         &toPoly);
+
+    float mid[3];
+    if (dtStatusFailed(GetEdgeMidPoint(m_pathPolyRefs[i], fromPoly, fromTile,
+                                       m_pathPolyRefs[i + 1], toPoly, toTile,
+                                       mid))) {
+      continue;
+    }
+
+    length += dtVdist(prev, mid);
+    dtVcopy(prev, mid);
+  }
+
+  // an incomplete corridor ends at whatever part of the last poly is closest
+  float end[3];
+  if (dtStatusFailed(m_navMeshQuery->closestPointOnPoly(
+        m_pathPolyRefs[m_polyLength - 1], endPoint, end, nullptr))) {
+    dtVcopy(end, endPoint);
+  }
+  length += dtVdist(prev, end);
+
+  setActualEndPosition(vec3{end[2], end[0], end[1]});
+  return length;
+}
+
 dtPolyRef PathFinder::FindWalkPoly(dtNavMeshQuery const* query,
                                    float const* pointYZX,
                                    dtQueryFilter const& filter,
                                    float* closestPointYZX,
-                                   float zSearchDist)
+                                   float zSearchDist,
+                                   PolyLocalityCache* cache)
 {
   HADESMEM_DETAIL_ASSERT(query);
 
   // WARNING : Nav mesh coords are Y, Z, X (and not X, Y, Z)
   float extents[3] = {5.0f, zSearchDist, 5.0f};
 
-  // Default recastnavigation method
+  // Default recastnavigation method, unless the caller remembers where it
+  // was last time
   dtPolyRef polyRef;
-  if (dtStatusFailed(query->findNearestPoly(pointYZX, extents, &filter,
-                                            &polyRef, closestPointYZX))) {
+  dtStatus const res =
+    cache ? cache->findNearestPoly(*query, pointYZX, extents, filter, &polyRef,
+                                   closestPointYZX)
+          : query->findNearestPoly(pointYZX, extents, &filter, &polyRef,
+                                   closestPointYZX);
+  if (dtStatusFailed(res)) {
     return 0;
   }
 
@@ -149,13 +315,23 @@ dtPolyRef PathFinder::FindWalkPoly(dtNavMeshQuery const* query,
 
 dtPolyRef PathFinder::getPolyByLocation(float const* point,
                                         float* distance,
-                                        uint32_t allowedFlags)
+                                        uint32_t allowedFlags,
+                                        PolyLocalityCache* cache)
 {
   float closestPoint[3] = {0.0f, 0.0f, 0.0f};
-  dtQueryFilter filter;
-  filter.setIncludeFlags(m_filter.getIncludeFlags() |
-                         static_cast<uint16_t>(allowedFlags));
-  dtPolyRef polyRef = FindWalkPoly(m_navMeshQuery, point, filter, closestPoint);
+
+  // only build an extended filter if we actually need to allow extra flags
+  dtPolyRef polyRef;
+  if (allowedFlags == 0) {
+    polyRef =
+      FindWalkPoly(m_navMeshQuery, point, m_filter, closestPoint, 10.0f, cache);
+  } else {
+    dtQueryFilter filter = m_filter;
+    filter.setIncludeFlags(m_filter.getIncludeFlags() |
+                           static_cast<uint16_t>(allowedFlags));
+    polyRef =
+      FindWalkPoly(m_navMeshQuery, point, filter, closestPoint, 10.0f, cache);
+  }
   if (m_navMesh->isValidPolyRef(polyRef)) {
     *distance = dtVdist(closestPoint, point);
     return polyRef;
@@ -163,13 +339,16 @@ dtPolyRef PathFinder::getPolyByLocation(float const* point,
   return 0;
 }
 
-void PathFinder::BuildPolyPath(vec3 const& startPos, vec3 const& endPos)
+void PathFinder::BuildPolyPath(vec3 const& startPos,
+                               vec3 const& endPos,
+                               bool const buildPointPath)
 {
   float distToStartPoly, distToEndPoly;
   float startPoint[3] = {startPos.y, startPos.z, startPos.x};
   float endPoint[3] = {endPos.y, endPos.z, endPos.x};
 
-  dtPolyRef startPoly = getPolyByLocation(startPoint, &distToStartPoly);
+  dtPolyRef startPoly =
+    getPolyByLocation(startPoint, &distToStartPoly, 0, m_startPolyCache);
   dtPolyRef endPoly =
     getPolyByLocation(endPoint, &distToEndPoly, m_targetAllowedFlags);
 
@@ -197,15 +376,19 @@ void PathFinder::BuildPolyPath(vec3 const& startPos, vec3 const& endPos)
     return;
   }
 
-  dtStatus dtResult = m_navMeshQuery->findPath(
+  // search with the compile-time filter so the cost function inlines, m_filter
+  // is the same filter for the dtNavMeshQuery calls that need a dtQueryFilter
+  PolyPathSearch& search = GetPathSearch(m_maxPathLength);
+  dtStatus dtResult = search.findPath<PlayerPathFilter>(
+    *m_navMesh, // nav mesh to search
     startPoly, // start polygon
     endPoly, // end polygon
     startPoint, // start position
     endPoint, // end position
-    &m_filter, // polygon search filter
-    m_pathPolyRefs, // [out] path
+    m_pathPolyRefs.data(), // [out] path
     (int*)&m_polyLength, // [out] path length
-    MAX_PATH_LENGTH); // max number of polygons in output path
+    int(m_maxPathLength)); // max number of polygons in output path
+  m_searchExpansions = uint32_t(search.getExpandedNodes());
 
   if (m_polyLength == 0 || dtStatusFailed(dtResult)) {
     // only happens if we passed bad data to findPath(), or navmesh is messed
@@ -229,20 +412,22 @@ void PathFinder::BuildPolyPath(vec3 const& startPos, vec3 const& endPos)
     m_type.set(PathFlag::PATHFIND_INCOMPLETE);
   }
 
-  BuildPointPath(startPoint, endPoint);
+  if (buildPointPath) {
+    BuildPointPath(startPoint, endPoint);
+  }
 }
 
 void PathFinder::BuildPointPath(const float* startPoint, const float* endPoint)
 {
   // generate the point-path out of our up-to-date poly-path
-  float pathPoints[3 * MAX_POINT_PATH_LENGTH];
+  float* pathPoints = m_pointPathBuffer.data();
   uint32_t pointCount = 0;
   dtStatus dtResult = DT_FAILURE;
   if (m_useStraightPath) {
     dtResult = m_navMeshQuery->findStraightPath(
       startPoint, // start position
       endPoint, // end position
-      m_pathPolyRefs, // current path
+      m_pathPolyRefs.data(), // current path
       m_polyLength, // lenth of current path
       pathPoints, // [out] path corner points
       NULL, // [out] flags
@@ -252,7 +437,7 @@ void PathFinder::BuildPointPath(const float* startPoint, const float* endPoint)
   } else {
     dtResult = findSmoothPath(startPoint, // start position
                               endPoint, // end position
-                              m_pathPolyRefs, // current path
+                              m_pathPolyRefs.data(), // current path
                               m_polyLength, // length of current path
                               pathPoints, // [out] path corner points
                               (int*)&pointCount,
@@ -272,10 +457,7 @@ void PathFinder::BuildPointPath(const float* startPoint, const float* endPoint)
   }
 
   m_pathPoints.resize(pointCount);
-  for (uint32_t i = 0; i < pointCount; ++i) {
-    m_pathPoints[i] =
-      vec3{pathPoints[i * 3 + 2], pathPoints[i * 3 + 0], pathPoints[i * 3 + 1]};
-  }
+  SwizzleYZXToXYZ(pathPoints, m_pathPoints.data(), pointCount);
 
   // first point is always our current location - we need the next one
   setActualEndPosition(m_pathPoints[pointCount - 1]);
@@ -498,7 +680,7 @@ dtStatus PathFinder::findSmoothPath(const float* startPos,
   *smoothPathSize = 0;
   uint32_t nsmoothPath = 0;
 
-  dtPolyRef polys[MAX_PATH_LENGTH];
+  dtPolyRef* polys = m_smoothPolyRefs.data();
   memcpy(polys, polyPath, sizeof(dtPolyRef) * polyPathSize);
   uint32_t npolys = polyPathSize;
 
@@ -557,7 +739,7 @@ dtStatus PathFinder::findSmoothPath(const float* startPos,
     m_navMeshQuery->moveAlongSurface(polys[0], iterPos, moveTgt, &m_filter,
                                      result, visited, (int*)&nvisited,
                                      MAX_VISIT_POLY);
-    npolys = fixupCorridor(polys, npolys, MAX_PATH_LENGTH, visited, nvisited);
+    npolys = fixupCorridor(polys, npolys, m_maxPathLength, visited, nvisited);
     npolys = fixupShortcuts(polys, npolys, m_navMeshQuery);
 
     m_navMeshQuery->getPolyHeight(polys[0], result, &result[1]);
@@ -646,17 +828,13 @@ dtStatus PathFinder::findSmoothPath(const float* startPos,
   *smoothPathSize = nsmoothPath;
 
   // this is most likely a loop
-  return nsmoothPath < MAX_POINT_PATH_LENGTH ? DT_SUCCESS : DT_FAILURE;
+  return nsmoothPath < m_maxPointPathLength ? DT_SUCCESS : DT_FAILURE;
 }
 
 float PathFinder::Length() const
 {
   HADESMEM_DETAIL_ASSERT(m_pathPoints.size());
-  float length = 0.0f;
-  uint32_t maxIndex = m_pathPoints.size() - 1;
-  for (uint32_t i = 1; i <= maxIndex; ++i)
-    length += distance(m_pathPoints[i - 1], m_pathPoints[i]);
-  return length;
+  return PathLength(m_pathPoints.data(), m_pathPoints.size());
 }
 
 bool PathFinder::inRangeYZX(const float* v1,
@@ -719,5 +897,265 @@ TEST_CASE("PathFinder should be able to compute a path in Elwynn Forest")
   CHECK(!path_type.test(PathFlag::PATHFIND_INCOMPLETE));
   CHECK(path_type.test(PathFlag::PATHFIND_NORMAL));
 }
+
+TEST_CASE("PathFinder::estimate should be close to the calculated path length")
+{
+  uint32_t const map_id = 0;
+  vec3 start{-8949.95f, -132.493f, 83.5312f};
+  vec3 end{-9046.507f, -45.71962f, 88.33186f};
+
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+  REQUIRE(mmap.loadMap(map_id, vec2i{48, 32}));
+
+  PathFinder path_info{mmap, map_id};
+  REQUIRE(path_info.calculate(start, end, false));
+  float const length = path_info.Length();
+  auto const type = path_info.getPathType();
+
+  PathFinder estimator{mmap, map_id};
+  PathEstimate const est = estimator.estimate(start, end);
+
+  CHECK(est.type == type);
+  CHECK(estimator.getPath().empty());
+  CHECK(est.length >= distance(start, end));
+  // portal midpoints zig-zag a bit, but shouldn't be wildly off
+  CHECK(est.length > 0.8f * length);
+  CHECK(est.length < 1.5f * length);
+}
+
+TEST_CASE("PathFinder corridor and point limits are configurable")
+{
+  uint32_t const map_id = 0;
+  vec3 start{-8949.95f, -132.493f, 83.5312f};
+  vec3 end{-9046.507f, -45.71962f, 88.33186f};
+
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+  REQUIRE(mmap.loadMap(map_id, vec2i{48, 32}));
+
+  PathFinder path_info{mmap, map_id};
+  CHECK(path_info.getMaxPathLength() == MAX_PATH_LENGTH);
+  CHECK(path_info.getMaxPointPathLength() == MAX_POINT_PATH_LENGTH);
+
+  // a corridor this short can't reach the destination
+  path_info.setMaxPathLength(2, 2);
+  REQUIRE(path_info.calculate(start, end, false));
+  CHECK(!path_info.getPathType().test(PathFlag::PATHFIND_NORMAL));
+
+  // asking for a longer path grows the limits past the defaults
+  path_info.setPathLengthLimit(4096.0f);
+  CHECK(path_info.getMaxPathLength() > MAX_PATH_LENGTH);
+  CHECK(path_info.getMaxPointPathLength() > MAX_POINT_PATH_LENGTH);
+
+  REQUIRE(path_info.calculate(start, end, false));
+  CHECK(path_info.getPathType().test(PathFlag::PATHFIND_NORMAL));
+  CHECK(path_info.Length() > 0.0f);
+}
+
+TEST_CASE("PathFinder::isPathValid notices its tiles being unloaded")
+{
+  SyntheticTerrain terrain;
+  terrain.tiles = vec2i{3, 1};
+  fs::path const dir = SyntheticMMapDir("unload");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  uint32_t const map_id = terrain.map_id;
+  MMapManager mmap{dir};
+  for (int x = 0; x < terrain.tiles.x; ++x) {
+    REQUIRE(mmap.loadMap(map_id, terrain.first_tile + vec2i{x, 0}));
+  }
+
+  std::vector<vec2i> unloaded;
+  uint32_t const listener = mmap.addTileUnloadListener(
+    [&](uint32_t, vec2i const& tile, uint32_t) { unloaded.push_back(tile); });
+
+  // both in tile {32, 32}
+  vec3 const start{-400.0f, -200.0f, 0.0f};
+  vec3 const end{-100.0f, -300.0f, 0.0f};
+
+  PathFinder path_info{mmap, map_id};
+  REQUIRE(path_info.calculate(start, end));
+  REQUIRE(path_info.getPathType().test(PathFlag::PATHFIND_NORMAL));
+  CHECK(path_info.isPathValid());
+
+  // a tile the path doesn't touch
+  REQUIRE(mmap.unloadMap(map_id, vec2i{34, 32}));
+  REQUIRE(unloaded.size() == 1);
+  CHECK(unloaded[0] == vec2i{34, 32});
+  CHECK(mmap.getTileGeneration(map_id) == path_info.getTileGeneration() + 1);
+  CHECK(path_info.isPathValid());
+
+  REQUIRE(mmap.unloadMap(map_id, vec2i{32, 32}));
+  CHECK(!path_info.isPathValid());
+
+  // a path calculated after the unload is fine again
+  REQUIRE(mmap.loadMap(map_id, vec2i{32, 32}));
+  REQUIRE(path_info.calculate(start, end));
+  CHECK(path_info.isPathValid());
+
+  // every remaining tile goes with the map, and so does the nav mesh
+  REQUIRE(mmap.unloadMap(map_id));
+  CHECK(unloaded.size() == 4);
+  CHECK(!path_info.isPathValid());
+
+  // and stays stale once the map's back, wherever its new nav mesh is
+  for (int x = 0; x < terrain.tiles.x; ++x) {
+    REQUIRE(mmap.loadMap(map_id, terrain.first_tile + vec2i{x, 0}));
+  }
+  CHECK(!path_info.isPathValid());
+  REQUIRE(path_info.calculate(start, end));
+  CHECK(path_info.isPathValid());
+
+  mmap.removeTileUnloadListener(listener);
+}
+
+TEST_CASE("PathFinder never takes a path across magma")
+{
+  SyntheticTerrain terrain;
+  terrain.hill_height = 10.0f;
+  terrain.hill_wavelength = 120.0f;
+  terrain.water = true;
+  terrain.water_level = 0.0f;
+  terrain.liquid = NAV_MAGMA;
+
+  fs::path const dir = SyntheticMMapDir("magma");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  // islands on either side of a magma filled trough, see the synthetic water
+  // test
+  vec3 const trough{-150.0f, -120.0f, terrain.water_level};
+  vec3 const island{-90.0f, -120.0f, 10.0f};
+  vec3 const other_island{-90.0f, -240.0f, 10.0f};
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMapAround(terrain.map_id, island.xy));
+  dtNavMeshQuery const* query = mmap.GetNavMeshQuery(terrain.map_id);
+  dtNavMesh const* nav = mmap.GetNavMesh(terrain.map_id);
+  REQUIRE(query != nullptr);
+  REQUIRE(nav != nullptr);
+
+  // the magma is really there, it's just not for players
+  dtQueryFilter const any = PlayerAvoidLiquidsFilter::toQueryFilter();
+  float const extents[3] = {2.0f, 2.0f, 2.0f};
+  float const troughYZX[3] = {trough.y, trough.z, trough.x};
+  dtPolyRef trough_ref = 0;
+  float nearest[3];
+  query->findNearestPoly(troughYZX, extents, &any, &trough_ref, nearest);
+  unsigned char trough_area = NAV_EMPTY;
+  nav->getPolyArea(trough_ref, &trough_area);
+  REQUIRE(trough_area == NAV_MAGMA);
+
+  PathFinder path_info{mmap, terrain.map_id};
+  REQUIRE(path_info.calculate(island, other_island));
+  REQUIRE(path_info.getPathPolyLength() > 0);
+
+  for (uint32_t i = 0; i < path_info.getPathPolyLength(); ++i) {
+    unsigned char area = NAV_EMPTY;
+    REQUIRE(dtStatusSucceed(
+      nav->getPolyArea(path_info.getPathPolyRefs()[i], &area)));
+    CHECK(area != NAV_MAGMA);
+  }
+}
+
+// allocations can only be counted with the debug CRT, so this is skipped in
+// release builds
+TEST_CASE("PathFinder::calculate doesn't allocate once warmed up" *
+          doctest::skip(!bench::AllocCounter::Supported()))
+{
+  uint32_t const map_id = 0;
+  vec3 start{-8949.95f, -132.493f, 83.5312f};
+  vec3 end{-9046.507f, -45.71962f, 88.33186f};
+
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+  REQUIRE(mmap.loadMap(map_id, vec2i{48, 32}));
+
+  // the first query creates this thread's dtNavMeshQuery and path search
+  PathFinder path_info{mmap, map_id};
+  REQUIRE(path_info.calculate(start, end, false));
+
+  uint32_t allocations = 0;
+  {
+    bench::AllocCounter counter;
+    for (int i = 0; i < 8; ++i) {
+      path_info.reset(map_id);
+      path_info.calculate(start, end, false);
+      path_info.estimate(start, end);
+    }
+    allocations = counter.Allocations();
+  }
+
+  CHECK(path_info.getPathType().test(PathFlag::PATHFIND_NORMAL));
+  CHECK(allocations == 0);
+}
+
+TEST_CASE("benchmark PathFinder reused vs constructed per query" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  uint32_t const map_id = 0;
+  vec3 start{-8949.95f, -132.493f, 83.5312f};
+  vec3 end{-9046.507f, -45.71962f, 88.33186f};
+
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+  REQUIRE(mmap.loadMap(map_id, vec2i{48, 32}));
+
+  uint32_t const iters = 256;
+  PathFinder reused{mmap, map_id};
+  reused.calculate(start, end, false);
+
+  bench::AllocCounter fresh_allocs;
+  double const fresh_us = bench::TimeMicros(iters, [&]() {
+    auto path_info = std::make_unique<PathFinder>(mmap, map_id);
+    path_info->calculate(start, end, false);
+    bench::DoNotOptimize(path_info->getPath().size());
+  });
+  uint32_t const fresh_count = fresh_allocs.Allocations();
+
+  bench::AllocCounter reused_allocs;
+  double const reused_us = bench::TimeMicros(iters, [&]() {
+    reused.reset(map_id);
+    reused.calculate(start, end, false);
+    bench::DoNotOptimize(reused.getPath().size());
+  });
+  uint32_t const reused_count = reused_allocs.Allocations();
+
+  bench::Report("PathFinder constructed per query", fresh_us);
+  bench::Report("PathFinder reused", reused_us);
+  if (bench::AllocCounter::Supported()) {
+    std::printf("[bench] allocations/query: constructed %.2f, reused %.2f\n",
+                double(fresh_count) / iters, double(reused_count) / iters);
+  }
+}
+
+TEST_CASE("benchmark PathFinder::estimate vs PathFinder::calculate" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  uint32_t const map_id = 0;
+  vec3 start{-8949.95f, -132.493f, 83.5312f};
+  vec3 end{-9046.507f, -45.71962f, 88.33186f};
+
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+  REQUIRE(mmap.loadMap(map_id, vec2i{48, 32}));
+  PathFinder path_info{mmap, map_id};
+
+  uint32_t const iters = 256;
+
+  double const smooth_us = bench::TimeMicros(iters, [&]() {
+    path_info.calculate(start, end, false);
+    bench::DoNotOptimize(path_info.getPath().size());
+  });
+
+  path_info.setUseStrightPath(true);
+  double const straight_us = bench::TimeMicros(iters, [&]() {
+    path_info.calculate(start, end, false);
+    bench::DoNotOptimize(path_info.getPath().size());
+  });
+
+  double const estimate_us = bench::TimeMicros(iters, [&]() {
+    bench::DoNotOptimize(path_info.estimate(start, end).length);
+  });
+
+  bench::Report("PathFinder::calculate (smooth)", smooth_us);
+  bench::Report("PathFinder::calculate (straight)", straight_us);
+  bench::Report("PathFinder::estimate", estimate_us);
+}
 }
 }
@@ -27,6 +27,8 @@
 
 #include "MoveMap.hpp"
 #include "MoveMapSharedDefines.hpp"
+#include "PathQueryLog.hpp"
+#include "PolyLocalityCache.hpp"
 
 #include "../wow_constants.hpp"
 
@@ -41,6 +43,7 @@ using PointsArray = std::vector<vec3>;
 // 64*6.0f=384y  number_of_points*interval = max_path_len
 // this is way more than actual evade range
 // I think we can safely cut those down even more
+// These are the defaults, see PathFinder::setMaxPathLength for longer routes.
 #define MAX_PATH_LENGTH 256
 #define MAX_POINT_PATH_LENGTH 256
 
@@ -90,18 +93,49 @@ size_t const
   PATHFIND_CASTER = 10;
 };
 
+struct PathEstimate {
+  float length; // approximate walking distance to the (actual) end position
+  std::bitset<10> type; // same as PathFinder::getPathType()
+};
+
 struct PathFinder {
-  explicit PathFinder(MMapManager& mmgr, uint32_t const m_mapId) noexcept;
+  // startPolyCache, if given, is used to resolve the start position, so an
+  // agent re-planning from where it stands can skip findNearestPoly
+  explicit PathFinder(MMapManager& mmgr,
+                      uint32_t const m_mapId,
+                      PolyLocalityCache* startPolyCache = nullptr) noexcept;
 
   // return value : true if new path was calculated
   bool
   calculate(vec3 const& src, vec3 const& dest, bool const forceDest = false);
 
+  // Like calculate, but stops after finding the poly corridor and measures it
+  // through the portal midpoints instead of building a point path. Slightly
+  // longer than the smoothed path, and much cheaper.
+  PathEstimate estimate(vec3 const& src, vec3 const& dest);
+
+  // Forget the last path and start querying mapId. A PathFinder keeps its
+  // buffers between calculations, so reusing one doesn't allocate. It can
+  // move between threads, but only one thread may use it at a time.
+  void reset(uint32_t const mapId);
+
   void setUseStrightPath(bool useStraightPath)
   {
     m_useStraightPath = useStraightPath;
   };
+  // Limit the point path to about distance yards, growing the buffers if the
+  // current limits can't reach that far.
   void setPathLengthLimit(float distance);
+  // Set how many polys the corridor and how many points the point path may
+  // have. The buffers only grow, so going back to short paths keeps them
+  // around for the next long one.
+  void setMaxPathLength(uint32_t const maxPolys, uint32_t const maxPoints);
+
+  inline uint32_t getMaxPathLength() const { return m_maxPathLength; }
+  inline uint32_t getMaxPointPathLength() const
+  {
+    return m_maxPointPathLength;
+  }
 
   inline uint32_t getMapId() { return m_mapId; }
 
@@ -119,14 +153,42 @@ struct PathFinder {
 
   float Length() const;
 
+  // search nodes expanded finding the last corridor
+  inline uint32_t getSearchExpansions() const { return m_searchExpansions; }
+
+  // Whether the poly corridor behind the last path is still in the nav mesh,
+  // i.e. none of its tiles were unloaded since. Cheap unless a tile of this
+  // map was unloaded, then each poly is checked. A path without a corridor
+  // has nothing to go stale.
+  bool isPathValid() const;
+  // MMapManager::getTileGeneration when the last path was calculated
+  inline uint32_t getTileGeneration() const { return m_tileGeneration; }
+  inline std::vector<dtPolyRef> const& getPathPolyRefs() const
+  {
+    return m_pathPolyRefs;
+  }
+  inline uint32_t getPathPolyLength() const { return m_polyLength; }
+
+  // Record every calculate() query to recorder, or stop recording if nullptr.
+  inline void setRecorder(PathQueryRecorder* recorder)
+  {
+    m_recorder = recorder;
+  }
+
 private:
   MMapManager& m_mmap;
 
-  uint32_t const m_mapId;
+  uint32_t m_mapId;
 
-  dtPolyRef m_pathPolyRefs[MAX_PATH_LENGTH]; // array of detour polygon
-                                             // references
+  std::vector<dtPolyRef> m_pathPolyRefs; // array of detour polygon
+                                         // references
   uint32_t m_polyLength; // number of polygons in the path
+  uint32_t m_maxPathLength; // max number of polygons in the path
+
+  // scratch buffers, kept around so calculating a path doesn't allocate
+  std::vector<dtPolyRef> m_smoothPolyRefs; // corridor for findSmoothPath
+  std::vector<float> m_pointPathBuffer; // point path, YZX
+  uint32_t m_maxPointPathLength; // max number of points in the point path
 
   PointsArray m_pathPoints; // our actual (x,y,z) path to the target
   std::bitset<10> m_type; // tells what kind of path this is
@@ -134,7 +196,7 @@ private:
   bool m_useStraightPath; // type of path will be generated
   bool m_forceDestination; // when set, we will always arrive at given point
   uint32_t m_pointPathLimit; // limit point path size; min(this,
-                             // MAX_POINT_PATH_LENGTH)
+                             // m_maxPointPathLength)
 
   vec3 m_startPosition; // {x, y, z} of current location
   vec3 m_endPosition; // {x, y, z} of the destination
@@ -145,6 +207,14 @@ private:
                                         // path
   uint32_t m_targetAllowedFlags;
 
+  PolyLocalityCache* m_startPolyCache; // optional, not owned
+  PathQueryRecorder* m_recorder; // optional, not owned
+  uint32_t m_searchExpansions; // search nodes expanded for the last corridor
+  uint32_t m_tileGeneration; // m_mmap's tile generation for m_mapId, when the
+                             // corridor was found
+  uint32_t m_mapInstance; // m_mmap's instance of m_mapId, when the corridor
+                          // was found
+
   dtQueryFilter m_filter; // use single filter for all movements, update it when
                           // needed
 
@@ -162,6 +232,7 @@ private:
   inline void clear()
   {
     m_polyLength = 0;
+    m_searchExpansions = 0;
     m_pathPoints.clear();
   }
   bool inRange(vec3 const& p1, vec3 const& p2, float r, float h) const;
@@ -172,13 +243,21 @@ private:
                                 float const* pointYZX,
                                 dtQueryFilter const& filter,
                                 float* closestPointYZX,
-                                float zSearchDist = 10.0f);
+                                float zSearchDist = 10.0f,
+                                PolyLocalityCache* cache = nullptr);
 
-  dtPolyRef
-  getPolyByLocation(float const* point, float* distance, uint32_t flags = 0);
+  dtPolyRef getPolyByLocation(float const* point,
+                              float* distance,
+                              uint32_t flags = 0,
+                              PolyLocalityCache* cache = nullptr);
   bool HaveTiles(vec3 const& p) const;
 
-  void BuildPolyPath(vec3 const& startPos, vec3 const& endPos);
+  bool prepareQuery(vec3 const& src, vec3 const& dest, bool const forceDest);
+  float corridorLength(float const* startPoint, float const* endPoint);
+
+  void BuildPolyPath(vec3 const& startPos,
+                     vec3 const& endPos,
+                     bool const buildPointPath = true);
   void BuildPointPath(float const* startPoint, float const* endPoint);
   void BuildShortcut();
 
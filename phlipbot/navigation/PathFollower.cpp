@@ -0,0 +1,288 @@
+#include "PathFollower.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include <glm/geometric.hpp>
+
+#include <doctest.h>
+
+#include "PathKernels.hpp"
+
+using glm::distance;
+
+namespace
+{
+float const NoProgress = std::numeric_limits<float>::max();
+
+// a repair path from PathFinder ends this close to the point it was asked
+// for, the same slop BuildPointPath allows before forcing the destination
+float const REJOIN_SLOP = 1.0f;
+}
+
+namespace phlipbot
+{
+void PathFollower::SetPath(PointsArray new_path)
+{
+  path = std::move(new_path);
+
+  remaining.assign(path.size(), 0.0f);
+  for (size_t i = path.size(); i-- > 1;) {
+    remaining[i - 1] = remaining[i] + distance(path[i - 1], path[i]);
+  }
+
+  segment = 0;
+  rejoin_idx = 0;
+  cross_track = 0.0f;
+  best_remaining = NoProgress;
+  stalled = 0.0f;
+}
+
+void PathFollower::Clear() { SetPath(PointsArray{}); }
+
+bool PathFollower::Repair(PointsArray const& repair)
+{
+  if (!HasPath() || repair.size() < 2) {
+    return false;
+  }
+
+  // the rejoin point it was asked for, still ahead of us
+  auto const it =
+    std::find_if(path.begin() + segment + 1, path.end(), [&](vec3 const& p) {
+      return distance(p, repair.back()) <= REJOIN_SLOP;
+    });
+  if (it == path.end()) {
+    return false;
+  }
+
+  PointsArray spliced{repair};
+  spliced.insert(spliced.end(), it + 1, path.end());
+  SetPath(std::move(spliced));
+  return true;
+}
+
+PathFollower::Action PathFollower::Update(vec3 const& pos, float const dt)
+{
+  if (!HasPath()) {
+    return Action::None;
+  }
+
+  // already there, and there's no segment left to advance along
+  if (segment + 1 >= path.size()) {
+    cross_track = 0.0f;
+    return Action::Arrived;
+  }
+
+  Advance(pos);
+  if (segment + 1 >= path.size()) {
+    cross_track = 0.0f;
+    return Action::Arrived;
+  }
+
+  float const left = Remaining(pos);
+  if (left < best_remaining - stuck_progress) {
+    best_remaining = left;
+    stalled = 0.0f;
+  } else {
+    stalled += dt;
+  }
+
+  if (cross_track > replan_thresh || stalled >= stuck_time) {
+    // give whatever comes of it a fresh start
+    best_remaining = NoProgress;
+    stalled = 0.0f;
+    return Action::Replan;
+  }
+
+  if (cross_track > repair_thresh) {
+    rejoin_idx = FindRejoinIndex(pos);
+    return Action::Repair;
+  }
+
+  return Action::Follow;
+}
+
+void PathFollower::Advance(vec3 const& pos)
+{
+  // Project onto the segment we're on or one of the next few. Like
+  // movePosition we only ever move forward, and only onto a segment we're
+  // within the repair threshold of, at about the height of one of its ends.
+  size_t const count = std::min(path.size() - segment, look_ahead + 2);
+  distances.resize(count - 1);
+  SegmentDistances2D(path.data() + segment, count, pos.xy, distances.data());
+
+  size_t nearest = 0;
+  for (size_t i = 1; i + 1 < count; ++i) {
+    vec3 const& a = path[segment + i];
+    vec3 const& b = path[segment + i + 1];
+    float const dz =
+      std::min(std::abs(a.z - pos.z), std::abs(b.z - pos.z));
+    if (distances[i] < distances[nearest] && distances[i] <= repair_thresh &&
+        dz <= reach_height) {
+      nearest = i;
+    }
+  }
+
+  segment += nearest;
+  cross_track = distances[nearest];
+
+  // and the waypoints we walked through
+  segment += FirstOutOfRange(path.data() + segment + 1,
+                             path.size() - segment - 1, pos, reach_2d,
+                             reach_height);
+}
+
+float PathFollower::Remaining(vec3 const& pos) const
+{
+  return remaining[segment + 1] + distance(pos, path[segment + 1]);
+}
+
+size_t PathFollower::FindRejoinIndex(vec3 const& pos) const
+{
+  // along the path from where we're projected onto it
+  vec2 const to_end = path[segment + 1].xy - pos.xy;
+  float along = std::sqrt(
+    std::max(glm::dot(to_end, to_end) - cross_track * cross_track, 0.0f));
+
+  size_t idx = segment + 1;
+  while (along < rejoin_dist && idx + 1 < path.size()) {
+    along += distance(path[idx], path[idx + 1]);
+    ++idx;
+  }
+  return idx;
+}
+
+namespace test
+{
+namespace
+{
+// 10 yards east, 40 north, 10 east again, on flat ground
+PointsArray TestPath()
+{
+  return PointsArray{{0, 0, 0}, {10, 0, 0}, {10, 40, 0}, {20, 40, 0}};
+}
+}
+
+TEST_CASE("PathFollower follows the path to the end")
+{
+  PathFollower follower;
+  CHECK(follower.Update(vec3{0, 0, 0}, 0.1f) == PathFollower::Action::None);
+
+  follower.SetPath(TestPath());
+  REQUIRE(follower.HasPath());
+
+  CHECK(follower.Update(vec3{0, 0, 0}, 0.1f) == PathFollower::Action::Follow);
+  CHECK(follower.GetSegment() == 0);
+  CHECK(follower.GetSteerTarget() == vec3{10, 0, 0});
+
+  CHECK(follower.Update(vec3{10, 0.2f, 0}, 0.1f) ==
+        PathFollower::Action::Follow);
+  CHECK(follower.GetSegment() == 1);
+  CHECK(follower.GetSteerTarget() == vec3{10, 40, 0});
+
+  CHECK(follower.Update(vec3{10, 20, 0}, 0.1f) ==
+        PathFollower::Action::Follow);
+  CHECK(follower.GetCrossTrack() == doctest::Approx(0.0f));
+
+  CHECK(follower.Update(vec3{19.8f, 40, 0}, 0.1f) ==
+        PathFollower::Action::Arrived);
+
+  // and stays there, wherever we wander off to
+  CHECK(follower.Update(vec3{19.8f, 40, 0}, 0.1f) ==
+        PathFollower::Action::Arrived);
+  CHECK(follower.Update(vec3{0, 0, 0}, 0.1f) ==
+        PathFollower::Action::Arrived);
+  CHECK(follower.GetSegment() == TestPath().size() - 1);
+  CHECK(follower.GetCrossTrack() == doctest::Approx(0.0f));
+}
+
+TEST_CASE("PathFollower tolerates small deviations")
+{
+  PathFollower follower;
+  follower.SetPath(TestPath());
+
+  // knocked a couple of yards to the side, carry on to the same waypoint
+  CHECK(follower.Update(vec3{5, -2, 0}, 0.1f) ==
+        PathFollower::Action::Follow);
+  CHECK(follower.GetSegment() == 0);
+  CHECK(follower.GetCrossTrack() == doctest::Approx(2.0f));
+
+  // knocked past the corner without touching it, the next segment's ours
+  CHECK(follower.Update(vec3{11, 8, 0}, 0.1f) ==
+        PathFollower::Action::Follow);
+  CHECK(follower.GetSegment() == 1);
+  CHECK(follower.GetCrossTrack() == doctest::Approx(1.0f));
+
+  // never backwards, even when nearer an earlier segment
+  CHECK(follower.Update(vec3{8, 0.5f, 0}, 0.1f) ==
+        PathFollower::Action::Follow);
+  CHECK(follower.GetSegment() == 1);
+
+  // a later segment's only ours at about its height
+  follower.SetPath(TestPath());
+  CHECK(follower.Update(vec3{10.5f, 2, 10}, 0.1f) ==
+        PathFollower::Action::Follow);
+  CHECK(follower.GetSegment() == 0);
+}
+
+TEST_CASE("PathFollower repairs moderate deviations")
+{
+  PathFollower follower;
+  follower.SetPath(TestPath());
+  REQUIRE(follower.Update(vec3{10, 1, 0}, 0.1f) ==
+          PathFollower::Action::Follow);
+
+  // 5 yards off the segment we're on
+  vec3 const pos{15, 10, 0};
+  REQUIRE(follower.Update(pos, 0.1f) == PathFollower::Action::Repair);
+  CHECK(follower.GetSegment() == 1);
+  CHECK(follower.GetCrossTrack() == doctest::Approx(5.0f));
+  // the first point at least rejoin_dist along from {10, 10}
+  CHECK(follower.GetRejoinPoint() == vec3{10, 40, 0});
+
+  // has to end at the rejoin point
+  CHECK(!follower.Repair(PointsArray{pos, {0, 0, 0}}));
+  CHECK(follower.GetPath() == TestPath());
+
+  REQUIRE(follower.Repair(PointsArray{pos, {12, 30, 0}, {10, 40.5f, 0}}));
+  CHECK(follower.GetPath() ==
+        PointsArray{pos, {12, 30, 0}, {10, 40.5f, 0}, {20, 40, 0}});
+  CHECK(follower.GetSegment() == 0);
+  CHECK(follower.Update(pos, 0.1f) == PathFollower::Action::Follow);
+}
+
+TEST_CASE("PathFollower replans far off the path, or when stuck")
+{
+  PathFollower follower;
+  follower.SetPath(TestPath());
+
+  CHECK(follower.Update(vec3{30, 10, 0}, 0.1f) ==
+        PathFollower::Action::Replan);
+
+  // pushing against a wall right on the path
+  follower.SetPath(TestPath());
+  vec3 const wall{10, 15, 0};
+  float waited = 0.0f;
+  PathFollower::Action action;
+  while ((action = follower.Update(wall, 0.25f)) ==
+         PathFollower::Action::Follow) {
+    waited += 0.25f;
+    REQUIRE(waited < 10.0f);
+  }
+  CHECK(action == PathFollower::Action::Replan);
+  CHECK(waited >= follower.stuck_time - 0.5f);
+
+  // and the clock starts again afterwards
+  CHECK(follower.Update(wall, 0.25f) == PathFollower::Action::Follow);
+
+  // slow but steady progress isn't stuck
+  follower.SetPath(TestPath());
+  for (float y = 1.0f; y < 39.0f; y += 0.5f) {
+    REQUIRE(follower.Update(vec3{10, y, 0}, 0.25f) ==
+            PathFollower::Action::Follow);
+  }
+}
+}
+}
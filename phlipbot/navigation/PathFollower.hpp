@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "PathFinder.hpp"
+
+namespace phlipbot
+{
+// Tracks the player along a point path the way dtPathCorridor::movePosition
+// tracks an agent along its corridor: each frame the player's position is
+// projected onto the path, only ever forwards, and small deviations (a
+// knockback, a fear, walking around an obstacle) don't need any new search.
+//
+// Update() says what to do about the player's cross track error, the 2D
+// distance from the player to the path:
+//
+//   up to repair_thresh   Follow, steer towards GetSteerTarget()
+//   up to replan_thresh   Repair, find a short path to GetRejoinPoint() and
+//                         hand it to Repair(), keep following meanwhile
+//   further               Replan the whole path
+//
+// A player that makes no progress along the path for stuck_time seconds,
+// however close to it, is told to Replan too.
+struct PathFollower {
+  enum class Action {
+    None, // no path
+    Follow,
+    Repair,
+    Replan,
+    Arrived,
+  };
+
+  void SetPath(PointsArray path);
+  void Clear();
+
+  // Splice a path from the player to GetRejoinPoint() in front of the rest
+  // of the path. False (and the path untouched) if it doesn't end at the
+  // rejoin point, or the player's already past it.
+  bool Repair(PointsArray const& repair);
+
+  Action Update(vec3 const& pos, float const dt);
+
+  bool HasPath() const { return path.size() >= 2; }
+  PointsArray const& GetPath() const { return path; }
+  // the player is on the segment from path[segment] to path[segment + 1]
+  size_t GetSegment() const { return segment; }
+  vec3 const& GetSteerTarget() const
+  {
+    return path[std::min(segment + 1, path.size() - 1)];
+  }
+  vec3 const& GetRejoinPoint() const { return path[rejoin_idx]; }
+  float GetCrossTrack() const { return cross_track; }
+
+  // a waypoint's reached within these, as in PlayerController::InRange
+  float reach_2d{0.4f};
+  float reach_height{3.0f};
+
+  float repair_thresh{3.0f};
+  float replan_thresh{10.0f};
+  // how far along the path past the player a repair rejoins it
+  float rejoin_dist{15.0f};
+  // how many segments past the current one the player can be projected onto
+  size_t look_ahead{4};
+
+  float stuck_time{4.0f};
+  float stuck_progress{1.0f};
+
+private:
+  void Advance(vec3 const& pos);
+  float Remaining(vec3 const& pos) const;
+  size_t FindRejoinIndex(vec3 const& pos) const;
+
+  PointsArray path;
+  // remaining[i] is the length of the path from path[i] to the end
+  std::vector<float> remaining;
+  size_t segment{0};
+  size_t rejoin_idx{0};
+  float cross_track{0.0f};
+  std::vector<float> distances; // scratch for Advance
+
+  // the least remaining distance so far, and how long since it went down
+  float best_remaining{0.0f};
+  float stalled{0.0f};
+};
+}
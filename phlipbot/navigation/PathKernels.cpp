@@ -0,0 +1,409 @@
+#include "PathKernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <emmintrin.h>
+
+#include <glm/geometric.hpp>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+
+// the kernels read and write vec3 arrays as packed floats
+static_assert(sizeof(phlipbot::vec3) == 3 * sizeof(float),
+              "vec3 isn't 3 packed floats");
+
+namespace
+{
+using phlipbot::vec2;
+using phlipbot::vec3;
+
+// Four packed xyz points from p (12 floats) as x, y and z registers.
+inline void
+LoadPoints4(float const* p, __m128& x, __m128& y, __m128& z)
+{
+  __m128 const a = _mm_loadu_ps(p);     // x0 y0 z0 x1
+  __m128 const b = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+  __m128 const c = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+
+  __m128 const x23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+  x = _mm_shuffle_ps(a, x23, _MM_SHUFFLE(2, 0, 3, 0));
+
+  __m128 const y01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+  __m128 const y23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+  y = _mm_shuffle_ps(y01, y23, _MM_SHUFFLE(2, 0, 2, 0));
+
+  __m128 const z01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+  __m128 const z23 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+  z = _mm_shuffle_ps(z01, z23, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// The inverse of LoadPoints4.
+inline void
+StorePoints4(float* p, __m128 const& x, __m128 const& y, __m128 const& z)
+{
+  __m128 const a0 = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0));
+  __m128 const a1 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));
+  _mm_storeu_ps(p, _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)));
+
+  __m128 const b0 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));
+  __m128 const b1 = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2));
+  _mm_storeu_ps(p + 4, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+
+  __m128 const c0 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2));
+  __m128 const c1 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));
+  _mm_storeu_ps(p + 8, _mm_shuffle_ps(c0, c1, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+inline float HorizontalSum(__m128 const& v)
+{
+  __m128 const hi = _mm_movehl_ps(v, v);
+  __m128 const sum2 = _mm_add_ps(v, hi);
+  __m128 const sum1 =
+    _mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, _MM_SHUFFLE(1, 1, 1, 1)));
+  return _mm_cvtss_f32(sum1);
+}
+
+float SegmentDistance2D(vec2 const& a, vec2 const& b, vec2 const& pos)
+{
+  vec2 const d = b - a;
+  float const len_sqr = glm::dot(d, d);
+  float t = len_sqr > 0.0f ? glm::dot(pos - a, d) / len_sqr : 0.0f;
+  t = std::min(std::max(t, 0.0f), 1.0f);
+  return glm::distance(pos, a + d * t);
+}
+
+bool InRange(vec3 const& point, vec3 const& pos, float const r, float const h)
+{
+  vec2 const d = point.xy - pos.xy;
+  return glm::dot(d, d) <= r * r && std::abs(point.z - pos.z) <= h;
+}
+
+// The one point at a time versions, for the tails, the tests and the
+// benchmarks.
+namespace scalar
+{
+float PathLength(vec3 const* points, size_t const count)
+{
+  float length = 0.0f;
+  for (size_t i = 1; i < count; ++i) {
+    length += glm::distance(points[i - 1], points[i]);
+  }
+  return length;
+}
+
+void SwizzleYZXToXYZ(float const* yzx, vec3* xyz, size_t const count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    xyz[i] = vec3{yzx[i * 3 + 2], yzx[i * 3 + 0], yzx[i * 3 + 1]};
+  }
+}
+
+void SegmentDistances2D(vec3 const* points,
+                        size_t const count,
+                        vec2 const& pos,
+                        float* distances)
+{
+  for (size_t i = 1; i < count; ++i) {
+    distances[i - 1] = SegmentDistance2D(points[i - 1].xy, points[i].xy, pos);
+  }
+}
+
+size_t FirstOutOfRange(vec3 const* points,
+                       size_t const count,
+                       vec3 const& pos,
+                       float const r,
+                       float const h)
+{
+  for (size_t i = 0; i < count; ++i) {
+    if (!InRange(points[i], pos, r, h)) {
+      return i;
+    }
+  }
+  return count;
+}
+}
+}
+
+namespace phlipbot
+{
+float PathLength(vec3 const* points, size_t const count)
+{
+  if (count < 2) {
+    return 0.0f;
+  }
+
+  float const* p = reinterpret_cast<float const*>(points);
+  __m128 sum = _mm_setzero_ps();
+
+  // segments i .. i + 3 end at points i + 1 .. i + 4
+  size_t i = 0;
+  for (; i + 5 <= count; i += 4) {
+    __m128 ax, ay, az, bx, by, bz;
+    LoadPoints4(p + i * 3, ax, ay, az);
+    LoadPoints4(p + i * 3 + 3, bx, by, bz);
+
+    __m128 const dx = _mm_sub_ps(bx, ax);
+    __m128 const dy = _mm_sub_ps(by, ay);
+    __m128 const dz = _mm_sub_ps(bz, az);
+    __m128 const len_sqr = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    sum = _mm_add_ps(sum, _mm_sqrt_ps(len_sqr));
+  }
+
+  return HorizontalSum(sum) + scalar::PathLength(points + i, count - i);
+}
+
+void SwizzleYZXToXYZ(float const* yzx, vec3* xyz, size_t const count)
+{
+  float* out = reinterpret_cast<float*>(xyz);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 y, z, x;
+    LoadPoints4(yzx + i * 3, y, z, x);
+    StorePoints4(out + i * 3, x, y, z);
+  }
+
+  scalar::SwizzleYZXToXYZ(yzx + i * 3, xyz + i, count - i);
+}
+
+void SegmentDistances2D(vec3 const* points,
+                        size_t const count,
+                        vec2 const& pos,
+                        float* distances)
+{
+  if (count < 2) {
+    return;
+  }
+
+  float const* p = reinterpret_cast<float const*>(points);
+  __m128 const px = _mm_set1_ps(pos.x);
+  __m128 const py = _mm_set1_ps(pos.y);
+  __m128 const zero = _mm_setzero_ps();
+  __m128 const one = _mm_set1_ps(1.0f);
+
+  size_t i = 0;
+  for (; i + 5 <= count; i += 4) {
+    __m128 ax, ay, az, bx, by, bz;
+    LoadPoints4(p + i * 3, ax, ay, az);
+    LoadPoints4(p + i * 3 + 3, bx, by, bz);
+
+    // t = clamp(dot(pos - a, b - a) / |b - a|^2, 0, 1), 0 for a point
+    __m128 const dx = _mm_sub_ps(bx, ax);
+    __m128 const dy = _mm_sub_ps(by, ay);
+    __m128 const ex = _mm_sub_ps(px, ax);
+    __m128 const ey = _mm_sub_ps(py, ay);
+    __m128 const len_sqr = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    __m128 const proj = _mm_add_ps(_mm_mul_ps(ex, dx), _mm_mul_ps(ey, dy));
+    __m128 const nonzero = _mm_cmpgt_ps(len_sqr, zero);
+    __m128 t = _mm_and_ps(nonzero, _mm_div_ps(proj, len_sqr));
+    t = _mm_min_ps(_mm_max_ps(t, zero), one);
+
+    __m128 const cx = _mm_sub_ps(ex, _mm_mul_ps(dx, t));
+    __m128 const cy = _mm_sub_ps(ey, _mm_mul_ps(dy, t));
+    __m128 const dist_sqr =
+      _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy));
+    _mm_storeu_ps(distances + i, _mm_sqrt_ps(dist_sqr));
+  }
+
+  scalar::SegmentDistances2D(points + i, count - i, pos, distances + i);
+}
+
+size_t FirstOutOfRange(vec3 const* points,
+                       size_t const count,
+                       vec3 const& pos,
+                       float const r,
+                       float const h)
+{
+  float const* p = reinterpret_cast<float const*>(points);
+  __m128 const px = _mm_set1_ps(pos.x);
+  __m128 const py = _mm_set1_ps(pos.y);
+  __m128 const pz = _mm_set1_ps(pos.z);
+  __m128 const r_sqr = _mm_set1_ps(r * r);
+  __m128 const hv = _mm_set1_ps(h);
+  __m128 const abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x, y, z;
+    LoadPoints4(p + i * 3, x, y, z);
+
+    __m128 const dx = _mm_sub_ps(x, px);
+    __m128 const dy = _mm_sub_ps(y, py);
+    __m128 const dz = _mm_and_ps(_mm_sub_ps(z, pz), abs_mask);
+    __m128 const dist_sqr = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    __m128 const in_range =
+      _mm_and_ps(_mm_cmple_ps(dist_sqr, r_sqr), _mm_cmple_ps(dz, hv));
+
+    int const mask = _mm_movemask_ps(in_range);
+    if (mask != 0xf) {
+      // lowest clear bit
+      int lane = 0;
+      while (mask & (1 << lane)) {
+        ++lane;
+      }
+      return i + size_t(lane);
+    }
+  }
+
+  return i + scalar::FirstOutOfRange(points + i, count - i, pos, r, h);
+}
+
+namespace test
+{
+namespace
+{
+std::vector<vec3> RandomPath(size_t const count, uint32_t const seed)
+{
+  std::mt19937 rng{seed};
+  std::uniform_real_distribution<float> step{-3.0f, 3.0f};
+  std::vector<vec3> path(count);
+  vec3 pos{100.0f, -200.0f, 50.0f};
+  for (auto& point : path) {
+    pos += vec3{step(rng), step(rng), step(rng) / 3.0f};
+    point = pos;
+  }
+  return path;
+}
+
+// every count around the 4 wide blocks and their tails
+size_t const TestCounts[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 17, 64, 1023};
+}
+
+TEST_CASE("path kernels match the scalar versions")
+{
+  for (size_t const count : TestCounts) {
+    CAPTURE(count);
+    std::vector<vec3> const path = RandomPath(count, uint32_t(count));
+    vec3 const* points = path.data();
+
+    CHECK(PathLength(points, count) ==
+          doctest::Approx(scalar::PathLength(points, count)).epsilon(1e-4));
+
+    // yzx as Detour has them
+    std::vector<float> yzx;
+    for (auto const& point : path) {
+      yzx.insert(yzx.end(), {point.y, point.z, point.x});
+    }
+    std::vector<vec3> xyz(count, vec3{0.0f, 0.0f, 0.0f});
+    SwizzleYZXToXYZ(yzx.data(), xyz.data(), count);
+    CHECK(xyz == path);
+
+    vec2 const pos = count ? path[count / 2].xy + vec2{1.0f, -0.5f}
+                           : vec2{0.0f, 0.0f};
+    size_t const segments = count ? count - 1 : 0;
+    std::vector<float> distances(segments, -1.0f);
+    std::vector<float> expected(segments, -1.0f);
+    SegmentDistances2D(points, count, pos, distances.data());
+    scalar::SegmentDistances2D(points, count, pos, expected.data());
+    for (size_t i = 0; i < segments; ++i) {
+      CHECK(distances[i] == doctest::Approx(expected[i]).epsilon(1e-4));
+    }
+
+    // everything's in range from far enough away, then the first point a
+    // tight range misses
+    if (count) {
+      vec3 const& center = path[0];
+      CHECK(FirstOutOfRange(points, count, center, 1e6f, 1e6f) == count);
+      for (float const r : {0.5f, 4.0f, 9.0f}) {
+        CHECK(FirstOutOfRange(points, count, center, r, 1.0f) ==
+              scalar::FirstOutOfRange(points, count, center, r, 1.0f));
+      }
+    }
+  }
+}
+
+TEST_CASE("path kernels on a known path")
+{
+  std::vector<vec3> const path{
+    {0, 0, 0}, {3, 4, 0}, {3, 4, 0}, {3, 8, 3}, {0, 8, 3}, {0, 0, 3}};
+
+  CHECK(PathLength(path.data(), path.size()) == doctest::Approx(21.0f));
+
+  // the repeated point is a zero length segment
+  std::vector<float> distances(path.size() - 1);
+  SegmentDistances2D(path.data(), path.size(), vec2{1, 8}, distances.data());
+  CHECK(distances[0] == doctest::Approx(std::sqrt(20.0f)));
+  CHECK(distances[1] == doctest::Approx(std::sqrt(20.0f)));
+  CHECK(distances[2] == doctest::Approx(2.0f));
+  CHECK(distances[3] == doctest::Approx(0.0f));
+  CHECK(distances[4] == doctest::Approx(1.0f));
+
+  // the range is inclusive, and the height counts
+  CHECK(FirstOutOfRange(path.data(), path.size(), vec3{0, 0, 0}, 5, 1) == 3);
+  CHECK(FirstOutOfRange(path.data(), path.size(), vec3{0, 0, 0}, 4.9f, 1) ==
+        1);
+  CHECK(FirstOutOfRange(path.data(), 0, vec3{0, 0, 0}, 5, 1) == 0);
+}
+
+TEST_CASE("benchmark path kernels, SSE2 vs scalar" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  // MAX_POINT_PATH_LENGTH points
+  size_t const count = 256;
+  size_t const long_count = 4096;
+  uint32_t const iters = 100000;
+
+  for (size_t const n : {count, long_count}) {
+    std::vector<vec3> const path = RandomPath(n, 42);
+    std::vector<float> yzx(n * 3);
+    std::vector<vec3> xyz(n);
+    std::vector<float> distances(n);
+    vec3 const far{1e6f, 1e6f, 0.0f};
+    auto const report = [n](char const* name, double const us) {
+      std::string const label =
+        std::string{name} + " " + std::to_string(n) + " points";
+      bench::Report(label.c_str(), us);
+    };
+
+    double us = bench::TimeMicros(iters, [&]() {
+      bench::DoNotOptimize(PathLength(path.data(), n));
+    });
+    report("PathLength", us);
+    us = bench::TimeMicros(iters, [&]() {
+      bench::DoNotOptimize(scalar::PathLength(path.data(), n));
+    });
+    report("scalar PathLength", us);
+
+    us = bench::TimeMicros(iters, [&]() {
+      SwizzleYZXToXYZ(yzx.data(), xyz.data(), n);
+      bench::DoNotOptimize(xyz[0]);
+    });
+    report("SwizzleYZXToXYZ", us);
+    us = bench::TimeMicros(iters, [&]() {
+      scalar::SwizzleYZXToXYZ(yzx.data(), xyz.data(), n);
+      bench::DoNotOptimize(xyz[0]);
+    });
+    report("scalar SwizzleYZXToXYZ", us);
+
+    us = bench::TimeMicros(iters, [&]() {
+      SegmentDistances2D(path.data(), n, far.xy, distances.data());
+      bench::DoNotOptimize(distances[0]);
+    });
+    report("SegmentDistances2D", us);
+    us = bench::TimeMicros(iters, [&]() {
+      scalar::SegmentDistances2D(path.data(), n, far.xy, distances.data());
+      bench::DoNotOptimize(distances[0]);
+    });
+    report("scalar SegmentDistances2D", us);
+
+    // all in range, the worst case
+    us = bench::TimeMicros(iters, [&]() {
+      bench::DoNotOptimize(FirstOutOfRange(path.data(), n, far, 1e7f, 1e7f));
+    });
+    report("FirstOutOfRange", us);
+    us = bench::TimeMicros(iters, [&]() {
+      bench::DoNotOptimize(
+        scalar::FirstOutOfRange(path.data(), n, far, 1e7f, 1e7f));
+    });
+    report("scalar FirstOutOfRange", us);
+  }
+}
+}
+}
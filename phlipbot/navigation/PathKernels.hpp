@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "../wow_constants.hpp"
+
+// SSE2 kernels for the loops that run over every point of a path. SSE2 is
+// the baseline for the 32-bit DLL, so there's no runtime dispatch. Points are
+// packed xyz (or yzx) floats, 4 of them are transposed into x, y and z
+// registers at a time, and the last count % 4 are done one at a time.
+
+namespace phlipbot
+{
+// Sum of the lengths of the segments between count points.
+float PathLength(vec3 const* points, size_t const count);
+
+// Detour's {y, z, x} points to our {x, y, z}. yzx has 3 * count floats.
+void SwizzleYZXToXYZ(float const* yzx, vec3* xyz, size_t const count);
+
+// 2D distance from pos to each of the count - 1 segments between points,
+// the i'th into distances[i].
+void SegmentDistances2D(vec3 const* points,
+                        size_t const count,
+                        vec2 const& pos,
+                        float* distances);
+
+// Index of the first point further than r yards from pos in 2D, or further
+// than h yards above or below it. count if they're all in range.
+size_t FirstOutOfRange(vec3 const* points,
+                       size_t const count,
+                       vec3 const& pos,
+                       float const r,
+                       float const h);
+}
@@ -0,0 +1,222 @@
+#include "PathQueryLog.hpp"
+
+#include <hadesmem/error.hpp>
+
+#include <doctest.h>
+
+#include "MoveMap.hpp"
+
+namespace fs = std::filesystem;
+
+using std::lock_guard;
+using std::mutex;
+
+namespace
+{
+uint32_t const PATH_QUERY_LOG_MAGIC = 0x50514c47; // 'PQLG'
+uint32_t const PATH_QUERY_LOG_VERSION = 1;
+
+struct PathQueryLogHeader {
+  uint32_t magic;
+  uint32_t version;
+};
+
+// on disk layout of a PathQuery, independent of vec3's padding
+struct PathQueryRecord {
+  uint32_t map_id;
+  float src[3];
+  float dest[3];
+  uint32_t flags;
+};
+static_assert(sizeof(PathQueryRecord) == 32,
+              "PathQueryRecord should have no padding");
+
+void ReadHeader(std::ifstream& in, fs::path const& path)
+{
+  PathQueryLogHeader header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Failed to read path query log header"}
+      << phlipbot::ErrorFile{path});
+  }
+
+  if (header.magic != PATH_QUERY_LOG_MAGIC) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Path query log has the wrong magic"}
+      << phlipbot::ErrorHeaderMagic{header.magic}
+      << phlipbot::ErrorFile{path});
+  }
+
+  if (header.version != PATH_QUERY_LOG_VERSION) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Path query log has the wrong version"}
+      << phlipbot::ErrorHeaderVersion{header.version}
+      << phlipbot::ErrorFile{path});
+  }
+}
+}
+
+namespace phlipbot
+{
+PathQueryRecorder::PathQueryRecorder(fs::path const& path) { Open(path); }
+
+void PathQueryRecorder::Open(fs::path const& path)
+{
+  lock_guard<mutex> guard{lock};
+
+  if (out.is_open()) {
+    out.close();
+  }
+  count = 0;
+
+  // appending to an older log, make sure it's one we can add to
+  bool const is_new = !fs::exists(path) || fs::file_size(path) == 0;
+  if (!is_new) {
+    std::ifstream in{path, std::ios::binary};
+    ReadHeader(in, path);
+  }
+
+  out.open(path, std::ios::binary | std::ios::app);
+  if (!out) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Failed to open path query log"}
+      << ErrorFile{path});
+  }
+
+  if (is_new) {
+    PathQueryLogHeader const header{PATH_QUERY_LOG_MAGIC,
+                                    PATH_QUERY_LOG_VERSION};
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  }
+}
+
+void PathQueryRecorder::Close()
+{
+  lock_guard<mutex> guard{lock};
+  out.close();
+}
+
+bool PathQueryRecorder::IsOpen() const
+{
+  lock_guard<mutex> guard{lock};
+  return out.is_open();
+}
+
+void PathQueryRecorder::Record(PathQuery const& query)
+{
+  PathQueryRecord const record{
+    query.map_id,
+    {query.src.x, query.src.y, query.src.z},
+    {query.dest.x, query.dest.y, query.dest.z},
+    query.flags};
+
+  lock_guard<mutex> guard{lock};
+  if (!out.is_open()) {
+    return;
+  }
+
+  // flush every record, we'll usually be unloaded rather than shut down
+  out.write(reinterpret_cast<char const*>(&record), sizeof(record));
+  out.flush();
+  ++count;
+}
+
+uint32_t PathQueryRecorder::GetCount() const
+{
+  lock_guard<mutex> guard{lock};
+  return count;
+}
+
+std::vector<PathQuery> LoadPathQueries(fs::path const& path)
+{
+  std::ifstream in{path, std::ios::binary};
+  if (!in) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Failed to open path query log"}
+      << ErrorFile{path});
+  }
+
+  ReadHeader(in, path);
+
+  std::vector<PathQuery> queries;
+  PathQueryRecord record;
+  // a torn last record (we were unloaded mid write) is ignored
+  while (in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+    queries.push_back(
+      PathQuery{record.map_id,
+                vec3{record.src[0], record.src[1], record.src[2]},
+                vec3{record.dest[0], record.dest[1], record.dest[2]},
+                record.flags});
+  }
+
+  return queries;
+}
+
+namespace test
+{
+TEST_CASE("PathQueryRecorder round trips through LoadPathQueries")
+{
+  fs::path const path =
+    fs::temp_directory_path() / "phlipbot_path_queries_test.bin";
+  fs::remove(path);
+
+  PathQuery const first{0, vec3{-8949.95f, -132.493f, 83.5312f},
+                        vec3{-9046.507f, -45.71962f, 88.33186f},
+                        PathQueryFlags::StraightPath};
+  PathQuery const second{1, vec3{1.0f, 2.0f, 3.0f}, vec3{4.0f, 5.0f, 6.0f},
+                         PathQueryFlags::ForceDest};
+
+  {
+    PathQueryRecorder recorder{path};
+    recorder.Record(first);
+    CHECK(recorder.GetCount() == 1);
+  }
+
+  // reopening appends
+  {
+    PathQueryRecorder recorder{path};
+    recorder.Record(second);
+    CHECK(recorder.GetCount() == 1);
+    recorder.Close();
+
+    // dropped, we're closed
+    recorder.Record(second);
+  }
+
+  auto const queries = LoadPathQueries(path);
+  REQUIRE(queries.size() == 2);
+
+  CHECK(queries[0].map_id == first.map_id);
+  CHECK(queries[0].src == first.src);
+  CHECK(queries[0].dest == first.dest);
+  CHECK(queries[0].flags == first.flags);
+
+  CHECK(queries[1].map_id == second.map_id);
+  CHECK(queries[1].src == second.src);
+  CHECK(queries[1].dest == second.dest);
+  CHECK(queries[1].flags == second.flags);
+
+  fs::remove(path);
+}
+
+TEST_CASE("LoadPathQueries rejects files that aren't path query logs")
+{
+  fs::path const path =
+    fs::temp_directory_path() / "phlipbot_path_queries_bad.bin";
+  {
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out << "definitely not a path query log";
+  }
+
+  CHECK_THROWS_AS(LoadPathQueries(path), hadesmem::Error);
+  CHECK_THROWS_AS(PathQueryRecorder{path}, hadesmem::Error);
+
+  fs::remove(path);
+}
+}
+}
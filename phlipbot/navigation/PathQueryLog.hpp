@@ -0,0 +1,55 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include "../wow_constants.hpp"
+
+namespace phlipbot
+{
+namespace PathQueryFlags
+{
+uint32_t const ForceDest = 0x1; // calculate() was asked to force dest
+uint32_t const StraightPath = 0x2; // straight instead of smooth path
+}
+
+// A single PathFinder::calculate call, everything needed to replay it.
+struct PathQuery {
+  uint32_t map_id;
+  vec3 src;
+  vec3 dest;
+  uint32_t flags; // PathQueryFlags
+};
+
+// Appends PathQuery's to a compact binary file, so real traffic can be
+// replayed later (see ReplayPathQueries). Recording to an existing file adds
+// to it.
+//
+// Thread safe. Record does nothing while the recorder isn't open.
+struct PathQueryRecorder {
+  PathQueryRecorder() = default;
+  explicit PathQueryRecorder(std::filesystem::path const& path);
+  PathQueryRecorder(PathQueryRecorder const&) = delete;
+  PathQueryRecorder& operator=(PathQueryRecorder const&) = delete;
+
+  void Open(std::filesystem::path const& path);
+  void Close();
+  bool IsOpen() const;
+
+  void Record(PathQuery const& query);
+
+  // queries recorded since the last Open
+  uint32_t GetCount() const;
+
+private:
+  mutable std::mutex lock;
+  std::ofstream out;
+  uint32_t count{0};
+};
+
+// Read back every query in a file written by PathQueryRecorder.
+std::vector<PathQuery> LoadPathQueries(std::filesystem::path const& path);
+}
@@ -0,0 +1,152 @@
+#include "PathQueryReplay.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <hadesmem/detail/trace.hpp>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+#include "PathFinder.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+char const* const PathFlagNames[] = {
+  "",
+  "BLANK",
+  "NORMAL",
+  "SHORTCUT",
+  "INCOMPLETE",
+  "NOPATH",
+  "NOT_USING_PATH",
+  "DEST_FORCED",
+  "FLYPATH",
+  "UNDERWATER",
+};
+}
+
+namespace phlipbot
+{
+PathReplayStats ReplayPathQueries(MMapManager& mmap,
+                                  std::vector<PathQuery> const& queries,
+                                  bool const use_straight_path)
+{
+  PathReplayStats stats;
+  stats.latencies_us.reserve(queries.size());
+  stats.expansions.reserve(queries.size());
+  stats.lengths.reserve(queries.size());
+
+  PathFinder path_info{mmap, 0};
+  path_info.setUseStrightPath(use_straight_path);
+
+  for (auto const& query : queries) {
+    if (!mmap.loadMapAround(query.map_id, query.src.xy)) {
+      ++stats.skipped;
+      continue;
+    }
+
+    path_info.reset(query.map_id);
+    bool const force_dest = (query.flags & PathQueryFlags::ForceDest) != 0;
+
+    auto const start = bench::clock::now();
+    path_info.calculate(query.src, query.dest, force_dest);
+    auto const elapsed = bench::clock::now() - start;
+
+    stats.latencies_us.push_back(
+      std::chrono::duration<double, std::micro>{elapsed}.count());
+    stats.expansions.push_back(path_info.getSearchExpansions());
+
+    auto const type = path_info.getPathType();
+    for (size_t flag = 0; flag < type.size(); ++flag) {
+      stats.type_counts[flag] += type.test(flag) ? 1 : 0;
+    }
+    if (path_info.getPath().size() >= 2) {
+      stats.lengths.push_back(path_info.Length());
+    }
+  }
+
+  return stats;
+}
+
+void ReportPathReplay(char const* name, PathReplayStats const& stats)
+{
+  using bench::Percentile;
+
+  std::printf("[bench] %s: %zu queries, %u skipped\n", name,
+              stats.latencies_us.size(), stats.skipped);
+  std::printf("[bench]   latency us    p50 %10.3f p95 %10.3f p99 %10.3f\n",
+              Percentile(stats.latencies_us, 50),
+              Percentile(stats.latencies_us, 95),
+              Percentile(stats.latencies_us, 99));
+  std::printf("[bench]   expansions    p50 %10u p95 %10u p99 %10u\n",
+              Percentile(stats.expansions, 50),
+              Percentile(stats.expansions, 95),
+              Percentile(stats.expansions, 99));
+  std::printf("[bench]   length yds    p50 %10.1f p95 %10.1f p99 %10.1f\n",
+              Percentile(stats.lengths, 50), Percentile(stats.lengths, 95),
+              Percentile(stats.lengths, 99));
+  for (size_t flag = 1; flag < stats.type_counts.size(); ++flag) {
+    if (stats.type_counts[flag]) {
+      std::printf("[bench]   PATHFIND_%-16s %u\n", PathFlagNames[flag],
+                  stats.type_counts[flag]);
+    }
+  }
+
+  HADESMEM_DETAIL_TRACE_FORMAT_A(
+    "[bench] %s: %zu queries, latency p50 %.3f p95 %.3f p99 %.3f us", name,
+    stats.latencies_us.size(), Percentile(stats.latencies_us, 50),
+    Percentile(stats.latencies_us, 95), Percentile(stats.latencies_us, 99));
+}
+
+namespace test
+{
+TEST_CASE("ReplayPathQueries replays every query it can load")
+{
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+
+  vec3 const start{-8949.95f, -132.493f, 83.5312f};
+  vec3 const end{-9046.507f, -45.71962f, 88.33186f};
+  std::vector<PathQuery> const queries{
+    PathQuery{0, start, end, 0},
+    PathQuery{0, end, start, PathQueryFlags::StraightPath},
+    // in the corner of the map, where there aren't any tiles
+    PathQuery{0, vec3{17000.0f, 17000.0f, 0.0f}, end, 0},
+  };
+
+  auto const stats = ReplayPathQueries(mmap, queries, false);
+  CHECK(stats.skipped == 1);
+  REQUIRE(stats.latencies_us.size() == 2);
+  CHECK(stats.expansions.size() == 2);
+  CHECK(stats.lengths.size() == 2);
+  CHECK(stats.type_counts[PathFlag::PATHFIND_NORMAL] == 2);
+  CHECK(stats.expansions[0] > 0);
+}
+
+// Record a corpus in game with the "Record Path Queries" checkbox, then point
+// PHLIPBOT_PATH_QUERIES at it (or leave it in the default location).
+TEST_CASE("benchmark replay recorded path queries, straight vs smooth" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  char const* const env_path = std::getenv("PHLIPBOT_PATH_QUERIES");
+  fs::path const corpus_path =
+    env_path ? env_path : "C:\\MaNGOS\\data\\path_queries.bin";
+  REQUIRE(fs::exists(corpus_path));
+
+  auto const queries = LoadPathQueries(corpus_path);
+  REQUIRE(!queries.empty());
+
+  MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+
+  // once untimed, so every tile the corpus touches is loaded and both modes
+  // see the same warm caches
+  ReplayPathQueries(mmap, queries, false);
+
+  ReportPathReplay("replay straight", ReplayPathQueries(mmap, queries, true));
+  ReportPathReplay("replay smooth", ReplayPathQueries(mmap, queries, false));
+}
+}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+#include "MoveMap.hpp"
+#include "PathQueryLog.hpp"
+
+namespace phlipbot
+{
+// What replaying a corpus of recorded queries through one PathFinder cost.
+struct PathReplayStats {
+  std::vector<double> latencies_us; // calculate() wall time, per query
+  std::vector<uint32_t> expansions; // search nodes expanded, per query
+  std::vector<float> lengths; // path length, per query that found a path
+  std::array<uint32_t, 10> type_counts{}; // queries with each PathFlag set
+  uint32_t skipped{0}; // queries whose tiles couldn't be loaded
+};
+
+// Run every query through PathFinder::calculate, in straight or smooth mode
+// regardless of the mode it was recorded in. Tiles are loaded outside the
+// timed region, so latencies are only the path search itself.
+PathReplayStats ReplayPathQueries(MMapManager& mmap,
+                                  std::vector<PathQuery> const& queries,
+                                  bool const use_straight_path);
+
+// Print p50/p95/p99 latency, expansions and path length, and the PathFlag
+// distribution.
+void ReportPathReplay(char const* name, PathReplayStats const& stats);
+}
@@ -1,40 +1,102 @@
 #include "PlayerNavigator.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <inttypes.h>
 
 #include <glm/geometric.hpp>
 
 #include <hadesmem/detail/trace.hpp>
 
-using boost::none;
-
+using glm::distance;
 using glm::length;
 
+using std::lock_guard;
+using std::mutex;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
 // TODO(phlip9): eventually update a pre-existing path if the destination
 //               doesn't change too much
 // TODO(phlip9): check if a tile is in-bounds before trying to load it
-// TODO(phlip9): for now, assume destination is close, but we will eventually
-//               have to load more intelligently
 
 
 namespace phlipbot
 {
+PlayerNavigator::PlayerNavigator(ObjectManager& objmgr,
+                                 PlayerController& player_controller,
+                                 MMapManager& mmap_mgr) noexcept
+  : objmgr(objmgr),
+    player_controller(player_controller),
+    mmap_mgr(mmap_mgr),
+    nav_worker(mmap_mgr),
+    walk_cache(objmgr, nav_worker),
+    unit_tracker(objmgr)
+{
+  follower.reach_2d = player_controller.range_thresh_2d;
+  follower.reach_height = player_controller.range_thresh_height;
+
+  tile_unload_listener = mmap_mgr.addTileUnloadListener(
+    [this](uint32_t map_id, vec2i const& tile, uint32_t generation) {
+      lock_guard<mutex> lock{tile_unloads_lock};
+      tile_unloads.push_back(TileUnload{map_id, tile, generation});
+    });
+}
+
+PlayerNavigator::~PlayerNavigator()
+{
+  mmap_mgr.removeTileUnloadListener(tile_unload_listener);
+}
+
 void PlayerNavigator::SetDestination(vec3 const dest)
 {
   update_path = true;
-  path_info = none;
-  path_idx = 0;
+
+  // the old path is no use to us anymore, don't wait for it
+  nav_worker.Cancel();
+  path_request = {};
+  repair_request = {};
+  path_result = PathResult{};
+  follower.Clear();
   destination = dest;
 }
 
+void PlayerNavigator::SetChaseTarget(Guid const guid)
+{
+  ClearChaseTarget();
+  chase_target = guid;
+  unit_tracker.Track(guid);
+}
+
+void PlayerNavigator::ClearChaseTarget()
+{
+  if (chase_target != 0) {
+    unit_tracker.Untrack(chase_target);
+    chase_target = 0;
+  }
+}
+
+void PlayerNavigator::SetFormation(FormationRole const role,
+                                   FormationPathStore* store,
+                                   vec2 const& offset)
+{
+  formation_role = store ? role : FormationRole::None;
+  formation_store = store;
+  formation_offset = offset;
+  formation_sequence = 0;
+}
+
 void PlayerNavigator::SetEnabled(bool val)
 {
   enabled = val;
   player_controller.SetEnabled(val);
 }
 
-void PlayerNavigator::Update()
+void PlayerNavigator::Update(float const dt)
 {
+  walk_cache.Update();
+  unit_tracker.Update(dt);
+
   if (!enabled) {
     return;
   }
@@ -47,60 +109,261 @@ void PlayerNavigator::Update()
   auto const* player = oplayer.get();
   auto const player_pos = player->GetPosition();
 
+  auto const start = steady_clock::now();
+  if (chase_target != 0) {
+    Chase(*player);
+  }
+  if (formation_role == FormationRole::Follower) {
+    FollowFormation(player_pos);
+  }
+  PathFollower::Action const action = Navigate(player_pos, dt);
+  auto const tick_time = steady_clock::now() - start;
+
+  if (follower.HasPath() && telemetry_enabled) {
+    NavSample sample{};
+    sample.position = player_pos;
+    sample.target = follower.GetSteerTarget();
+    sample.cross_track = follower.GetCrossTrack();
+    sample.facing_error = player_controller.last_facing_error;
+    sample.facing_output = player_controller.last_facing_output;
+    sample.tick_us = duration<float, std::micro>{tick_time}.count();
+    sample.segment = static_cast<uint32_t>(follower.GetSegment());
+    sample.action = static_cast<uint32_t>(action);
+    telemetry.Push(sample);
+  }
+}
+
+PathFollower::Action PlayerNavigator::Navigate(vec3 const& player_pos,
+                                              float const dt)
+{
   if (update_path) {
-    auto const map_id = objmgr.GetMapId();
-    vec2i const tile = mmap_mgr.tileFromPos(player_pos.xy);
-
-    // load the tiles around the player
-    bool any_success = false;
-    for (int i = -1; i <= 1; ++i) {
-      for (int j = -1; j <= 1; ++j) {
-        vec2i const offset{i, j};
-        any_success |= mmap_mgr.loadMap(map_id, tile + offset);
-      }
-    }
+    path_request =
+      nav_worker.CalculateAsync(objmgr.GetMapId(), player_pos, destination);
+    update_path = false;
+
+    // a repair of the old path is no use once the new one's here
+    repair_request = {};
+  }
+
+  // pick up the path once the worker's done with it
+  if (path_request.valid() &&
+      path_request.wait_for(std::chrono::seconds{0}) ==
+        std::future_status::ready) {
+    path_result = path_request.get();
+    follower.Clear();
 
-    if (!any_success) {
+    if (!path_result.type.test(PathFlag::PATHFIND_NORMAL)) {
       HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "Failed to load any tiles around tile {%d, %d}", tile.x, tile.y);
-      return;
+        "nav_worker.CalculateAsync failed, path_result.type = %s",
+        path_result.type.to_string().c_str());
+
+      // try again next frame
+      update_path = true;
+      return PathFollower::Action::None;
+    }
+
+    follower.SetPath(path_result.path);
+    SendPath();
+
+    if (formation_role == FormationRole::Leader) {
+      formation_store->Publish(FormationPath{0, path_result.map_id,
+                                             destination, path_result.path});
     }
+  }
+
+  PickUpRepair();
+
+  // a newer path is on its way, it'll be checked once it's here
+  if (!path_request.valid()) {
+    CheckTileUnloads();
+  }
+
+  if (!follower.HasPath()) {
+    return PathFollower::Action::None;
+  }
 
-    // calculate the path
-    path_info.emplace(mmap_mgr, map_id);
-    bool res = path_info->calculate(player_pos, destination);
-    auto type = path_info->getPathType();
-    if (!res || !type.test(PathFlag::PATHFIND_NORMAL)) {
+  size_t const prev_segment = follower.GetSegment();
+  PathFollower::Action const action = follower.Update(player_pos, dt);
+  switch (action) {
+  case PathFollower::Action::Repair:
+    // keep heading for the next waypoint while the worker finds a way back
+    if (!repair_request.valid() && !path_request.valid()) {
+      repair_request = nav_worker.CalculateAsync(
+        path_result.map_id, player_pos, follower.GetRejoinPoint());
+    }
+    break;
+  case PathFollower::Action::Replan:
+    if (!path_request.valid()) {
       HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "path_info->calculate failed, path_info->GetPathType() = %s",
-        path_info->getPathType().to_string().c_str());
-      return;
+        "%.1f yards off the path, or stuck, replanning",
+        follower.GetCrossTrack());
+      ++replans;
+      update_path = true;
     }
+    return action;
+  case PathFollower::Action::Arrived:
+    // done with it, there's nothing left to follow or record
+    follower.Clear();
+    return action;
+  case PathFollower::Action::None:
+    return action;
+  case PathFollower::Action::Follow:
+    break;
+  }
 
-    update_path = false;
+  // set the player controller's position objective
+  auto const& next_pos = follower.GetSteerTarget();
+  if (pursuit) {
+    player_controller.SetPathSegment(follower.GetSegment());
+  } else {
+    player_controller.SetPosition(next_pos);
+    player_controller.SetFacing(next_pos);
+  }
+  if (follower.GetSegment() != prev_segment) {
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Moving to next waypoint {%.03f, %.03f %0.3f}", next_pos.x, next_pos.y,
+      next_pos.z);
   }
+  return action;
+}
 
-  // move towards the next waypoint
-  if (path_info.has_value() &&
-      path_info->getPathType().test(PathFlag::PATHFIND_NORMAL)) {
-    auto const& path = path_info->getPath();
-    uint32_t const prev_path_idx = path_idx;
+void PlayerNavigator::Chase(WowPlayer const& player)
+{
+  auto const latest = unit_tracker.GetLatest(chase_target);
+  if (!latest.has_value()) {
+    // out of sight, keep going to where we last thought it'd be
+    return;
+  }
 
-    // walk the path_idx forward until we hit the next position we need to reach
-    while (path_idx < path.size() &&
-           player_controller.InRange(player_pos, path[path_idx])) {
-      path_idx += 1;
+  vec3 const player_pos = player.GetPosition();
+  vec3 const aim = predict_intercept
+                     ? *unit_tracker.PredictIntercept(
+                         chase_target, player_pos,
+                         player.GetMovement()->run_speed)
+                     : latest->position;
+
+  // a path's on its way, or should be
+  if (update_path || path_request.valid()) {
+    return;
+  }
+  if (follower.HasPath()) {
+    float const drift = distance(aim, destination);
+    float const replan_dist = std::max(
+      chase_replan_dist, chase_replan_ratio * distance(player_pos, aim));
+    if (drift <= replan_dist) {
+      return;
     }
+    ++chase_replans;
+  }
+  SetDestination(aim);
+}
 
-    // set the player controller's position objective
-    if (path_idx > prev_path_idx && path_idx < path.size()) {
-      auto const& next_pos = path[path_idx];
-      player_controller.SetPosition(next_pos);
-      player_controller.SetFacing(next_pos);
+void PlayerNavigator::FollowFormation(vec3 const& player_pos)
+{
+  // a Fetch copies the whole path, only worth it once there's a new one
+  if (formation_store->GetSequence() == formation_sequence) {
+    return;
+  }
+
+  auto const leader = formation_store->Fetch();
+  if (!leader.has_value() || leader->sequence == formation_sequence ||
+      leader->map_id != objmgr.GetMapId()) {
+    return;
+  }
+  formation_sequence = leader->sequence;
+
+  // the leader's path replaces whatever we were after, and where it's going
+  // is where we'd replan to
+  nav_worker.Cancel();
+  repair_request = {};
+  update_path = false;
+  destination = leader->destination;
+  path_request = nav_worker.FormationPathAsync(
+    leader->map_id, player_pos, leader->path, formation_offset);
+  ++formation_paths;
+}
+
+void PlayerNavigator::SetPursuit(bool val)
+{
+  pursuit = val;
+  if (follower.HasPath()) {
+    SendPath();
+  }
+}
+
+void PlayerNavigator::SendPath()
+{
+  if (pursuit) {
+    player_controller.SetPath(follower.GetPath(), follower.GetSegment());
+  } else {
+    player_controller.SetPosition(follower.GetSteerTarget());
+    player_controller.SetFacing(follower.GetSteerTarget());
+  }
+}
+
+void PlayerNavigator::PickUpRepair()
+{
+  if (!repair_request.valid() ||
+      repair_request.wait_for(std::chrono::seconds{0}) !=
+        std::future_status::ready) {
+    return;
+  }
+
+  PathResult const repair = repair_request.get();
+
+  // if it didn't work out, the follower asks again or gives up and replans
+  if (repair.type.test(PathFlag::PATHFIND_NORMAL) &&
+      repair.map_id == path_result.map_id && follower.Repair(repair.path)) {
+    ++repairs;
+    SendPath();
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Repaired the path with %zu points",
+                                   repair.path.size());
+  }
+}
+
+void PlayerNavigator::CheckTileUnloads()
+{
+  std::vector<TileUnload> unloads;
+  {
+    lock_guard<mutex> lock{tile_unloads_lock};
+    unloads.swap(tile_unloads);
+  }
+
+  if (!path_result.type.test(PathFlag::PATHFIND_NORMAL)) {
+    return;
+  }
+
+  // tiles from before the path was calculated didn't make it into the path,
+  // and tiles away from it don't matter
+  for (auto const& unload : unloads) {
+    if (unload.map_id == path_result.map_id &&
+        unload.generation > path_result.tile_generation &&
+        PathCrosses(unload.tile)) {
       HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "Moving to next waypoint {%.03f, %.03f %0.3f}", next_pos.x, next_pos.y,
-        next_pos.z);
+        "Tile {%d, %d} under the path was unloaded, replanning",
+        unload.tile.x, unload.tile.y);
+      update_path = true;
+      return;
+    }
+  }
+}
+
+bool PlayerNavigator::PathCrosses(vec2i const& tile) const
+{
+  auto const& path = follower.GetPath();
+
+  // the segment we're on and everything after it, a segment can cross any
+  // tile in the box around its ends
+  size_t const first = follower.GetSegment();
+  for (size_t i = first; i < path.size(); ++i) {
+    vec2i const a = mmap_mgr.tileFromPos(path[i].xy);
+    vec2i const b =
+      mmap_mgr.tileFromPos(path[std::min(i + 1, path.size() - 1)].xy);
+    if (std::min(a.x, b.x) <= tile.x && tile.x <= std::max(a.x, b.x) &&
+        std::min(a.y, b.y) <= tile.y && tile.y <= std::max(a.y, b.y)) {
+      return true;
     }
   }
+  return false;
+}
 }
-}
\ No newline at end of file
@@ -1,29 +1,48 @@
 #pragma once
 
+#include <future>
 #include <memory>
-
-#include <boost/optional.hpp>
+#include <mutex>
+#include <vector>
 
 #include "../PlayerController.hpp"
+#include "FormationPaths.hpp"
+#include "LineOfWalkCache.hpp"
 #include "MoveMap.hpp"
+#include "NavTelemetry.hpp"
+#include "NavWorker.hpp"
 #include "PathFinder.hpp"
+#include "PathFollower.hpp"
+#include "UnitTracker.hpp"
 
 namespace phlipbot
 {
 struct PlayerNavigator {
   explicit PlayerNavigator(ObjectManager& objmgr,
                            PlayerController& player_controller,
-                           MMapManager& mmap_mgr) noexcept
-    : objmgr(objmgr),
-      player_controller(player_controller),
-      mmap_mgr(mmap_mgr){};
-  ~PlayerNavigator() = default;
+                           MMapManager& mmap_mgr) noexcept;
+  ~PlayerNavigator();
   PlayerNavigator(PlayerNavigator const&) = delete;
   PlayerNavigator& operator=(PlayerNavigator const&) = delete;
 
   void SetDestination(vec3 const dest);
+  // Keep heading for where the unit's going, replanning as it gets away
+  void SetChaseTarget(Guid const guid);
+  void ClearChaseTarget();
+
+  enum class FormationRole { None, Leader, Follower };
+  // Travel as part of a party. A leader publishes every path it picks up
+  // to store. A follower walks offset (x yards to the right, y behind) off
+  // the leader's latest path instead of searching for its own, and only
+  // searches if it strays too far from it.
+  void SetFormation(FormationRole const role,
+                    FormationPathStore* store,
+                    vec2 const& offset = vec2{0, 0});
   void SetEnabled(bool val);
-  void Update();
+  // steer with PlayerController's pure pursuit rather than waypoint by
+  // waypoint
+  void SetPursuit(bool val);
+  void Update(float const dt);
 
   ObjectManager& objmgr;
   PlayerController& player_controller;
@@ -31,9 +50,66 @@ struct PlayerNavigator {
 
   bool enabled{false};
   bool update_path{false};
+  bool pursuit{true};
 
-  boost::optional<PathFinder> path_info;
-  size_t path_idx{0};
+  // paths are calculated on the worker, and picked up in Update once they're
+  // ready
+  NavWorker nav_worker;
+  std::future<PathResult> path_request;
+  PathResult path_result;
   vec3 destination{0, 0, 0};
+
+  // tracks the player along path_result.path, spliced with repairs when the
+  // player strays a little, replanning when it strays a lot
+  PathFollower follower;
+  std::future<PathResult> repair_request;
+  uint32_t repairs{0};
+  uint32_t replans{0};
+
+  // straight line reachability of the visible units, raycast on nav_worker
+  // whether or not we're navigating
+  LineOfWalkCache walk_cache;
+
+  // Chasing a unit, the destination's where we'd meet it if it kept going
+  // (or where it is, without predict_intercept), and the path's only
+  // replanned once that's moved more than chase_replan_dist, or
+  // chase_replan_ratio of the way there, from the destination.
+  UnitTracker unit_tracker;
+  Guid chase_target{0};
+  bool predict_intercept{true};
+  float chase_replan_dist{3.0f};
+  float chase_replan_ratio{0.25f};
+  uint32_t chase_replans{0};
+
+  // Tiles are unloaded on whichever thread unloads them; the listener queues
+  // them up and Update replans if one was under the rest of the path.
+  struct TileUnload {
+    uint32_t map_id;
+    vec2i tile;
+    uint32_t generation;
+  };
+  std::mutex tile_unloads_lock;
+  std::vector<TileUnload> tile_unloads;
+  uint32_t tile_unload_listener{0};
+
+  FormationRole formation_role{FormationRole::None};
+  FormationPathStore* formation_store{nullptr};
+  vec2 formation_offset{0, 0};
+  // the leader path we last followed, and how many we have
+  uint32_t formation_sequence{0};
+  uint32_t formation_paths{0};
+
+  // a NavSample for every Update while there's a path to follow
+  NavTelemetry telemetry;
+  bool telemetry_enabled{true};
+
+private:
+  PathFollower::Action Navigate(vec3 const& player_pos, float const dt);
+  void Chase(WowPlayer const& player);
+  void FollowFormation(vec3 const& player_pos);
+  void SendPath();
+  void PickUpRepair();
+  void CheckTileUnloads();
+  bool PathCrosses(vec2i const& tile) const;
 };
 }
@@ -0,0 +1,350 @@
+#include "PolyLocalityCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <DetourCommon.h>
+
+#include <hadesmem/detail/assert.hpp>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+#include "MoveMap.hpp"
+#include "NavQueryFilter.hpp"
+#include "PathFinder.hpp"
+
+using std::vector;
+
+namespace
+{
+// Is pos over poly and within the tile's climb height of its surface? Another
+// poly layer would have to be at least an agent's height away, so this is the
+// poly findNearestPoly would have picked as well.
+bool PointOverPoly(dtNavMeshQuery const& query,
+                   dtPolyRef const ref,
+                   dtMeshTile const* tile,
+                   dtPoly const* poly,
+                   float const* pos,
+                   dtQueryFilter const& filter,
+                   float* nearestPt)
+{
+  if (poly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION) return false;
+  if (!filter.passFilter(ref, tile, poly)) return false;
+
+  float verts[DT_VERTS_PER_POLYGON * 3];
+  int const nverts = poly->vertCount;
+  for (int i = 0; i < nverts; ++i) {
+    dtVcopy(&verts[i * 3], &tile->verts[poly->verts[i] * 3]);
+  }
+  if (!dtPointInPolygon(pos, verts, nverts)) return false;
+
+  float height = 0.0f;
+  if (dtStatusFailed(query.getPolyHeight(ref, pos, &height))) return false;
+  if (dtAbs(height - pos[1]) > tile->header->walkableClimb) return false;
+
+  dtVcopy(nearestPt, pos);
+  nearestPt[1] = height;
+  return true;
+}
+
+// Visit the polys in tile whose bounds overlap [qmin, qmax] until f returns
+// true. Mirrors the private dtNavMeshQuery::queryPolygonsInTile.
+template <typename F>
+void QueryPolygonsInTile(dtNavMesh const& nav,
+                         dtMeshTile const* tile,
+                         float const* qmin,
+                         float const* qmax,
+                         F&& f)
+{
+  dtPolyRef const base = nav.getPolyRefBase(tile);
+
+  if (!tile->bvTree) {
+    for (int i = 0; i < tile->header->polyCount; ++i) {
+      dtPoly const* poly = &tile->polys[i];
+      if (poly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION) continue;
+
+      // Calc polygon bounds.
+      float bmin[3], bmax[3];
+      dtVcopy(bmin, &tile->verts[poly->verts[0] * 3]);
+      dtVcopy(bmax, bmin);
+      for (int j = 1; j < poly->vertCount; ++j) {
+        dtVmin(bmin, &tile->verts[poly->verts[j] * 3]);
+        dtVmax(bmax, &tile->verts[poly->verts[j] * 3]);
+      }
+      if (dtOverlapBounds(qmin, qmax, bmin, bmax) &&
+          f(base | dtPolyRef(i), poly)) {
+        return;
+      }
+    }
+    return;
+  }
+
+  dtBVNode const* node = &tile->bvTree[0];
+  dtBVNode const* end = &tile->bvTree[tile->header->bvNodeCount];
+  float const* tbmin = tile->header->bmin;
+  float const* tbmax = tile->header->bmax;
+  float const qfac = tile->header->bvQuantFactor;
+
+  // Calculate quantized box
+  unsigned short bmin[3], bmax[3];
+  // dtClamp query box to world box.
+  float const minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
+  float const miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
+  float const minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
+  float const maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
+  float const maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
+  float const maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
+  // Quantize
+  bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
+  bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
+  bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
+  bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
+  bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
+  bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
+
+  // Traverse tree
+  while (node < end) {
+    bool const overlap =
+      dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
+    bool const isLeafNode = node->i >= 0;
+
+    if (isLeafNode && overlap) {
+      if (f(base | dtPolyRef(node->i), &tile->polys[node->i])) return;
+    }
+
+    if (overlap || isLeafNode) {
+      node++;
+    } else {
+      int const escapeIndex = -node->i;
+      node += escapeIndex;
+    }
+  }
+}
+}
+
+namespace phlipbot
+{
+dtStatus PolyLocalityCache::findNearestPoly(dtNavMeshQuery const& query,
+                                            float const* center,
+                                            float const* extents,
+                                            dtQueryFilter const& filter,
+                                            dtPolyRef* nearestRef,
+                                            float* nearestPt)
+{
+  dtNavMesh const* nav = query.getAttachedNavMesh();
+  HADESMEM_DETAIL_ASSERT(nav);
+
+  // refs from another nav mesh don't mean anything here
+  if (nav != m_navMesh) {
+    m_navMesh = nav;
+    m_lastRef = 0;
+  }
+
+  dtPolyRef const ref = findLocal(*nav, query, center, filter, nearestPt);
+  if (ref) {
+    ++m_hits;
+    m_lastRef = ref;
+    *nearestRef = ref;
+    return DT_SUCCESS;
+  }
+
+  ++m_misses;
+  dtStatus const status =
+    query.findNearestPoly(center, extents, &filter, nearestRef, nearestPt);
+  m_lastRef = dtStatusSucceed(status) ? *nearestRef : 0;
+  return status;
+}
+
+void PolyLocalityCache::reset()
+{
+  m_navMesh = nullptr;
+  m_lastRef = 0;
+  m_hits = 0;
+  m_misses = 0;
+}
+
+float PolyLocalityCache::getHitRate() const
+{
+  uint32_t const total = m_hits + m_misses;
+  return total ? float(m_hits) / float(total) : 0.0f;
+}
+
+dtPolyRef PolyLocalityCache::findLocal(dtNavMesh const& nav,
+                                       dtNavMeshQuery const& query,
+                                       float const* pos,
+                                       dtQueryFilter const& filter,
+                                       float* nearestPt) const
+{
+  dtMeshTile const* tile = nullptr;
+  dtPoly const* poly = nullptr;
+  if (m_lastRef &&
+      dtStatusSucceed(nav.getTileAndPolyByRef(m_lastRef, &tile, &poly))) {
+    // still on the same poly
+    if (PointOverPoly(query, m_lastRef, tile, poly, pos, filter, nearestPt)) {
+      return m_lastRef;
+    }
+
+    // walked onto one of its neighbours
+    for (unsigned int i = poly->firstLink; i != DT_NULL_LINK;
+         i = tile->links[i].next) {
+      dtPolyRef const neighbourRef = tile->links[i].ref;
+      if (!neighbourRef) continue;
+
+      dtMeshTile const* neighbourTile = nullptr;
+      dtPoly const* neighbourPoly = nullptr;
+      nav.getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile,
+                                    &neighbourPoly);
+      if (PointOverPoly(query, neighbourRef, neighbourTile, neighbourPoly, pos,
+                        filter, nearestPt)) {
+        return neighbourRef;
+      }
+    }
+  }
+
+  // somewhere else, check the polys right around the point in its tile
+  int tx, ty;
+  nav.calcTileLoc(pos, &tx, &ty);
+  dtMeshTile const* posTile = nav.getTileAt(tx, ty, 0);
+  if (!posTile) return 0;
+
+  float const climb = posTile->header->walkableClimb;
+  float const qmin[3] = {pos[0], pos[1] - climb, pos[2]};
+  float const qmax[3] = {pos[0], pos[1] + climb, pos[2]};
+
+  dtPolyRef found = 0;
+  QueryPolygonsInTile(
+    nav, posTile, qmin, qmax, [&](dtPolyRef const ref, dtPoly const* p) {
+      if (PointOverPoly(query, ref, posTile, p, pos, filter, nearestPt)) {
+        found = ref;
+        return true;
+      }
+      return false;
+    });
+  return found;
+}
+
+namespace test
+{
+namespace
+{
+struct WalkFixture {
+  WalkFixture() : mmap{"C:\\MaNGOS\\data\\__mmaps"}
+  {
+    // Eastern Kingdoms, Elwynn Forest
+    REQUIRE(mmap.loadMap(map_id, vec2i{48, 32}));
+    query = mmap.GetNavMeshQuery(map_id);
+    REQUIRE(query != nullptr);
+
+    PathFinder path_info{mmap, map_id};
+    REQUIRE(path_info.calculate(vec3{-8949.95f, -132.493f, 83.5312f},
+                                vec3{-9046.507f, -45.71962f, 88.33186f}));
+    auto const& path = path_info.getPath();
+    REQUIRE(path.size() >= 2);
+
+    // Sample the path every half yard, like a player walking along it and
+    // being looked up every frame.
+    for (size_t i = 1; i < path.size(); ++i) {
+      vec3 const& a = path[i - 1];
+      vec3 const& b = path[i];
+      int const steps = std::max(1, int(glm::distance(a, b) / 0.5f));
+      for (int s = 0; s < steps; ++s) {
+        vec3 const p = glm::mix(a, b, float(s) / float(steps));
+        float const pYZX[3] = {p.y, p.z, p.x};
+        positions.insert(end(positions), pYZX, pYZX + 3);
+      }
+    }
+  }
+
+  uint32_t const map_id = 0;
+  MMapManager mmap;
+  dtNavMeshQuery const* query = nullptr;
+  dtQueryFilter const filter = PlayerFilter::toQueryFilter();
+  vector<float> positions;
+};
+
+float const extents[3] = {5.0f, 10.0f, 5.0f};
+}
+
+TEST_CASE("PolyLocalityCache resolves the same position as findNearestPoly")
+{
+  WalkFixture fx;
+  PolyLocalityCache cache;
+
+  for (size_t i = 0; i < fx.positions.size(); i += 3) {
+    float const* pos = &fx.positions[i];
+
+    dtPolyRef expected = 0;
+    float expectedPt[3];
+    fx.query->findNearestPoly(pos, extents, &fx.filter, &expected, expectedPt);
+
+    dtPolyRef actual = 0;
+    float actualPt[3];
+    cache.findNearestPoly(*fx.query, pos, extents, fx.filter, &actual,
+                          actualPt);
+
+    CHECK((expected != 0) == (actual != 0));
+    if (expected && actual) {
+      CHECK(dtAbs(expectedPt[1] - actualPt[1]) < 0.1f);
+    }
+  }
+
+  // a walking player almost always stays on or next to the last poly
+  CHECK(cache.getHits() > cache.getMisses());
+}
+
+TEST_CASE("PolyLocalityCache::reset forgets the cached poly and counters")
+{
+  WalkFixture fx;
+  PolyLocalityCache cache;
+
+  dtPolyRef ref = 0;
+  float nearest[3];
+  cache.findNearestPoly(*fx.query, &fx.positions[0], extents, fx.filter, &ref,
+                        nearest);
+  CHECK(ref != 0);
+  CHECK(cache.getLastRef() == ref);
+
+  cache.reset();
+  CHECK(cache.getLastRef() == 0);
+  CHECK(cache.getHits() == 0);
+  CHECK(cache.getMisses() == 0);
+  CHECK(cache.getHitRate() == 0.0f);
+}
+
+TEST_CASE("benchmark PolyLocalityCache vs findNearestPoly" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  WalkFixture fx;
+  PolyLocalityCache cache;
+  uint32_t const npos = uint32_t(fx.positions.size() / 3);
+
+  dtPolyRef ref = 0;
+  float nearest[3];
+
+  double const uncached_us =
+    bench::TimeMicros(npos, [&, i = size_t(0)]() mutable {
+      fx.query->findNearestPoly(&fx.positions[3 * i++], extents, &fx.filter,
+                                &ref, nearest);
+      bench::DoNotOptimize(ref);
+    });
+
+  double const cached_us =
+    bench::TimeMicros(npos, [&, i = size_t(0)]() mutable {
+      cache.findNearestPoly(*fx.query, &fx.positions[3 * i++], extents,
+                            fx.filter, &ref, nearest);
+      bench::DoNotOptimize(ref);
+    });
+
+  bench::Report("dtNavMeshQuery::findNearestPoly", uncached_us);
+  bench::Report("PolyLocalityCache::findNearestPoly", cached_us);
+  std::printf("[bench] PolyLocalityCache hit rate %.1f%% (%u/%u)\n",
+              100.0f * cache.getHitRate(), cache.getHits(),
+              cache.getHits() + cache.getMisses());
+}
+}
+}
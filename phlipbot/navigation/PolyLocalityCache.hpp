@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <DetourNavMesh.h>
+#include <DetourNavMeshQuery.h>
+
+namespace phlipbot
+{
+// Remembers the last poly an agent's position resolved to, so resolving the
+// same agent's position again (it only moves a few yards per frame) can
+// usually skip dtNavMeshQuery::findNearestPoly.
+//
+// A lookup checks, in order: the cached poly, the cached poly's linked
+// neighbours, and the polys near the point in its tile's BV tree. Only if all
+// of those miss do we fall back to findNearestPoly.
+//
+// Not thread safe; use one PolyLocalityCache per agent.
+struct PolyLocalityCache {
+  // Same contract as dtNavMeshQuery::findNearestPoly.
+  dtStatus findNearestPoly(dtNavMeshQuery const& query,
+                           float const* center,
+                           float const* extents,
+                           dtQueryFilter const& filter,
+                           dtPolyRef* nearestRef,
+                           float* nearestPt);
+
+  void reset();
+
+  inline dtPolyRef getLastRef() const { return m_lastRef; }
+  inline uint32_t getHits() const { return m_hits; }
+  inline uint32_t getMisses() const { return m_misses; }
+  float getHitRate() const;
+
+private:
+  dtPolyRef findLocal(dtNavMesh const& nav,
+                      dtNavMeshQuery const& query,
+                      float const* pos,
+                      dtQueryFilter const& filter,
+                      float* nearestPt) const;
+
+  dtNavMesh const* m_navMesh{nullptr};
+  dtPolyRef m_lastRef{0};
+
+  uint32_t m_hits{0};
+  uint32_t m_misses{0};
+};
+}
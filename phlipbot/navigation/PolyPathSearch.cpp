@@ -0,0 +1,333 @@
+#include "PolyPathSearch.hpp"
+
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <DetourNavMeshQuery.h>
+
+#include <hadesmem/detail/assert.hpp>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+#include "MoveMap.hpp"
+
+using std::make_unique;
+using std::vector;
+
+namespace fs = std::filesystem;
+
+namespace phlipbot
+{
+dtStatus GetPortalPoints(dtPolyRef from,
+                         dtPoly const* fromPoly,
+                         dtMeshTile const* fromTile,
+                         dtPolyRef to,
+                         dtPoly const* toPoly,
+                         dtMeshTile const* toTile,
+                         float* left,
+                         float* right)
+{
+  // Find the link that points to the 'to' polygon.
+  dtLink const* link = nullptr;
+  for (unsigned int i = fromPoly->firstLink; i != DT_NULL_LINK;
+       i = fromTile->links[i].next) {
+    if (fromTile->links[i].ref == to) {
+      link = &fromTile->links[i];
+      break;
+    }
+  }
+  if (!link) return DT_FAILURE | DT_INVALID_PARAM;
+
+  // Handle off-mesh connections.
+  if (fromPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION) {
+    int const v = link->edge;
+    dtVcopy(left, &fromTile->verts[fromPoly->verts[v] * 3]);
+    dtVcopy(right, &fromTile->verts[fromPoly->verts[v] * 3]);
+    return DT_SUCCESS;
+  }
+
+  if (toPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION) {
+    for (unsigned int i = toPoly->firstLink; i != DT_NULL_LINK;
+         i = toTile->links[i].next) {
+      if (toTile->links[i].ref == from) {
+        int const v = toTile->links[i].edge;
+        dtVcopy(left, &toTile->verts[toPoly->verts[v] * 3]);
+        dtVcopy(right, &toTile->verts[toPoly->verts[v] * 3]);
+        return DT_SUCCESS;
+      }
+    }
+    return DT_FAILURE | DT_INVALID_PARAM;
+  }
+
+  // Find portal vertices.
+  int const v0 = fromPoly->verts[link->edge];
+  int const v1 = fromPoly->verts[(link->edge + 1) % int(fromPoly->vertCount)];
+  dtVcopy(left, &fromTile->verts[v0 * 3]);
+  dtVcopy(right, &fromTile->verts[v1 * 3]);
+
+  // If the link is at tile boundary, clamp the vertices to the link width.
+  if (link->side != 0xff && (link->bmin != 0 || link->bmax != 255)) {
+    float const s = 1.0f / 255.0f;
+    float const tmin = link->bmin * s;
+    float const tmax = link->bmax * s;
+    dtVlerp(left, &fromTile->verts[v0 * 3], &fromTile->verts[v1 * 3], tmin);
+    dtVlerp(right, &fromTile->verts[v0 * 3], &fromTile->verts[v1 * 3], tmax);
+  }
+
+  return DT_SUCCESS;
+}
+
+dtStatus GetEdgeMidPoint(dtPolyRef from,
+                         dtPoly const* fromPoly,
+                         dtMeshTile const* fromTile,
+                         dtPolyRef to,
+                         dtPoly const* toPoly,
+                         dtMeshTile const* toTile,
+                         float* mid)
+{
+  float left[3], right[3];
+  dtStatus const res = GetPortalPoints(from, fromPoly, fromTile, to, toPoly,
+                                       toTile, left, right);
+  if (dtStatusFailed(res)) {
+    return res;
+  }
+
+  mid[0] = (left[0] + right[0]) * 0.5f;
+  mid[1] = (left[1] + right[1]) * 0.5f;
+  mid[2] = (left[2] + right[2]) * 0.5f;
+  return DT_SUCCESS;
+}
+
+PolyPathSearch::PolyPathSearch(int const maxNodes)
+  : m_maxNodes(maxNodes),
+    m_nodePool(make_unique<dtNodePool>(
+      maxNodes, int(dtNextPow2(static_cast<unsigned int>(maxNodes / 4))))),
+    m_openList(make_unique<dtNodeQueue>(maxNodes))
+{
+  HADESMEM_DETAIL_ASSERT(maxNodes > 0 && maxNodes <= int(DT_NULL_IDX));
+}
+
+void PolyPathSearch::reserve(int const maxNodes)
+{
+  int const nodes = dtMin(maxNodes, int(DT_NULL_IDX));
+  if (nodes <= m_maxNodes) return;
+
+  m_nodePool = make_unique<dtNodePool>(
+    nodes, int(dtNextPow2(static_cast<unsigned int>(nodes / 4))));
+  m_openList = make_unique<dtNodeQueue>(nodes);
+  m_maxNodes = nodes;
+}
+
+dtStatus PolyPathSearch::getPathToNode(dtNode* endNode,
+                                       dtPolyRef* path,
+                                       int* pathCount,
+                                       int const maxPath) const
+{
+  // Find the length of the entire path.
+  dtNode* curNode = endNode;
+  int length = 0;
+  do {
+    length++;
+    curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
+  } while (curNode);
+
+  // If the path cannot be fully stored then advance to the last node we will
+  // be able to store.
+  curNode = endNode;
+  int writeCount;
+  for (writeCount = length; writeCount > maxPath; writeCount--) {
+    HADESMEM_DETAIL_ASSERT(curNode);
+    curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
+  }
+
+  // Write path
+  for (int i = writeCount - 1; i >= 0; i--) {
+    HADESMEM_DETAIL_ASSERT(curNode);
+    path[i] = curNode->id;
+    curNode = m_nodePool->getNodeAtIdx(curNode->pidx);
+  }
+
+  *pathCount = dtMin(length, maxPath);
+
+  if (length > maxPath) {
+    return DT_SUCCESS | DT_BUFFER_TOO_SMALL;
+  }
+
+  return DT_SUCCESS;
+}
+
+namespace test
+{
+namespace
+{
+// Pick the center of every walkable poly in the tile as a query endpoint.
+vector<float> GroundPolyCenters(dtMeshTile const* tile)
+{
+  vector<float> centers;
+  for (int i = 0; i < tile->header->polyCount; ++i) {
+    dtPoly const& poly = tile->polys[i];
+    if (poly.getType() != DT_POLYTYPE_GROUND || !(poly.flags & NAV_GROUND)) {
+      continue;
+    }
+
+    float center[3] = {0.0f, 0.0f, 0.0f};
+    for (int j = 0; j < poly.vertCount; ++j) {
+      dtVadd(center, center, &tile->verts[poly.verts[j] * 3]);
+    }
+    dtVscale(center, center, 1.0f / poly.vertCount);
+    centers.insert(end(centers), center, center + 3);
+  }
+  return centers;
+}
+
+struct SearchFixture {
+  SearchFixture() : mmap{"C:\\MaNGOS\\data\\__mmaps"}
+  {
+    // Eastern Kingdoms, Elwynn Forest
+    REQUIRE(mmap.loadMap(map_id, vec2i{48, 32}));
+    query = mmap.GetNavMeshQuery(map_id);
+    REQUIRE(query != nullptr);
+    nav = query->getAttachedNavMesh();
+    REQUIRE(nav != nullptr);
+
+    dtMeshTile const* tile = nav->getTile(0);
+    REQUIRE(tile != nullptr);
+    centers = GroundPolyCenters(tile);
+    REQUIRE(centers.size() >= 3 * 2);
+  }
+
+  // Deterministic pseudo-random (start, end) pairs of poly centers
+  vector<std::pair<size_t, size_t>> Pairs(size_t const count) const
+  {
+    std::mt19937 rng{1234};
+    std::uniform_int_distribution<size_t> pick{0, centers.size() / 3 - 1};
+    vector<std::pair<size_t, size_t>> pairs;
+    for (size_t i = 0; i < count; ++i) {
+      pairs.emplace_back(pick(rng) * 3, pick(rng) * 3);
+    }
+    return pairs;
+  }
+
+  dtPolyRef NearestPoly(float const* pos, dtQueryFilter const& filter) const
+  {
+    float const extents[3] = {5.0f, 10.0f, 5.0f};
+    float nearest[3];
+    dtPolyRef ref = 0;
+    query->findNearestPoly(pos, extents, &filter, &ref, nearest);
+    return ref;
+  }
+
+  uint32_t const map_id = 0;
+  MMapManager mmap;
+  dtNavMeshQuery const* query = nullptr;
+  dtNavMesh const* nav = nullptr;
+  vector<float> centers;
+};
+}
+
+TEST_CASE("PolyPathSearch finds the same paths as dtNavMeshQuery::findPath")
+{
+  SearchFixture fx;
+  dtQueryFilter const filter = PlayerFilter::toQueryFilter();
+  PolyPathSearch search{2048};
+
+  dtPolyRef generic[256];
+  dtPolyRef specialized[256];
+
+  for (auto const& pair : fx.Pairs(64)) {
+    float const* start = &fx.centers[pair.first];
+    float const* end = &fx.centers[pair.second];
+    dtPolyRef const startRef = fx.NearestPoly(start, filter);
+    dtPolyRef const endRef = fx.NearestPoly(end, filter);
+    if (!startRef || !endRef) continue;
+
+    int ngeneric = 0;
+    int nspecialized = 0;
+    dtStatus const res_generic = fx.query->findPath(
+      startRef, endRef, start, end, &filter, generic, &ngeneric, 256);
+    dtStatus const res_specialized = search.findPath<PlayerFilter>(
+      *fx.nav, startRef, endRef, start, end, specialized, &nspecialized, 256);
+
+    CHECK(dtStatusSucceed(res_generic) == dtStatusSucceed(res_specialized));
+    CHECK(ngeneric == nspecialized);
+    if (ngeneric > 0 && ngeneric == nspecialized) {
+      CHECK(generic[0] == specialized[0]);
+      CHECK(generic[ngeneric - 1] == specialized[nspecialized - 1]);
+    }
+  }
+}
+
+TEST_CASE("PolyPathSearch::reserve only grows the node pool")
+{
+  PolyPathSearch search{2048};
+  CHECK(search.getMaxNodes() == 2048);
+
+  search.reserve(1024);
+  CHECK(search.getMaxNodes() == 2048);
+
+  search.reserve(8192);
+  CHECK(search.getMaxNodes() == 8192);
+
+  search.reserve(1 << 20);
+  CHECK(search.getMaxNodes() == int(DT_NULL_IDX));
+}
+
+TEST_CASE("benchmark PolyPathSearch<PlayerFilter> vs dtQueryFilter" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  SearchFixture fx;
+  dtQueryFilter const filter = PlayerFilter::toQueryFilter();
+  PolyPathSearch search{2048};
+
+  struct Query {
+    dtPolyRef startRef, endRef;
+    float const *start, *end;
+  };
+  vector<Query> queries;
+  for (auto const& pair : fx.Pairs(512)) {
+    float const* start = &fx.centers[pair.first];
+    float const* end = &fx.centers[pair.second];
+    dtPolyRef const startRef = fx.NearestPoly(start, filter);
+    dtPolyRef const endRef = fx.NearestPoly(end, filter);
+    if (startRef && endRef) {
+      queries.push_back({startRef, endRef, start, end});
+    }
+  }
+  REQUIRE(!queries.empty());
+
+  dtPolyRef path[256];
+  int npath = 0;
+
+  double const generic_us =
+    bench::TimeMicros(uint32_t(queries.size()), [&, i = size_t(0)]() mutable {
+      auto const& q = queries[i++];
+      fx.query->findPath(q.startRef, q.endRef, q.start, q.end, &filter, path,
+                         &npath, 256);
+      bench::DoNotOptimize(npath);
+    });
+
+  double const specialized_us =
+    bench::TimeMicros(uint32_t(queries.size()), [&, i = size_t(0)]() mutable {
+      auto const& q = queries[i++];
+      search.findPath<PlayerFilter>(*fx.nav, q.startRef, q.endRef, q.start,
+                                    q.end, path, &npath, 256);
+      bench::DoNotOptimize(npath);
+    });
+
+  double const avoid_liquids_us =
+    bench::TimeMicros(uint32_t(queries.size()), [&, i = size_t(0)]() mutable {
+      auto const& q = queries[i++];
+      search.findPath<PlayerAvoidLiquidsFilter>(
+        *fx.nav, q.startRef, q.endRef, q.start, q.end, path, &npath, 256);
+      bench::DoNotOptimize(npath);
+    });
+
+  bench::Report("dtNavMeshQuery::findPath (dtQueryFilter)", generic_us);
+  bench::Report("PolyPathSearch::findPath<PlayerFilter>", specialized_us);
+  bench::Report("PolyPathSearch::findPath<PlayerAvoidLiquidsFilter>",
+                avoid_liquids_us);
+}
+}
+}
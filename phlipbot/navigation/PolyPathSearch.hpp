@@ -0,0 +1,249 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+
+#include <DetourCommon.h>
+#include <DetourNavMesh.h>
+#include <DetourNode.h>
+#include <DetourStatus.h>
+
+#include "NavQueryFilter.hpp"
+
+namespace phlipbot
+{
+// Find the portal (shared edge) between two adjacent polygons.
+// Mirrors the private dtNavMeshQuery::getPortalPoints.
+dtStatus GetPortalPoints(dtPolyRef from,
+                         dtPoly const* fromPoly,
+                         dtMeshTile const* fromTile,
+                         dtPolyRef to,
+                         dtPoly const* toPoly,
+                         dtMeshTile const* toTile,
+                         float* left,
+                         float* right);
+
+// Midpoint of the portal between two adjacent polygons.
+dtStatus GetEdgeMidPoint(dtPolyRef from,
+                         dtPoly const* fromPoly,
+                         dtMeshTile const* fromTile,
+                         dtPolyRef to,
+                         dtPoly const* toPoly,
+                         dtMeshTile const* toTile,
+                         float* mid);
+
+// A* over the navmesh polygon graph, templated on a compile-time filter (see
+// NavQueryFilter.hpp) so the filter and cost functions inline into the
+// search loop. This is the same algorithm as dtNavMeshQuery::findPath, but
+// owns its own node pool and open list.
+//
+// Not thread safe; use one PolyPathSearch per thread.
+struct PolyPathSearch {
+  explicit PolyPathSearch(int const maxNodes);
+  ~PolyPathSearch() = default;
+  PolyPathSearch(PolyPathSearch const&) = delete;
+  PolyPathSearch& operator=(PolyPathSearch const&) = delete;
+
+  template <typename Filter>
+  dtStatus findPath(dtNavMesh const& nav,
+                    dtPolyRef const startRef,
+                    dtPolyRef const endRef,
+                    float const* startPos,
+                    float const* endPos,
+                    dtPolyRef* path,
+                    int* pathCount,
+                    int const maxPath);
+
+  // Grow the node pool to at least maxNodes (at most DT_NULL_IDX) nodes.
+  // Never shrinks.
+  void reserve(int const maxNodes);
+
+  inline int getMaxNodes() const { return m_maxNodes; }
+  // number of nodes the last findPath took off the open list
+  inline int getExpandedNodes() const { return m_expandedNodes; }
+
+private:
+  dtStatus getPathToNode(dtNode* endNode,
+                         dtPolyRef* path,
+                         int* pathCount,
+                         int const maxPath) const;
+
+  // heuristic scale, same as dtNavMeshQuery's H_SCALE
+  static constexpr float H_SCALE = 0.999f;
+
+  int m_maxNodes;
+  int m_expandedNodes = 0;
+  std::unique_ptr<dtNodePool> m_nodePool;
+  std::unique_ptr<dtNodeQueue> m_openList;
+};
+
+template <typename Filter>
+dtStatus PolyPathSearch::findPath(dtNavMesh const& nav,
+                                  dtPolyRef const startRef,
+                                  dtPolyRef const endRef,
+                                  float const* startPos,
+                                  float const* endPos,
+                                  dtPolyRef* path,
+                                  int* pathCount,
+                                  int const maxPath)
+{
+  *pathCount = 0;
+  m_expandedNodes = 0;
+
+  if (!nav.isValidPolyRef(startRef) || !nav.isValidPolyRef(endRef) ||
+      !startPos || !endPos || !path || maxPath <= 0) {
+    return DT_FAILURE | DT_INVALID_PARAM;
+  }
+
+  if (startRef == endRef) {
+    path[0] = startRef;
+    *pathCount = 1;
+    return DT_SUCCESS;
+  }
+
+  m_nodePool->clear();
+  m_openList->clear();
+
+  dtNode* startNode = m_nodePool->getNode(startRef);
+  dtVcopy(startNode->pos, startPos);
+  startNode->pidx = 0;
+  startNode->cost = 0;
+  startNode->total = dtVdist(startPos, endPos) * H_SCALE;
+  startNode->id = startRef;
+  startNode->flags = DT_NODE_OPEN;
+  m_openList->push(startNode);
+
+  dtNode* lastBestNode = startNode;
+  float lastBestNodeCost = startNode->total;
+
+  bool outOfNodes = false;
+
+  while (!m_openList->empty()) {
+    // Remove node from open list and put it in closed list.
+    dtNode* bestNode = m_openList->pop();
+    bestNode->flags &= ~DT_NODE_OPEN;
+    bestNode->flags |= DT_NODE_CLOSED;
+    ++m_expandedNodes;
+
+    // Reached the goal, stop searching.
+    if (bestNode->id == endRef) {
+      lastBestNode = bestNode;
+      break;
+    }
+
+    // Get current poly and tile.
+    // The API input has been checked already, skip checking internal data.
+    dtPolyRef const bestRef = bestNode->id;
+    dtMeshTile const* bestTile = nullptr;
+    dtPoly const* bestPoly = nullptr;
+    nav.getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+
+    // Get parent poly. Our filters' costs don't depend on the parent poly, so
+    // unlike dtNavMeshQuery we don't need to look up its tile.
+    dtPolyRef parentRef = 0;
+    if (bestNode->pidx) {
+      parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+    }
+
+    for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK;
+         i = bestTile->links[i].next) {
+      dtPolyRef const neighbourRef = bestTile->links[i].ref;
+
+      // Skip invalid ids and do not expand back to where we came from.
+      if (!neighbourRef || neighbourRef == parentRef) continue;
+
+      // Get neighbour poly and tile.
+      dtMeshTile const* neighbourTile = nullptr;
+      dtPoly const* neighbourPoly = nullptr;
+      nav.getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile,
+                                    &neighbourPoly);
+
+      if (!Filter::passFilter(neighbourRef, neighbourTile, neighbourPoly)) {
+        continue;
+      }
+
+      // deal explicitly with crossing tile boundaries
+      unsigned char crossSide = 0;
+      if (bestTile->links[i].side != 0xff) {
+        crossSide = bestTile->links[i].side >> 1;
+      }
+
+      dtNode* neighbourNode = m_nodePool->getNode(neighbourRef, crossSide);
+      if (!neighbourNode) {
+        outOfNodes = true;
+        continue;
+      }
+
+      // If the node is visited the first time, calculate node position.
+      if (neighbourNode->flags == 0) {
+        GetEdgeMidPoint(bestRef, bestPoly, bestTile, neighbourRef,
+                        neighbourPoly, neighbourTile, neighbourNode->pos);
+      }
+
+      // Calculate cost and heuristic.
+      float cost = 0;
+      float heuristic = 0;
+
+      // Special case for last node.
+      if (neighbourRef == endRef) {
+        float const curCost =
+          Filter::getCost(bestNode->pos, neighbourNode->pos, bestPoly);
+        float const endCost =
+          Filter::getCost(neighbourNode->pos, endPos, neighbourPoly);
+
+        cost = bestNode->cost + curCost + endCost;
+        heuristic = 0;
+      } else {
+        float const curCost =
+          Filter::getCost(bestNode->pos, neighbourNode->pos, bestPoly);
+
+        cost = bestNode->cost + curCost;
+        heuristic = dtVdist(neighbourNode->pos, endPos) * H_SCALE;
+      }
+
+      float const total = cost + heuristic;
+
+      // The node is already in open list and the new result is worse, skip.
+      if ((neighbourNode->flags & DT_NODE_OPEN) &&
+          total >= neighbourNode->total) {
+        continue;
+      }
+      // The node is already visited and process, and the new result is worse,
+      // skip.
+      if ((neighbourNode->flags & DT_NODE_CLOSED) &&
+          total >= neighbourNode->total) {
+        continue;
+      }
+
+      // Add or update the node.
+      neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+      neighbourNode->id = neighbourRef;
+      neighbourNode->flags = (neighbourNode->flags & ~DT_NODE_CLOSED);
+      neighbourNode->cost = cost;
+      neighbourNode->total = total;
+
+      if (neighbourNode->flags & DT_NODE_OPEN) {
+        // Already in open, update node location.
+        m_openList->modify(neighbourNode);
+      } else {
+        // Put the node in open list.
+        neighbourNode->flags |= DT_NODE_OPEN;
+        m_openList->push(neighbourNode);
+      }
+
+      // Update nearest node to target so far.
+      if (heuristic < lastBestNodeCost) {
+        lastBestNodeCost = heuristic;
+        lastBestNode = neighbourNode;
+      }
+    }
+  }
+
+  dtStatus status = getPathToNode(lastBestNode, path, pathCount, maxPath);
+
+  if (lastBestNode->id != endRef) status |= DT_PARTIAL_RESULT;
+  if (outOfNodes) status |= DT_OUT_OF_NODES;
+
+  return status;
+}
+}
@@ -0,0 +1,630 @@
+#include "RouteTable.hpp"
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <glm/geometric.hpp>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+
+#include <doctest.h>
+
+#include "SyntheticMMap.hpp"
+
+namespace fs = std::filesystem;
+
+using glm::distance;
+
+using hadesmem::ErrorCodeWinLast;
+using hadesmem::ErrorString;
+
+using std::vector;
+
+namespace
+{
+uint32_t const ROUTE_TABLE_MAGIC = 0x5254424c; // 'RTBL'
+uint32_t const ROUTE_TABLE_VERSION = 1;
+
+// deltas are stored in 1/8 yards, so a point is at most 1/16 yard off and a
+// single delta can reach ~4000 yards
+float const ROUTE_DELTA_SCALE = 8.0f;
+float const ROUTE_MAX_DELTA = 4000.0f;
+
+// dest has to be this close to a POI for its routes to apply
+float const ROUTE_POI_RADIUS = 5.0f;
+// and src this close to the route to join it
+float const ROUTE_JOIN_RADIUS = 100.0f;
+
+struct RouteTableHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t map_id;
+  uint32_t poi_count;
+  uint32_t points_offset; // from the start of the file
+  uint32_t points_size;
+};
+
+struct RoutePoiRecord {
+  uint32_t id;
+  float pos[3];
+};
+static_assert(sizeof(RoutePoiRecord) == 16,
+              "RoutePoiRecord should have no padding");
+
+struct RouteRecord {
+  uint32_t offset; // into the point data
+  uint32_t count;
+  float length;
+};
+static_assert(sizeof(RouteRecord) == 12, "RouteRecord should have no padding");
+
+size_t RouteDataSize(uint32_t const count)
+{
+  size_t const size = 3 * sizeof(float) + (count - 1) * 3 * sizeof(int16_t);
+  return (size + 3) & ~size_t(3);
+}
+
+template <typename T>
+void Append(vector<unsigned char>& out, T const& t)
+{
+  auto const* bytes = reinterpret_cast<unsigned char const*>(&t);
+  out.insert(out.end(), bytes, bytes + sizeof(t));
+}
+
+// Append path to out as a first point and deltas, returns how many points
+// that took. Deltas are taken from where the decoder will be rather than the
+// previous point, so the rounding doesn't add up along the route.
+uint32_t EncodeRoute(phlipbot::PointsArray const& path,
+                     vector<unsigned char>& out)
+{
+  size_t const start = out.size();
+
+  phlipbot::vec3 decoded = path.front();
+  Append(out, decoded.x);
+  Append(out, decoded.y);
+  Append(out, decoded.z);
+  uint32_t count = 1;
+
+  for (size_t i = 1; i < path.size(); ++i) {
+    phlipbot::vec3 const& prev = path[i - 1];
+    phlipbot::vec3 const& next = path[i];
+
+    // split segments too long for one delta
+    phlipbot::vec3 const d = next - prev;
+    float const longest =
+      std::max({std::abs(d.x), std::abs(d.y), std::abs(d.z)});
+    int const steps = std::max(1, int(std::ceil(longest / ROUTE_MAX_DELTA)));
+
+    for (int step = 1; step <= steps; ++step) {
+      phlipbot::vec3 const target = prev + d * (float(step) / steps);
+      phlipbot::vec3 const q = (target - decoded) * ROUTE_DELTA_SCALE;
+      int16_t const delta[3] = {int16_t(std::lround(q.x)),
+                                int16_t(std::lround(q.y)),
+                                int16_t(std::lround(q.z))};
+      Append(out, delta);
+      decoded += phlipbot::vec3{float(delta[0]), float(delta[1]),
+                                float(delta[2])} /
+                 ROUTE_DELTA_SCALE;
+      ++count;
+    }
+  }
+
+  out.resize(start + RouteDataSize(count), 0);
+  return count;
+}
+
+void LoadTilesBetween(phlipbot::MMapManager& mmap,
+                      uint32_t const map_id,
+                      phlipbot::vec3 const& a,
+                      phlipbot::vec3 const& b)
+{
+  phlipbot::vec2i const ta = mmap.tileFromPos(a.xy);
+  phlipbot::vec2i const tb = mmap.tileFromPos(b.xy);
+  for (int x = std::min(ta.x, tb.x) - 1; x <= std::max(ta.x, tb.x) + 1; ++x) {
+    for (int y = std::min(ta.y, tb.y) - 1; y <= std::max(ta.y, tb.y) + 1;
+         ++y) {
+      mmap.loadMap(map_id, phlipbot::vec2i{x, y});
+    }
+  }
+}
+}
+
+namespace phlipbot
+{
+struct RouteTable::Mapping {
+  ~Mapping()
+  {
+    if (view) {
+      ::UnmapViewOfFile(view);
+    }
+    if (mapping) {
+      ::CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+      ::CloseHandle(file);
+    }
+  }
+
+  HANDLE file{INVALID_HANDLE_VALUE};
+  HANDLE mapping{nullptr};
+  void const* view{nullptr};
+};
+
+RouteTable::RouteTable(fs::path const& path) : mapping(new Mapping)
+{
+  mapping->file =
+    ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (mapping->file == INVALID_HANDLE_VALUE) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to open route table"}
+                        << ErrorFile{path}
+                        << ErrorCodeWinLast{::GetLastError()});
+  }
+
+  LARGE_INTEGER file_size;
+  if (!::GetFileSizeEx(mapping->file, &file_size) ||
+      file_size.QuadPart < LONGLONG(sizeof(RouteTableHeader))) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Route table is too small"}
+                        << ErrorFile{path});
+  }
+
+  mapping->mapping = ::CreateFileMappingW(mapping->file, nullptr,
+                                          PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping->mapping) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to map route table"}
+                        << ErrorFile{path}
+                        << ErrorCodeWinLast{::GetLastError()});
+  }
+
+  mapping->view = ::MapViewOfFile(mapping->mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!mapping->view) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to map view of route table"}
+                        << ErrorFile{path}
+                        << ErrorCodeWinLast{::GetLastError()});
+  }
+
+  data = static_cast<unsigned char const*>(mapping->view);
+  size = size_t(file_size.QuadPart);
+
+  Validate(path);
+
+  HADESMEM_DETAIL_TRACE_FORMAT_A("Mapped route table %s, map %03u, %u POIs",
+                                 path.string().c_str(), GetMapId(),
+                                 GetPoiCount());
+}
+
+RouteTable::~RouteTable() = default;
+
+void RouteTable::Validate(fs::path const& path) const
+{
+  auto const& header = *reinterpret_cast<RouteTableHeader const*>(data);
+  if (header.magic != ROUTE_TABLE_MAGIC) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Route table has the wrong magic"}
+                        << ErrorHeaderMagic{header.magic} << ErrorFile{path});
+  }
+
+  if (header.version != ROUTE_TABLE_VERSION) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Route table has the wrong version"}
+                        << ErrorHeaderVersion{header.version}
+                        << ErrorFile{path});
+  }
+
+  // everything GetRoute reads has to be in the file, check it all up front
+  uint64_t const pois = header.poi_count;
+  uint64_t const index_end = sizeof(RouteTableHeader) +
+                             pois * sizeof(RoutePoiRecord) +
+                             pois * pois * sizeof(RouteRecord);
+  bool valid = index_end <= header.points_offset &&
+               uint64_t(header.points_offset) + header.points_size <= size;
+
+  auto const* routes = reinterpret_cast<RouteRecord const*>(
+    data + sizeof(RouteTableHeader) + pois * sizeof(RoutePoiRecord));
+  for (uint64_t i = 0; valid && i < pois * pois; ++i) {
+    valid = routes[i].count == 0 ||
+            (routes[i].offset % 4 == 0 &&
+             uint64_t(routes[i].offset) + RouteDataSize(routes[i].count) <=
+               header.points_size);
+  }
+
+  if (!valid) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Route table is truncated or corrupt"}
+                        << ErrorMapId{header.map_id} << ErrorFile{path});
+  }
+}
+
+uint32_t RouteTable::GetMapId() const
+{
+  return reinterpret_cast<RouteTableHeader const*>(data)->map_id;
+}
+
+uint32_t RouteTable::GetPoiCount() const
+{
+  return reinterpret_cast<RouteTableHeader const*>(data)->poi_count;
+}
+
+RoutePoi RouteTable::GetPoi(uint32_t const index) const
+{
+  HADESMEM_DETAIL_ASSERT(index < GetPoiCount());
+  auto const* pois = reinterpret_cast<RoutePoiRecord const*>(
+    data + sizeof(RouteTableHeader));
+  auto const& poi = pois[index];
+  return RoutePoi{poi.id, vec3{poi.pos[0], poi.pos[1], poi.pos[2]}};
+}
+
+boost::optional<uint32_t> RouteTable::FindPoi(vec3 const& pos,
+                                              float const radius) const
+{
+  boost::optional<uint32_t> nearest;
+  float nearest_dist = radius;
+  for (uint32_t i = 0; i < GetPoiCount(); ++i) {
+    float const dist = distance(GetPoi(i).position, pos);
+    if (dist <= nearest_dist) {
+      nearest = i;
+      nearest_dist = dist;
+    }
+  }
+  return nearest;
+}
+
+bool RouteTable::GetRoute(uint32_t const from,
+                          uint32_t const to,
+                          PointsArray& path) const
+{
+  uint32_t const pois = GetPoiCount();
+  HADESMEM_DETAIL_ASSERT(from < pois && to < pois);
+
+  auto const& header = *reinterpret_cast<RouteTableHeader const*>(data);
+  auto const* routes = reinterpret_cast<RouteRecord const*>(
+    data + sizeof(RouteTableHeader) + pois * sizeof(RoutePoiRecord));
+  RouteRecord const& route = routes[from * pois + to];
+  if (route.count == 0) {
+    return false;
+  }
+
+  unsigned char const* points = data + header.points_offset + route.offset;
+  float first[3];
+  std::memcpy(first, points, sizeof(first));
+  auto const* deltas = reinterpret_cast<int16_t const*>(points + sizeof(first));
+
+  path.clear();
+  path.reserve(route.count);
+
+  vec3 pos{first[0], first[1], first[2]};
+  path.push_back(pos);
+  for (uint32_t i = 1; i < route.count; ++i, deltas += 3) {
+    pos += vec3{float(deltas[0]), float(deltas[1]), float(deltas[2])} /
+           ROUTE_DELTA_SCALE;
+    path.push_back(pos);
+  }
+
+  return true;
+}
+
+float RouteTable::GetRouteLength(uint32_t const from, uint32_t const to) const
+{
+  uint32_t const pois = GetPoiCount();
+  HADESMEM_DETAIL_ASSERT(from < pois && to < pois);
+
+  auto const* routes = reinterpret_cast<RouteRecord const*>(
+    data + sizeof(RouteTableHeader) + pois * sizeof(RoutePoiRecord));
+  return routes[from * pois + to].length;
+}
+
+void BuildRouteTable(MMapManager& mmap,
+                     uint32_t const map_id,
+                     vector<RoutePoi> const& pois,
+                     fs::path const& path)
+{
+  uint32_t const poi_count = uint32_t(pois.size());
+
+  PathFinder path_info{mmap, map_id};
+  path_info.setUseStrightPath(true);
+
+  vector<RouteRecord> routes(poi_count * poi_count, RouteRecord{0, 0, 0.0f});
+  vector<unsigned char> points;
+  uint32_t found = 0;
+
+  for (uint32_t from = 0; from < poi_count; ++from) {
+    for (uint32_t to = 0; to < poi_count; ++to) {
+      if (from == to) {
+        continue;
+      }
+
+      vec3 const& src = pois[from].position;
+      vec3 const& dest = pois[to].position;
+      LoadTilesBetween(mmap, map_id, src, dest);
+
+      // roads between hubs wind, leave plenty of room
+      path_info.setPathLengthLimit(
+        std::max(3.0f * distance(src, dest), 200.0f));
+      path_info.calculate(src, dest);
+      if (!path_info.getPathType().test(PathFlag::PATHFIND_NORMAL)) {
+        HADESMEM_DETAIL_TRACE_FORMAT_A(
+          "No route from POI %u to POI %u on map %03u, type %s", pois[from].id,
+          pois[to].id, map_id, path_info.getPathType().to_string().c_str());
+        continue;
+      }
+
+      RouteRecord& route = routes[from * poi_count + to];
+      route.offset = uint32_t(points.size());
+      route.count = EncodeRoute(path_info.getPath(), points);
+      route.length = path_info.Length();
+      ++found;
+    }
+  }
+
+  RouteTableHeader const header{
+    ROUTE_TABLE_MAGIC,
+    ROUTE_TABLE_VERSION,
+    map_id,
+    poi_count,
+    uint32_t(sizeof(RouteTableHeader) + pois.size() * sizeof(RoutePoiRecord) +
+             routes.size() * sizeof(RouteRecord)),
+    uint32_t(points.size())};
+
+  fs::create_directories(path.parent_path());
+  std::ofstream out{path, std::ios::binary | std::ios::trunc};
+  if (!out) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to open route table"}
+                        << ErrorFile{path});
+  }
+
+  out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  for (auto const& poi : pois) {
+    RoutePoiRecord const record{
+      poi.id, {poi.position.x, poi.position.y, poi.position.z}};
+    out.write(reinterpret_cast<char const*>(&record), sizeof(record));
+  }
+  out.write(reinterpret_cast<char const*>(routes.data()),
+            routes.size() * sizeof(RouteRecord));
+  out.write(reinterpret_cast<char const*>(points.data()), points.size());
+
+  if (!out) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to write route table"}
+                        << ErrorFile{path});
+  }
+
+  HADESMEM_DETAIL_TRACE_FORMAT_A(
+    "Wrote %u of %u routes between %u POIs on map %03u, %zu bytes of points",
+    found, poi_count * (poi_count - 1), poi_count, map_id, points.size());
+}
+
+vector<std::pair<uint32_t, RoutePoi>> LoadPoiList(fs::path const& path)
+{
+  std::ifstream in{path};
+  if (!in) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << ErrorString{"Failed to open POI list"}
+                        << ErrorFile{path});
+  }
+
+  vector<std::pair<uint32_t, RoutePoi>> pois;
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+
+    std::istringstream fields{line};
+    uint32_t map_id;
+    RoutePoi poi;
+    if (!(fields >> map_id >> poi.id >> poi.position.x >> poi.position.y >>
+          poi.position.z)) {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error{} << ErrorString{"Bad line in POI list"}
+                          << hadesmem::ErrorStringOther{line}
+                          << ErrorFile{path});
+    }
+    pois.emplace_back(map_id, poi);
+  }
+
+  return pois;
+}
+
+bool ConnectRoute(RouteTable const& table,
+                  PathFinder& path_info,
+                  vec3 const& src,
+                  vec3 const& dest,
+                  PointsArray& path)
+{
+  auto const to = table.FindPoi(dest, ROUTE_POI_RADIUS);
+  auto const from = table.FindPoi(src, ROUTE_JOIN_RADIUS);
+  if (!to || !from || *to == *from) {
+    return false;
+  }
+
+  PointsArray route;
+  if (!table.GetRoute(*from, *to, route)) {
+    return false;
+  }
+
+  // join at the route point nearest to us, which skips whatever part of the
+  // route we're already past
+  size_t join = 0;
+  for (size_t i = 1; i < route.size(); ++i) {
+    if (distance(route[i], src) < distance(route[join], src)) {
+      join = i;
+    }
+  }
+  if (distance(route[join], src) > ROUTE_JOIN_RADIUS) {
+    return false;
+  }
+
+  path_info.calculate(src, route[join]);
+  if (!path_info.getPathType().test(PathFlag::PATHFIND_NORMAL)) {
+    return false;
+  }
+
+  path = path_info.getPath();
+  path.insert(path.end(), route.begin() + join + 1, route.end());
+  return true;
+}
+
+namespace test
+{
+namespace
+{
+// a wall across the middle of each of 2 tiles, with a gap in the middle
+struct RouteFixture {
+  RouteFixture()
+  {
+    terrain.tiles = vec2i{2, 1};
+    terrain.walls_per_tile = 1;
+    GenerateSyntheticMMaps(mmap_dir, terrain);
+
+    float const g = MMAP_GRID_SIZE;
+    pois = {
+      RoutePoi{100, vec3{-1.5f * g + 20.0f, -0.25f * g, 0.0f}},
+      RoutePoi{200, vec3{-0.5f * g + 20.0f, -0.25f * g, 0.0f}},
+      RoutePoi{300, vec3{-0.75f * g, -0.75f * g, 0.0f}},
+    };
+  }
+
+  SyntheticTerrain terrain;
+  fs::path const dir = SyntheticMMapDir("routes");
+  fs::path const mmap_dir = dir / "mmaps";
+  fs::path const table_path = dir / "000.routes";
+  vector<RoutePoi> pois;
+};
+}
+
+TEST_CASE("RouteTable round trips the routes BuildRouteTable found")
+{
+  RouteFixture fixture;
+  MMapManager mmap{fixture.mmap_dir};
+  BuildRouteTable(mmap, fixture.terrain.map_id, fixture.pois,
+                  fixture.table_path);
+
+  RouteTable const table{fixture.table_path};
+  CHECK(table.GetMapId() == fixture.terrain.map_id);
+  REQUIRE(table.GetPoiCount() == fixture.pois.size());
+  CHECK(table.GetPoi(1).id == 200);
+  CHECK(table.GetPoi(1).position == fixture.pois[1].position);
+
+  CHECK(table.FindPoi(fixture.pois[2].position + vec3{3.0f, 0, 0}, 5.0f) ==
+        uint32_t{2});
+  CHECK(!table.FindPoi(vec3{0, 0, 0}, 5.0f));
+
+  PointsArray route;
+  CHECK(!table.GetRoute(0, 0, route));
+
+  PathFinder path_info{mmap, fixture.terrain.map_id};
+  path_info.setUseStrightPath(true);
+  path_info.setPathLengthLimit(2 * MMAP_GRID_SIZE);
+
+  for (uint32_t from = 0; from < table.GetPoiCount(); ++from) {
+    for (uint32_t to = 0; to < table.GetPoiCount(); ++to) {
+      if (from == to) {
+        continue;
+      }
+
+      REQUIRE(table.GetRoute(from, to, route));
+      REQUIRE(
+        path_info.calculate(fixture.pois[from].position,
+                            fixture.pois[to].position));
+      auto const& expected = path_info.getPath();
+
+      REQUIRE(route.size() == expected.size());
+      for (size_t i = 0; i < route.size(); ++i) {
+        CHECK(distance(route[i], expected[i]) < 0.2f);
+      }
+      CHECK(table.GetRouteLength(from, to) ==
+            doctest::Approx(path_info.Length()));
+    }
+  }
+}
+
+TEST_CASE("ConnectRoute joins a route from near its start")
+{
+  RouteFixture fixture;
+  MMapManager mmap{fixture.mmap_dir};
+  BuildRouteTable(mmap, fixture.terrain.map_id, fixture.pois,
+                  fixture.table_path);
+  RouteTable const table{fixture.table_path};
+
+  PathFinder path_info{mmap, fixture.terrain.map_id};
+  vec3 const src = fixture.pois[0].position + vec3{-15.0f, 20.0f, 0.0f};
+  vec3 const dest = fixture.pois[1].position;
+
+  PointsArray path;
+  REQUIRE(ConnectRoute(table, path_info, src, dest, path));
+  REQUIRE(path.size() >= 2);
+  CHECK(distance(path.front(), src) < 1.0f);
+  CHECK(distance(path.back(), dest) < 1.0f);
+
+  // dest isn't a POI, or we're nowhere near one
+  CHECK(!ConnectRoute(table, path_info, src, dest + vec3{50.0f, 0, 0}, path));
+  CHECK(!ConnectRoute(table, path_info,
+                      fixture.pois[0].position + vec3{0, 200.0f, 0}, dest,
+                      path));
+}
+
+TEST_CASE("RouteTable rejects files that aren't route tables")
+{
+  fs::path const path = fs::temp_directory_path() / "phlipbot_bad.routes";
+  {
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out << "definitely not a route table";
+  }
+
+  CHECK_THROWS_AS(RouteTable{path}, hadesmem::Error);
+
+  fs::remove(path);
+}
+
+// The offline tool: point PHLIPBOT_POI_LIST at a POI list (see LoadPoiList)
+// and run
+//
+//   phlipbot_unittest --no-skip --test-suite=tool
+//
+// to write a MMM.routes table per map into PHLIPBOT_ROUTE_DIR, or next to
+// the mmaps by default.
+TEST_CASE("tool build route tables from a POI list" *
+          doctest::test_suite("tool") * doctest::skip())
+{
+  char const* const poi_list = std::getenv("PHLIPBOT_POI_LIST");
+  REQUIRE(poi_list != nullptr);
+  char const* const env_dir = std::getenv("PHLIPBOT_ROUTE_DIR");
+  fs::path const route_dir = env_dir ? env_dir : "C:\\MaNGOS\\data\\routes";
+
+  std::map<uint32_t, vector<RoutePoi>> maps;
+  for (auto const& pair : LoadPoiList(poi_list)) {
+    maps[pair.first].push_back(pair.second);
+  }
+  REQUIRE(!maps.empty());
+
+  for (auto const& pair : maps) {
+    // a fresh manager per map, so the last map's tiles don't pile up
+    MMapManager mmap{"C:\\MaNGOS\\data\\__mmaps"};
+
+    char filename[16];
+    snprintf(filename, sizeof(filename), "%03u.routes", pair.first);
+    BuildRouteTable(mmap, pair.first, pair.second, route_dir / filename);
+
+    RouteTable const table{route_dir / filename};
+    CHECK(table.GetPoiCount() == pair.second.size());
+  }
+}
+}
+}
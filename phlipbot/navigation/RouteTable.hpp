@@ -0,0 +1,87 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "MoveMap.hpp"
+#include "PathFinder.hpp"
+
+namespace phlipbot
+{
+// A fixed point of interest routes are precomputed between: a vendor,
+// trainer, flight master, grind spot...
+struct RoutePoi {
+  uint32_t id;
+  vec3 position;
+};
+
+// Paths between every pair of one map's POIs, computed offline with
+// BuildRouteTable and memory mapped at runtime, so travelling between them
+// doesn't search at all.
+//
+// Layout, all little endian and 4 byte aligned:
+//
+//   RouteTableHeader
+//   poi_count x {uint32 id, float x, y, z}
+//   poi_count^2 x {uint32 offset, uint32 point count, float length}, by
+//                 [from * poi_count + to], a point count of 0 is no route
+//   point data: per route its first point as 3 floats, then each next point
+//               as 3 int16 deltas in 1/8 yards, padded to 4 bytes
+//
+// The file stays mapped (read only) for as long as the RouteTable lives.
+class RouteTable {
+public:
+  explicit RouteTable(std::filesystem::path const& path);
+  ~RouteTable();
+  RouteTable(RouteTable const&) = delete;
+  RouteTable& operator=(RouteTable const&) = delete;
+
+  uint32_t GetMapId() const;
+  uint32_t GetPoiCount() const;
+  RoutePoi GetPoi(uint32_t const index) const;
+
+  // index of the POI nearest pos within radius yards
+  boost::optional<uint32_t> FindPoi(vec3 const& pos, float const radius) const;
+
+  // Decode the route between two POI indices into path. False if the build
+  // couldn't find one.
+  bool
+  GetRoute(uint32_t const from, uint32_t const to, PointsArray& path) const;
+  float GetRouteLength(uint32_t const from, uint32_t const to) const;
+
+private:
+  struct Mapping;
+
+  void Validate(std::filesystem::path const& path) const;
+
+  std::unique_ptr<Mapping> mapping;
+  unsigned char const* data{nullptr};
+  size_t size{0};
+};
+
+// Calculate the straight path between every pair of pois on map_id and write
+// them to path as a RouteTable. Loads the tiles around each pair as it goes,
+// and leaves them loaded. Pairs PathFinder can't find a complete path for
+// are left without a route.
+void BuildRouteTable(MMapManager& mmap,
+                     uint32_t const map_id,
+                     std::vector<RoutePoi> const& pois,
+                     std::filesystem::path const& path);
+
+// Parse a POI list, one "map_id id x y z" per line, '#' starts a comment.
+std::vector<std::pair<uint32_t, RoutePoi>>
+LoadPoiList(std::filesystem::path const& path);
+
+// If dest is one of table's POIs and src is near another one, calculate a
+// path from src onto the route between them with path_info and follow the
+// route from there. False (and path untouched) when the table can't help.
+bool ConnectRoute(RouteTable const& table,
+                  PathFinder& path_info,
+                  vec3 const& src,
+                  vec3 const& dest,
+                  PointsArray& path);
+}
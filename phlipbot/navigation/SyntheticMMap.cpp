@@ -0,0 +1,617 @@
+#include "SyntheticMMap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <boost/math/constants/constants.hpp>
+
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+
+#include <DetourNavMesh.h>
+#include <DetourNavMeshBuilder.h>
+#include <DetourNavMeshQuery.h>
+#include <Recast.h>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+#include "MoveMap.hpp"
+#include "MoveMapSharedDefines.hpp"
+#include "NavQueryFilter.hpp"
+#include "PathFinder.hpp"
+
+namespace fs = std::filesystem;
+
+using boost::math::float_constants::two_pi;
+
+using hadesmem::ErrorString;
+
+using std::unique_ptr;
+using std::vector;
+
+namespace
+{
+using phlipbot::SyntheticTerrain;
+using phlipbot::vec2;
+using phlipbot::vec2i;
+using phlipbot::vec3;
+
+// the agent the mesh is built for, roughly a player
+float const AgentHeight = 2.0f;
+float const AgentRadius = 0.6f;
+float const AgentMaxClimb = 1.0f;
+float const AgentMaxSlope = 50.0f; // degrees
+
+float const WallThickness = 2.0f;
+float const PlatformThickness = 1.0f;
+float const RampWidth = 8.0f;
+float const RampSlope = 0.35f; // rise over run, about 20 degrees
+
+// Triangle soup, in Recast's coordinates, i.e. {y, z, x} of the game's.
+struct TriMesh {
+  int AddVertex(vec3 const& p)
+  {
+    verts.insert(verts.end(), {p.y, p.z, p.x});
+    return int(verts.size() / 3) - 1;
+  }
+
+  // Triangles are counter clockwise seen from above. Anything steeper than
+  // the agent can walk up, or facing down, is unwalkable.
+  void AddTriangle(int const a, int const b, int const c, unsigned char area)
+  {
+    vec3 const pa = Vertex(a);
+    vec3 const normal = glm::normalize(
+      glm::cross(Vertex(b) - pa, Vertex(c) - pa));
+    float const min_z = std::cos(AgentMaxSlope / 360.0f * two_pi);
+    if (normal.z < min_z) {
+      area = RC_NULL_AREA;
+    }
+
+    tris.insert(tris.end(), {a, b, c});
+    areas.push_back(area);
+  }
+
+  void AddQuad(vec3 const& a,
+               vec3 const& b,
+               vec3 const& c,
+               vec3 const& d,
+               unsigned char const area)
+  {
+    int const ia = AddVertex(a);
+    int const ib = AddVertex(b);
+    int const ic = AddVertex(c);
+    int const id = AddVertex(d);
+    AddTriangle(ia, ib, ic, area);
+    AddTriangle(ia, ic, id, area);
+  }
+
+  // a solid box, only the top is walkable
+  void AddBox(vec3 const& lo, vec3 const& hi)
+  {
+    vec3 const c[8] = {
+      {lo.x, lo.y, lo.z}, {hi.x, lo.y, lo.z}, {hi.x, hi.y, lo.z},
+      {lo.x, hi.y, lo.z}, {lo.x, lo.y, hi.z}, {hi.x, lo.y, hi.z},
+      {hi.x, hi.y, hi.z}, {lo.x, hi.y, hi.z},
+    };
+    AddQuad(c[4], c[5], c[6], c[7], NAV_GROUND); // top
+    AddQuad(c[0], c[3], c[2], c[1], RC_NULL_AREA); // bottom
+    AddQuad(c[0], c[1], c[5], c[4], RC_NULL_AREA);
+    AddQuad(c[1], c[2], c[6], c[5], RC_NULL_AREA);
+    AddQuad(c[2], c[3], c[7], c[6], RC_NULL_AREA);
+    AddQuad(c[3], c[0], c[4], c[7], RC_NULL_AREA);
+  }
+
+  vec3 Vertex(int const i) const
+  {
+    return vec3{verts[3 * i + 2], verts[3 * i], verts[3 * i + 1]};
+  }
+
+  vector<float> verts;
+  vector<int> tris;
+  vector<unsigned char> areas;
+};
+
+vec2 TileMin(vec2i const& tile)
+{
+  return vec2{float(31 - tile.x) * MMAP_GRID_SIZE,
+              float(31 - tile.y) * MMAP_GRID_SIZE};
+}
+
+// The ground and, where it's under water_level, the water over it.
+void AddGround(TriMesh& mesh,
+               SyntheticTerrain const& terrain,
+               vec2 const& lo,
+               vec2 const& hi)
+{
+  int const nx = int(std::ceil((hi.x - lo.x) / terrain.grid_spacing));
+  int const ny = int(std::ceil((hi.y - lo.y) / terrain.grid_spacing));
+
+  auto const point = [&](int const i, int const j) {
+    vec2 const p{lo.x + (hi.x - lo.x) * i / nx, lo.y + (hi.y - lo.y) * j / ny};
+    return vec3{p, phlipbot::SyntheticGroundHeight(terrain, p)};
+  };
+
+  int const first = int(mesh.verts.size() / 3);
+  for (int j = 0; j <= ny; ++j) {
+    for (int i = 0; i <= nx; ++i) {
+      mesh.AddVertex(point(i, j));
+    }
+  }
+
+  auto const index = [&](int const i, int const j) {
+    return first + j * (nx + 1) + i;
+  };
+
+  for (int j = 0; j < ny; ++j) {
+    for (int i = 0; i < nx; ++i) {
+      mesh.AddTriangle(index(i, j), index(i + 1, j), index(i + 1, j + 1),
+                       NAV_GROUND);
+      mesh.AddTriangle(index(i, j), index(i + 1, j + 1), index(i, j + 1),
+                       NAV_GROUND);
+
+      if (!terrain.water) {
+        continue;
+      }
+
+      float const lowest = std::min({point(i, j).z, point(i + 1, j).z,
+                                     point(i + 1, j + 1).z, point(i, j + 1).z});
+      if (lowest < terrain.water_level) {
+        vec3 const a{point(i, j).xy, terrain.water_level};
+        vec3 const c{point(i + 1, j + 1).xy, terrain.water_level};
+        mesh.AddQuad(a, vec3{c.x, a.y, a.z}, c, vec3{a.x, c.y, a.z},
+                     terrain.liquid);
+      }
+    }
+  }
+}
+
+// The walls and platform on tile, which may stick out into its neighbours.
+void AddTileFeatures(TriMesh& mesh,
+                     SyntheticTerrain const& terrain,
+                     vec2i const& tile)
+{
+  vec2 const lo = TileMin(tile);
+  vec2 const hi = lo + vec2{MMAP_GRID_SIZE, MMAP_GRID_SIZE};
+  float const mid_y = (lo.y + hi.y) / 2;
+
+  float const bottom = terrain.ground_height - terrain.hill_height - 1.0f;
+  float const top =
+    terrain.ground_height + terrain.hill_height + terrain.wall_height;
+  for (uint32_t i = 0; i < terrain.walls_per_tile; ++i) {
+    float const x =
+      lo.x + MMAP_GRID_SIZE * (i + 1) / (terrain.walls_per_tile + 1);
+    float const x0 = x - WallThickness / 2;
+    float const x1 = x + WallThickness / 2;
+    mesh.AddBox(vec3{x0, lo.y, bottom},
+                vec3{x1, mid_y - terrain.wall_gap / 2, top});
+    mesh.AddBox(vec3{x0, mid_y + terrain.wall_gap / 2, bottom},
+                vec3{x1, hi.y, top});
+  }
+
+  if (terrain.platforms) {
+    vec3 const center = phlipbot::SyntheticPlatformCenter(terrain, tile);
+    float const half = terrain.platform_size / 2;
+    mesh.AddBox(vec3{center.x - half, center.y - half,
+                     center.z - PlatformThickness},
+                vec3{center.x + half, center.y + half, center.z});
+
+    // sink the bottom of the ramp into the ground so the two connect
+    float const x0 = center.x + half;
+    float const x1 = x0 + terrain.platform_height / RampSlope;
+    float const y0 = center.y - RampWidth / 2;
+    float const y1 = center.y + RampWidth / 2;
+    float const z1 =
+      phlipbot::SyntheticGroundHeight(terrain, vec2{x1, center.y}) - 0.5f;
+    mesh.AddQuad(vec3{x0, y0, center.z}, vec3{x1, y0, z1},
+                 vec3{x1, y1, z1}, vec3{x0, y1, center.z}, NAV_GROUND);
+  }
+}
+
+template <typename T>
+using RecastPtr = unique_ptr<T, void (*)(T*)>;
+
+[[noreturn]] void ThrowBuildError(char const* what,
+                                  SyntheticTerrain const& terrain,
+                                  vec2i const& tile)
+{
+  HADESMEM_DETAIL_THROW_EXCEPTION(hadesmem::Error{}
+                                  << ErrorString{what}
+                                  << phlipbot::ErrorMapId{terrain.map_id}
+                                  << phlipbot::ErrorMapTile{tile});
+}
+
+// Build one tile's nav mesh data, same as the extractor does, but from
+// mesh instead of the game's terrain. Returns the dtCreateNavMeshData buffer.
+RecastPtr<unsigned char> BuildTile(SyntheticTerrain const& terrain,
+                                   vec2i const& tile,
+                                   int* data_size,
+                                   int* poly_count)
+{
+  // a whole number of cells per tile, so the tile edges line up
+  int const tile_cells =
+    std::max(1, int(std::round(MMAP_GRID_SIZE / terrain.cell_size)));
+
+  rcConfig cfg{};
+  cfg.cs = MMAP_GRID_SIZE / tile_cells;
+  cfg.ch = terrain.cell_height;
+  cfg.walkableSlopeAngle = AgentMaxSlope;
+  cfg.walkableHeight = int(std::ceil(AgentHeight / cfg.ch));
+  cfg.walkableClimb = int(std::floor(AgentMaxClimb / cfg.ch));
+  cfg.walkableRadius = int(std::ceil(AgentRadius / cfg.cs));
+  cfg.maxEdgeLen = int(12.0f / cfg.cs);
+  cfg.maxSimplificationError = 1.3f;
+  cfg.minRegionArea = 8 * 8;
+  cfg.mergeRegionArea = 20 * 20;
+  cfg.maxVertsPerPoly = DT_VERTS_PER_POLYGON;
+  cfg.tileSize = tile_cells;
+  cfg.borderSize = cfg.walkableRadius + 3;
+  cfg.width = cfg.tileSize + 2 * cfg.borderSize;
+  cfg.height = cfg.tileSize + 2 * cfg.borderSize;
+  cfg.detailSampleDist = 6.0f * cfg.cs;
+  cfg.detailSampleMaxError = cfg.ch;
+
+  float const border = cfg.borderSize * cfg.cs;
+  vec2 const lo = TileMin(tile) - vec2{border, border};
+  vec2 const hi = TileMin(tile) + vec2{MMAP_GRID_SIZE + border,
+                                       MMAP_GRID_SIZE + border};
+
+  TriMesh mesh;
+  AddGround(mesh, terrain, lo, hi);
+  for (int i = -1; i <= 1; ++i) {
+    for (int j = -1; j <= 1; ++j) {
+      AddTileFeatures(mesh, terrain, tile + vec2i{i, j});
+    }
+  }
+
+  float min_z = mesh.verts[1];
+  float max_z = mesh.verts[1];
+  for (size_t i = 1; i < mesh.verts.size(); i += 3) {
+    min_z = std::min(min_z, mesh.verts[i]);
+    max_z = std::max(max_z, mesh.verts[i]);
+  }
+
+  // Recast's {y, z, x}
+  cfg.bmin[0] = lo.y;
+  cfg.bmin[1] = min_z;
+  cfg.bmin[2] = lo.x;
+  cfg.bmax[0] = hi.y;
+  cfg.bmax[1] = max_z;
+  cfg.bmax[2] = hi.x;
+
+  rcContext ctx{false};
+
+  RecastPtr<rcHeightfield> solid{rcAllocHeightfield(), &rcFreeHeightField};
+  if (!solid || !rcCreateHeightfield(&ctx, *solid, cfg.width, cfg.height,
+                                     cfg.bmin, cfg.bmax, cfg.cs, cfg.ch)) {
+    ThrowBuildError("Failed to create heightfield", terrain, tile);
+  }
+
+  if (!rcRasterizeTriangles(&ctx, mesh.verts.data(),
+                            int(mesh.verts.size() / 3), mesh.tris.data(),
+                            mesh.areas.data(), int(mesh.areas.size()),
+                            *solid, cfg.walkableClimb)) {
+    ThrowBuildError("Failed to rasterize triangles", terrain, tile);
+  }
+
+  rcFilterLowHangingWalkableObstacles(&ctx, cfg.walkableClimb, *solid);
+  rcFilterLedgeSpans(&ctx, cfg.walkableHeight, cfg.walkableClimb, *solid);
+  rcFilterWalkableLowHeightSpans(&ctx, cfg.walkableHeight, *solid);
+
+  RecastPtr<rcCompactHeightfield> chf{rcAllocCompactHeightfield(),
+                                      &rcFreeCompactHeightfield};
+  if (!chf || !rcBuildCompactHeightfield(&ctx, cfg.walkableHeight,
+                                         cfg.walkableClimb, *solid, *chf)) {
+    ThrowBuildError("Failed to build compact heightfield", terrain, tile);
+  }
+  solid.reset();
+
+  if (!rcErodeWalkableArea(&ctx, cfg.walkableRadius, *chf) ||
+      !rcBuildDistanceField(&ctx, *chf) ||
+      !rcBuildRegions(&ctx, *chf, cfg.borderSize, cfg.minRegionArea,
+                      cfg.mergeRegionArea)) {
+    ThrowBuildError("Failed to build regions", terrain, tile);
+  }
+
+  RecastPtr<rcContourSet> cset{rcAllocContourSet(), &rcFreeContourSet};
+  if (!cset || !rcBuildContours(&ctx, *chf, cfg.maxSimplificationError,
+                                cfg.maxEdgeLen, *cset)) {
+    ThrowBuildError("Failed to build contours", terrain, tile);
+  }
+
+  RecastPtr<rcPolyMesh> pmesh{rcAllocPolyMesh(), &rcFreePolyMesh};
+  if (!pmesh || !rcBuildPolyMesh(&ctx, *cset, cfg.maxVertsPerPoly, *pmesh)) {
+    ThrowBuildError("Failed to build poly mesh", terrain, tile);
+  }
+
+  RecastPtr<rcPolyMeshDetail> dmesh{rcAllocPolyMeshDetail(),
+                                    &rcFreePolyMeshDetail};
+  if (!dmesh ||
+      !rcBuildPolyMeshDetail(&ctx, *pmesh, *chf, cfg.detailSampleDist,
+                             cfg.detailSampleMaxError, *dmesh)) {
+    ThrowBuildError("Failed to build detail mesh", terrain, tile);
+  }
+
+  // like the extractor, a poly's flags are its terrain type
+  for (int i = 0; i < pmesh->npolys; ++i) {
+    pmesh->flags[i] = pmesh->areas[i];
+  }
+
+  dtNavMeshCreateParams params{};
+  params.verts = pmesh->verts;
+  params.vertCount = pmesh->nverts;
+  params.polys = pmesh->polys;
+  params.polyAreas = pmesh->areas;
+  params.polyFlags = pmesh->flags;
+  params.polyCount = pmesh->npolys;
+  params.nvp = pmesh->nvp;
+  params.detailMeshes = dmesh->meshes;
+  params.detailVerts = dmesh->verts;
+  params.detailVertsCount = dmesh->nverts;
+  params.detailTris = dmesh->tris;
+  params.detailTriCount = dmesh->ntris;
+  params.walkableHeight = AgentHeight;
+  params.walkableRadius = AgentRadius;
+  params.walkableClimb = AgentMaxClimb;
+  // the nav mesh origin is tile {63, 63}, so Detour's tile {x, y} covers
+  // Recast's x, i.e. the game's y
+  params.tileX = 63 - tile.y;
+  params.tileY = 63 - tile.x;
+  params.tileLayer = 0;
+  std::copy(pmesh->bmin, pmesh->bmin + 3, params.bmin);
+  std::copy(pmesh->bmax, pmesh->bmax + 3, params.bmax);
+  params.cs = cfg.cs;
+  params.ch = cfg.ch;
+  params.buildBvTree = true;
+
+  unsigned char* data = nullptr;
+  if (!dtCreateNavMeshData(&params, &data, data_size)) {
+    ThrowBuildError("Failed to create nav mesh data", terrain, tile);
+  }
+
+  *poly_count = pmesh->npolys;
+  return RecastPtr<unsigned char>{data, [](unsigned char* p) { dtFree(p); }};
+}
+
+void WriteFile(fs::path const& path, void const* data, size_t const size)
+{
+  std::ofstream out{path, std::ios::binary | std::ios::app};
+  if (!out.write(static_cast<char const*>(data), size)) {
+    HADESMEM_DETAIL_THROW_EXCEPTION(hadesmem::Error{}
+                                    << ErrorString{"Failed to write file"}
+                                    << phlipbot::ErrorFile{path});
+  }
+}
+}
+
+namespace phlipbot
+{
+float SyntheticGroundHeight(SyntheticTerrain const& terrain, vec2 const& pos)
+{
+  float const k = two_pi / terrain.hill_wavelength;
+  return terrain.ground_height +
+         terrain.hill_height * std::sin(k * pos.x) * std::cos(k * pos.y);
+}
+
+vec3 SyntheticPlatformCenter(SyntheticTerrain const& terrain,
+                             vec2i const& tile)
+{
+  // a quarter of the way into the tile, out of the way of a single wall
+  vec2 const center =
+    TileMin(tile) + vec2{MMAP_GRID_SIZE / 4, MMAP_GRID_SIZE / 4};
+  return vec3{center, SyntheticGroundHeight(terrain, center) +
+                        terrain.platform_height};
+}
+
+void GenerateSyntheticMMaps(fs::path const& mmap_dir,
+                            SyntheticTerrain const& terrain)
+{
+  fs::create_directories(mmap_dir);
+
+  int max_polys = 1;
+  for (int x = 0; x < terrain.tiles.x; ++x) {
+    for (int y = 0; y < terrain.tiles.y; ++y) {
+      vec2i const tile = terrain.first_tile + vec2i{x, y};
+
+      int data_size = 0;
+      int poly_count = 0;
+      auto const data = BuildTile(terrain, tile, &data_size, &poly_count);
+      max_polys = std::max(max_polys, poly_count);
+
+      char filename[20];
+      snprintf(filename, sizeof(filename), "%03u%02d%02d.mmtile",
+               terrain.map_id, tile.x, tile.y);
+      fs::path const tile_path = mmap_dir / filename;
+      fs::remove(tile_path);
+
+      MmapTileHeader header;
+      header.size = uint32_t(data_size);
+      header.usesLiquids = terrain.water;
+      WriteFile(tile_path, &header, sizeof(header));
+      WriteFile(tile_path, data.get(), size_t(data_size));
+    }
+  }
+
+  dtNavMeshParams params{};
+  params.orig[0] = -32 * MMAP_GRID_SIZE;
+  params.orig[1] = 0.0f;
+  params.orig[2] = -32 * MMAP_GRID_SIZE;
+  params.tileWidth = MMAP_GRID_SIZE;
+  params.tileHeight = MMAP_GRID_SIZE;
+  params.maxTiles = terrain.tiles.x * terrain.tiles.y;
+  params.maxPolys = max_polys;
+
+  char filename[10];
+  snprintf(filename, sizeof(filename), "%03u.mmap", terrain.map_id);
+  fs::path const mmap_path = mmap_dir / filename;
+  fs::remove(mmap_path);
+  WriteFile(mmap_path, &params, sizeof(params));
+
+  HADESMEM_DETAIL_TRACE_FORMAT_A("Generated %d synthetic tiles for map %03u",
+                                 params.maxTiles, terrain.map_id);
+}
+
+fs::path SyntheticMMapDir(char const* name)
+{
+  return fs::temp_directory_path() / "phlipbot_synthetic_mmaps" / name;
+}
+
+namespace test
+{
+TEST_CASE("Synthetic walls make paths detour through the gaps, across tiles")
+{
+  SyntheticTerrain terrain;
+  terrain.tiles = vec2i{2, 1};
+  terrain.walls_per_tile = 1;
+
+  fs::path const dir = SyntheticMMapDir("walls");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  // east of the wall in tile {33, 32}, to east of the wall in tile {32, 32}
+  float const g = MMAP_GRID_SIZE;
+  vec3 const start{-1.5f * g + 20.0f, -0.25f * g, 0.0f};
+  vec3 const end{-0.5f * g + 20.0f, -0.25f * g, 0.0f};
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMapAround(terrain.map_id, start.xy));
+
+  PathFinder path_info{mmap, terrain.map_id};
+  path_info.setPathLengthLimit(2 * g);
+  REQUIRE(path_info.calculate(start, end));
+  CHECK(path_info.getPathType().test(PathFlag::PATHFIND_NORMAL));
+  // through the gap in the middle of the tile, not straight across
+  CHECK(path_info.Length() > 1.15f * glm::distance(start, end));
+}
+
+TEST_CASE("Synthetic platforms have walkable ground beneath them")
+{
+  SyntheticTerrain terrain;
+  terrain.platforms = true;
+
+  fs::path const dir = SyntheticMMapDir("platforms");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  vec3 const top = SyntheticPlatformCenter(terrain, terrain.first_tile);
+  vec3 const beneath{top.xy, terrain.ground_height};
+  vec3 const start{top.x - terrain.platform_size, top.y,
+                   terrain.ground_height};
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMapAround(terrain.map_id, start.xy));
+  PathFinder path_info{mmap, terrain.map_id};
+
+  REQUIRE(path_info.calculate(start, top));
+  CHECK(path_info.getPathType().test(PathFlag::PATHFIND_NORMAL));
+  CHECK(std::abs(path_info.getPath().back().z - top.z) < 1.0f);
+  // around to the ramp on the far side
+  CHECK(path_info.Length() > 2.0f * glm::distance(start, top));
+
+  REQUIRE(path_info.calculate(start, beneath));
+  CHECK(path_info.getPathType().test(PathFlag::PATHFIND_NORMAL));
+  CHECK(std::abs(path_info.getPath().back().z - beneath.z) < 1.0f);
+}
+
+TEST_CASE("Synthetic water covers the hill troughs and leaves islands")
+{
+  SyntheticTerrain terrain;
+  terrain.hill_height = 10.0f;
+  terrain.hill_wavelength = 120.0f;
+  terrain.water = true;
+  terrain.water_level = 0.0f;
+
+  fs::path const dir = SyntheticMMapDir("islands");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  // sin(k x) cos(k y) is -1 at the trough and 1 on the crests
+  vec3 const trough{-150.0f, -120.0f, terrain.water_level};
+  vec3 const island{-90.0f, -120.0f, 10.0f};
+  vec3 const other_island{-90.0f, -240.0f, 10.0f};
+  CHECK(SyntheticGroundHeight(terrain, trough.xy) < terrain.water_level);
+  CHECK(SyntheticGroundHeight(terrain, island.xy) > terrain.water_level);
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMapAround(terrain.map_id, island.xy));
+  dtNavMeshQuery const* query = mmap.GetNavMeshQuery(terrain.map_id);
+  dtNavMesh const* nav = mmap.GetNavMesh(terrain.map_id);
+  REQUIRE(query != nullptr);
+  REQUIRE(nav != nullptr);
+
+  dtQueryFilter const filter = PlayerFilter::toQueryFilter();
+  float const extents[3] = {2.0f, 2.0f, 2.0f};
+  auto const area_at = [&](vec3 const& p) {
+    float const pYZX[3] = {p.y, p.z, p.x};
+    dtPolyRef ref = 0;
+    float nearest[3];
+    query->findNearestPoly(pYZX, extents, &filter, &ref, nearest);
+    unsigned char area = RC_NULL_AREA;
+    nav->getPolyArea(ref, &area);
+    return area;
+  };
+
+  CHECK(area_at(trough) == NAV_WATER);
+  CHECK(area_at(island) == NAV_GROUND);
+
+  // swimming across to the next one
+  PathFinder path_info{mmap, terrain.map_id};
+  REQUIRE(path_info.calculate(island, other_island));
+  CHECK(path_info.getPathType().test(PathFlag::PATHFIND_NORMAL));
+}
+
+TEST_CASE("benchmark PathFinder on a generated 4x4 tile map" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  SyntheticTerrain terrain;
+  terrain.first_tile = vec2i{30, 30};
+  terrain.tiles = vec2i{4, 4};
+  terrain.hill_height = 12.0f;
+  terrain.hill_wavelength = 200.0f;
+  terrain.water = true;
+  terrain.water_level = -6.0f;
+  terrain.walls_per_tile = 1;
+  terrain.platforms = true;
+
+  fs::path const dir = SyntheticMMapDir("bench");
+  double const generate_us =
+    bench::TimeMicros(1, [&]() { GenerateSyntheticMMaps(dir, terrain); });
+  bench::Report("GenerateSyntheticMMaps 4x4 tiles", generate_us);
+
+  MMapManager mmap{dir};
+  vec2 const lo = TileMin(terrain.first_tile + terrain.tiles - vec2i{1, 1});
+  vec2 const size = vec2{float(terrain.tiles.x), float(terrain.tiles.y)} *
+                    MMAP_GRID_SIZE;
+  for (int x = 0; x < terrain.tiles.x; ++x) {
+    for (int y = 0; y < terrain.tiles.y; ++y) {
+      REQUIRE(mmap.loadMap(terrain.map_id, terrain.first_tile + vec2i{x, y}));
+    }
+  }
+
+  // the same random queries every run
+  std::mt19937 rng{1234};
+  std::uniform_real_distribution<float> along{0.05f, 0.95f};
+  auto const random_point = [&]() {
+    vec2 const p{lo.x + along(rng) * size.x, lo.y + along(rng) * size.y};
+    return vec3{p, SyntheticGroundHeight(terrain, p)};
+  };
+
+  size_t const query_count = 200;
+  vector<vec3> points;
+  for (size_t i = 0; i < 2 * query_count; ++i) {
+    points.push_back(random_point());
+  }
+
+  PathFinder path_info{mmap, terrain.map_id};
+  path_info.setPathLengthLimit(2 * glm::length(size));
+  size_t i = 0;
+  double const calculate_us = bench::TimeMicros(query_count, [&]() {
+    path_info.calculate(points[2 * i], points[2 * i + 1]);
+    bench::DoNotOptimize(path_info.getPath().size());
+    ++i;
+  });
+  bench::Report("PathFinder::calculate, generated 4x4 tiles", calculate_us);
+}
+}
+}
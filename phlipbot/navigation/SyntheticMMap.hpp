@@ -0,0 +1,74 @@
+#pragma once
+
+#include <filesystem>
+#include <stdint.h>
+
+#include "../wow_constants.hpp"
+#include "MoveMapSharedDefines.hpp"
+
+namespace phlipbot
+{
+// Procedural terrain to build test mmaps from. Every feature is off by
+// default, so the default is a flat plane at ground_height.
+//
+// Positions are in game coordinates, and tiles are numbered like the
+// extracted ones, i.e. tile {x, y} covers game x in
+// [(31 - x) * MMAP_GRID_SIZE, (32 - x) * MMAP_GRID_SIZE] (same for y).
+struct SyntheticTerrain {
+  uint32_t map_id{0};
+
+  // generates tiles first_tile .. first_tile + tiles - 1
+  vec2i first_tile{32, 32};
+  vec2i tiles{1, 1};
+
+  // Recast voxel size. The extractor uses ~0.27, which is much slower to
+  // build and not any more interesting for tests.
+  float cell_size{1.0f};
+  float cell_height{0.25f};
+  // spacing of the ground mesh vertices
+  float grid_spacing{4.0f};
+
+  float ground_height{0.0f};
+
+  // rolling hills, hill_height above and below ground_height
+  float hill_height{0.0f};
+  float hill_wavelength{120.0f};
+
+  // A liquid surface wherever the ground dips below water_level. With
+  // water_level between ground_height +- hill_height, the hill tops become
+  // islands.
+  bool water{false};
+  float water_level{0.0f};
+  // what the liquid surface is made of
+  NavTerrain liquid{NAV_WATER};
+
+  // walls along y, evenly spaced across each tile, each with a gap in the
+  // middle of the tile
+  uint32_t walls_per_tile{0};
+  float wall_height{10.0f};
+  float wall_gap{12.0f};
+
+  // a square platform platform_height above the middle of each tile, with a
+  // ramp down to the ground on its +x side and walkable ground beneath it
+  bool platforms{false};
+  float platform_height{8.0f};
+  float platform_size{60.0f};
+};
+
+// Height of the terrain's ground (ignoring walls and platforms) at pos.
+float SyntheticGroundHeight(SyntheticTerrain const& terrain, vec2 const& pos);
+
+// Center of the platform on tile, on its walkable surface.
+vec3 SyntheticPlatformCenter(SyntheticTerrain const& terrain,
+                             vec2i const& tile);
+
+// Build the terrain's nav mesh with Recast and write it to mmap_dir as a
+// .mmap and .mmtile's in the same format as the extractor, so MMapManager
+// loads it like any other map. Existing files are overwritten.
+void GenerateSyntheticMMaps(std::filesystem::path const& mmap_dir,
+                            SyntheticTerrain const& terrain);
+
+// A scratch directory to generate the synthetic mmaps called name in, under
+// the temp directory.
+std::filesystem::path SyntheticMMapDir(char const* name);
+}
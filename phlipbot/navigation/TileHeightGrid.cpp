@@ -0,0 +1,303 @@
+#include "TileHeightGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include <glm/common.hpp>
+
+#include <doctest.h>
+
+#include "../bench_helpers.hpp"
+#include "MoveMap.hpp"
+#include "SyntheticMMap.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+float const NoHeight = std::numeric_limits<float>::quiet_NaN();
+float const AmbiguousHeight = std::numeric_limits<float>::infinity();
+
+// detail tri vertices index the poly's vertices first, then its own
+float const* DetailVertex(dtMeshTile const& tile,
+                          dtPoly const& poly,
+                          dtPolyDetail const& detail,
+                          unsigned char const index)
+{
+  if (index < poly.vertCount) {
+    return &tile.verts[poly.verts[index] * 3];
+  }
+  return &tile.detailVerts[(detail.vertBase + index - poly.vertCount) * 3];
+}
+}
+
+namespace phlipbot
+{
+TileHeightGrid::TileHeightGrid(dtMeshTile const& tile)
+  : heights(Size * Size, NoHeight)
+{
+  dtMeshHeader const& header = *tile.header;
+
+  // Recast's {y, z, x}
+  min = vec2{header.bmin[2], header.bmin[0]};
+  max = vec2{header.bmax[2], header.bmax[0]};
+  cell_size = (max - min) / float(Size);
+
+  level_gap = std::max(header.walkableClimb, 0.5f);
+  // a little steeper than anything walkable, diagonally
+  max_step = 2.0f * std::max(cell_size.x, cell_size.y) + level_gap;
+
+  for (int i = 0; i < header.polyCount; ++i) {
+    dtPoly const& poly = tile.polys[i];
+    // off mesh connections don't have a detail mesh
+    if (poly.getType() == DT_POLYTYPE_OFFMESH_CONNECTION) {
+      continue;
+    }
+
+    dtPolyDetail const& detail = tile.detailMeshes[i];
+    for (int j = 0; j < detail.triCount; ++j) {
+      unsigned char const* tri = &tile.detailTris[(detail.triBase + j) * 4];
+      Rasterize(DetailVertex(tile, poly, detail, tri[0]),
+                DetailVertex(tile, poly, detail, tri[1]),
+                DetailVertex(tile, poly, detail, tri[2]));
+    }
+  }
+}
+
+void TileHeightGrid::Rasterize(float const* a, float const* b, float const* c)
+{
+  // back to game coordinates
+  vec3 const pa{a[2], a[0], a[1]};
+  vec3 const pb{b[2], b[0], b[1]};
+  vec3 const pc{c[2], c[0], c[1]};
+
+  float const det =
+    (pb.y - pc.y) * (pa.x - pc.x) + (pc.x - pb.x) * (pa.y - pc.y);
+  // vertical, nothing to stand on
+  if (std::abs(det) < 1e-6f) {
+    return;
+  }
+
+  // the cells whose centers are in the triangle's bounding box
+  vec2 const lo = (glm::min(pa.xy, glm::min(pb.xy, pc.xy)) - min) / cell_size;
+  vec2 const hi = (glm::max(pa.xy, glm::max(pb.xy, pc.xy)) - min) / cell_size;
+  int const x0 = std::max(0, int(std::ceil(lo.x - 0.5f)));
+  int const y0 = std::max(0, int(std::ceil(lo.y - 0.5f)));
+  int const x1 = std::min(Size - 1, int(std::floor(hi.x - 0.5f)));
+  int const y1 = std::min(Size - 1, int(std::floor(hi.y - 0.5f)));
+
+  // a little slack so centers on a shared edge land in both triangles
+  float const eps = -1e-4f;
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      vec2 const p = min + (vec2{float(x), float(y)} + 0.5f) * cell_size;
+
+      float const u =
+        ((pb.y - pc.y) * (p.x - pc.x) + (pc.x - pb.x) * (p.y - pc.y)) / det;
+      float const v =
+        ((pc.y - pa.y) * (p.x - pc.x) + (pa.x - pc.x) * (p.y - pc.y)) / det;
+      float const w = 1.0f - u - v;
+      if (u < eps || v < eps || w < eps) {
+        continue;
+      }
+
+      float const h = u * pa.z + v * pb.z + w * pc.z;
+      float& cell = heights[y * Size + x];
+      if (std::isnan(cell)) {
+        cell = h;
+      } else if (std::isfinite(cell) && std::abs(cell - h) > level_gap) {
+        cell = AmbiguousHeight;
+      }
+    }
+  }
+}
+
+bool TileHeightGrid::Contains(vec2 const& pos) const
+{
+  return pos.x >= min.x && pos.x <= max.x && pos.y >= min.y && pos.y <= max.y;
+}
+
+bool TileHeightGrid::Sample(vec2 const& pos, float& height) const
+{
+  if (!Contains(pos)) {
+    return false;
+  }
+
+  // relative to the cell centers, clamped to the edge cells at the border
+  vec2 const f = (pos - min) / cell_size - 0.5f;
+  int const x = std::clamp(int(std::floor(f.x)), 0, Size - 2);
+  int const y = std::clamp(int(std::floor(f.y)), 0, Size - 2);
+  float const tx = std::clamp(f.x - float(x), 0.0f, 1.0f);
+  float const ty = std::clamp(f.y - float(y), 0.0f, 1.0f);
+
+  float const h00 = heights[y * Size + x];
+  float const h10 = heights[y * Size + x + 1];
+  float const h01 = heights[(y + 1) * Size + x];
+  float const h11 = heights[(y + 1) * Size + x + 1];
+
+  // NaN and infinity both fail this
+  if (!std::isfinite(h00 + h10 + h01 + h11)) {
+    return false;
+  }
+
+  float const lo = std::min(std::min(h00, h10), std::min(h01, h11));
+  float const hi = std::max(std::max(h00, h10), std::max(h01, h11));
+  if (hi - lo > max_step) {
+    return false;
+  }
+
+  height = (h00 * (1.0f - tx) + h10 * tx) * (1.0f - ty) +
+           (h01 * (1.0f - tx) + h11 * tx) * ty;
+  return true;
+}
+
+int TileHeightGrid::GetWalkableCells() const
+{
+  return int(std::count_if(heights.begin(), heights.end(),
+                           [](float h) { return !std::isnan(h); }));
+}
+
+int TileHeightGrid::GetAmbiguousCells() const
+{
+  return int(std::count(heights.begin(), heights.end(), AmbiguousHeight));
+}
+
+namespace test
+{
+TEST_CASE("MMapManager::getGroundHeights matches the mesh on rolling hills")
+{
+  SyntheticTerrain terrain;
+  terrain.hill_height = 10.0f;
+  terrain.hill_wavelength = 120.0f;
+
+  fs::path const dir = SyntheticMMapDir("heights");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMap(terrain.map_id, terrain.first_tile));
+
+  dtNavMesh const* nav = mmap.GetNavMesh(terrain.map_id);
+  REQUIRE(nav != nullptr);
+  TileHeightGrid const grid{*nav->getTile(0)};
+  CHECK(grid.GetWalkableCells() > 9 * TileHeightGrid::Size *
+                                    TileHeightGrid::Size / 10);
+  CHECK(grid.GetAmbiguousCells() == 0);
+
+  // all over tile {32, 32}, i.e. game x and y in [-G, 0]
+  std::vector<vec3> positions;
+  for (float x = -520.0f; x < -10.0f; x += 37.0f) {
+    for (float y = -520.0f; y < -10.0f; y += 29.0f) {
+      positions.push_back(vec3{x, y, 0.0f});
+    }
+  }
+
+  std::vector<float> heights;
+  CHECK(mmap.getGroundHeights(terrain.map_id, positions, heights) ==
+        positions.size());
+  REQUIRE(heights.size() == positions.size());
+
+  for (size_t i = 0; i < positions.size(); ++i) {
+    vec3 const& pos = positions[i];
+    float exact = NoHeight;
+    REQUIRE(mmap.getExactGroundHeight(terrain.map_id, pos, exact));
+    CHECK(std::abs(heights[i] - exact) < 0.5f);
+    CHECK(std::abs(heights[i] - SyntheticGroundHeight(terrain, pos.xy)) <
+          1.0f);
+  }
+
+  // nothing loaded out here
+  float height;
+  CHECK(!mmap.getGroundHeight(terrain.map_id, vec3{1000.0f, 1000.0f, 0.0f},
+                              height));
+  CHECK(!mmap.getGroundHeight(terrain.map_id + 1, positions[0], height));
+
+  // and nothing once the tile is gone
+  REQUIRE(mmap.unloadMap(terrain.map_id, terrain.first_tile));
+  CHECK(!mmap.getGroundHeight(terrain.map_id, positions[0], height));
+}
+
+TEST_CASE("MMapManager::getGroundHeight picks the level nearest the hint")
+{
+  SyntheticTerrain terrain;
+  terrain.platforms = true;
+
+  fs::path const dir = SyntheticMMapDir("height_levels");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  REQUIRE(mmap.loadMap(terrain.map_id, terrain.first_tile));
+
+  dtNavMesh const* nav = mmap.GetNavMesh(terrain.map_id);
+  REQUIRE(nav != nullptr);
+  TileHeightGrid const grid{*nav->getTile(0)};
+  CHECK(grid.GetAmbiguousCells() > 0);
+
+  vec3 const top = SyntheticPlatformCenter(terrain, terrain.first_tile);
+
+  float height;
+  REQUIRE(mmap.getGroundHeight(terrain.map_id, top, height));
+  CHECK(std::abs(height - top.z) < 1.0f);
+
+  REQUIRE(mmap.getGroundHeight(
+    terrain.map_id, vec3{top.xy, terrain.ground_height + 1.0f}, height));
+  CHECK(std::abs(height - terrain.ground_height) < 1.0f);
+
+  // well away from the platform there's only the ground
+  vec3 const away{top.x, top.y + terrain.platform_size * 2.0f, 50.0f};
+  REQUIRE(grid.Sample(away.xy, height));
+  CHECK(std::abs(height - terrain.ground_height) < 0.5f);
+}
+
+TEST_CASE("benchmark ground heights, grid vs exact" *
+          doctest::test_suite("benchmark") * doctest::skip())
+{
+  SyntheticTerrain terrain;
+  terrain.first_tile = vec2i{31, 31};
+  terrain.tiles = vec2i{2, 2};
+  terrain.hill_height = 12.0f;
+  terrain.hill_wavelength = 200.0f;
+  terrain.platforms = true;
+
+  fs::path const dir = SyntheticMMapDir("heights_bench");
+  GenerateSyntheticMMaps(dir, terrain);
+
+  MMapManager mmap{dir};
+  for (int x = 0; x < terrain.tiles.x; ++x) {
+    for (int y = 0; y < terrain.tiles.y; ++y) {
+      REQUIRE(mmap.loadMap(terrain.map_id, terrain.first_tile + vec2i{x, y}));
+    }
+  }
+
+  // tiles {31, 31} .. {32, 32} cover game x and y in [-G, G]
+  float const g = MMAP_GRID_SIZE;
+  std::mt19937 rng{1234};
+  std::uniform_real_distribution<float> along{-0.95f * g, 0.95f * g};
+  std::vector<vec3> positions(10000);
+  for (auto& pos : positions) {
+    pos.x = along(rng);
+    pos.y = along(rng);
+    pos.z = SyntheticGroundHeight(terrain, pos.xy);
+  }
+
+  // builds the grids, untimed
+  std::vector<float> heights;
+  mmap.getGroundHeights(terrain.map_id, positions, heights);
+
+  double const grid_us = bench::TimeMicros(100, [&]() {
+    mmap.getGroundHeights(terrain.map_id, positions, heights);
+    bench::DoNotOptimize(heights[0]);
+  });
+  bench::Report("getGroundHeights 10000 positions", grid_us);
+
+  double const exact_us = bench::TimeMicros(10, [&]() {
+    for (size_t i = 0; i < positions.size(); ++i) {
+      mmap.getExactGroundHeight(terrain.map_id, positions[i], heights[i]);
+    }
+    bench::DoNotOptimize(heights[0]);
+  });
+  bench::Report("getExactGroundHeight x 10000", exact_us);
+}
+}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include <DetourNavMesh.h>
+
+#include "../wow_constants.hpp"
+
+namespace phlipbot
+{
+// Walkable heights over one nav mesh tile, sampled from its detail meshes on
+// a Size x Size grid, so a height lookup is a few array reads instead of a
+// poly search.
+//
+// Each cell holds the height of the mesh at its center, or nothing if the
+// center isn't over the mesh. Cells over more than one level (bridges,
+// platforms, caves) only remember that they're ambiguous; the caller needs
+// the exact poly height there.
+class TileHeightGrid {
+public:
+  // ~4.2 yards per cell on a full size tile
+  static constexpr int Size = 128;
+
+  explicit TileHeightGrid(dtMeshTile const& tile);
+
+  bool Contains(vec2 const& pos) const;
+
+  // Height at pos (game coordinates), interpolated between the four cells
+  // around it. False outside the tile, and wherever one of those cells is
+  // empty or ambiguous, or they're too far apart to be the same slope.
+  bool Sample(vec2 const& pos, float& height) const;
+
+  // number of cells over the mesh, and how many of those are ambiguous
+  int GetWalkableCells() const;
+  int GetAmbiguousCells() const;
+
+private:
+  void Rasterize(float const* a, float const* b, float const* c);
+
+  vec2 min;
+  vec2 max;
+  vec2 cell_size;
+  // two heights in a cell further apart than this are different levels
+  float level_gap;
+  // neighbouring cells further apart than this are across a ledge
+  float max_step;
+  // Size * Size, indexed by y * Size + x. NaN where there's no mesh, and
+  // infinity where there's more than one level.
+  std::vector<float> heights;
+};
+}
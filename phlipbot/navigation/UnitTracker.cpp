@@ -0,0 +1,255 @@
+#include "UnitTracker.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+
+#include <doctest.h>
+
+#include "MovementSim.hpp"
+
+using glm::dot;
+using glm::length;
+
+namespace
+{
+uint32_t const MovingFlags =
+  phlipbot::MovementFlags::Forward | phlipbot::MovementFlags::Backward |
+  phlipbot::MovementFlags::StrafeLeft | phlipbot::MovementFlags::StrafeRight;
+
+// positions closer than this haven't moved
+float const StillEpsilon = 1e-3f;
+}
+
+namespace phlipbot
+{
+UnitTracker::UnitTracker(ObjectManager& objmgr) noexcept : objmgr(objmgr) {}
+
+void UnitTracker::Track(Guid const guid) { units[guid]; }
+
+void UnitTracker::Untrack(Guid const guid) { units.erase(guid); }
+
+void UnitTracker::Update(float const dt)
+{
+  time += dt;
+
+  for (auto& pair : units) {
+    History& history = pair.second;
+
+    auto const o_obj = objmgr.GetObjByGuid(pair.first);
+    auto const* unit =
+      o_obj ? dynamic_cast<WowUnit const*>(o_obj.get()) : nullptr;
+    if (unit == nullptr) {
+      // out of sight, start over if it's back
+      history.count = 0;
+      continue;
+    }
+
+    CMovementData const* movement = unit->GetMovement();
+    history.samples[history.next] =
+      Sample{time, movement->position, movement->facing,
+             movement->move_flags, movement->current_speed};
+    history.next = (history.next + 1) % HistorySize;
+    if (history.count < HistorySize) {
+      ++history.count;
+    }
+  }
+}
+
+boost::optional<UnitTracker::Sample>
+UnitTracker::GetLatest(Guid const guid) const
+{
+  auto const it = units.find(guid);
+  if (it == units.end() || it->second.count == 0) {
+    return boost::none;
+  }
+  return it->second.Latest();
+}
+
+boost::optional<vec3> UnitTracker::GetVelocity(Guid const guid) const
+{
+  auto const it = units.find(guid);
+  if (it == units.end() || it->second.count == 0) {
+    return boost::none;
+  }
+  return EstimateVelocity(it->second);
+}
+
+vec3 UnitTracker::EstimateVelocity(History const& history) const
+{
+  Sample const& latest = history.Latest();
+
+  // stood still, whatever it was doing before
+  if (history.count < 2 ||
+      ((latest.move_flags & MovingFlags) == 0 &&
+       length(latest.position - history.Back(1).position) < StillEpsilon)) {
+    return vec3{0, 0, 0};
+  }
+
+  // least squares fit of position against time over the window
+  size_t n = 0;
+  float mean_t = 0.0f;
+  vec3 mean_p{0, 0, 0};
+  for (size_t i = 0; i < history.count; ++i) {
+    Sample const& sample = history.Back(i);
+    if (i >= 2 && latest.time - sample.time > window) {
+      break;
+    }
+    mean_t += sample.time;
+    mean_p += sample.position;
+    ++n;
+  }
+  mean_t /= static_cast<float>(n);
+  mean_p = mean_p / static_cast<float>(n);
+
+  float var_t = 0.0f;
+  vec3 cov{0, 0, 0};
+  for (size_t i = 0; i < n; ++i) {
+    Sample const& sample = history.Back(i);
+    float const dt = sample.time - mean_t;
+    var_t += dt * dt;
+    cov += dt * (sample.position - mean_p);
+  }
+  if (var_t <= 0.0f) {
+    return vec3{0, 0, 0};
+  }
+  vec3 velocity = cov / var_t;
+
+  // no faster than the client says it's going, when it says
+  float const speed = length(velocity);
+  if (latest.speed > 0.0f && speed > latest.speed) {
+    velocity *= latest.speed / speed;
+  }
+  return velocity;
+}
+
+boost::optional<vec3> UnitTracker::PredictIntercept(Guid const guid,
+                                                    vec3 const& from,
+                                                    float const speed) const
+{
+  auto const it = units.find(guid);
+  if (it == units.end() || it->second.count == 0) {
+    return boost::none;
+  }
+
+  vec3 const pos = it->second.Latest().position;
+  vec3 const velocity = EstimateVelocity(it->second);
+
+  // the soonest t where |pos + velocity * t - from| = speed * t, in 2D
+  vec2 const d = pos.xy - from.xy;
+  vec2 const v = velocity.xy;
+  float const a = dot(v, v) - speed * speed;
+  float const b = 2.0f * dot(d, v);
+  float const c = dot(d, d);
+
+  float t = max_lead_time;
+  if (std::abs(a) < 1e-6f) {
+    // just as fast as us, only if it's coming our way
+    if (b < 0.0f) {
+      t = -c / b;
+    }
+  } else {
+    float const disc = b * b - 4.0f * a * c;
+    if (disc >= 0.0f) {
+      float const root = std::sqrt(disc);
+      float const t1 = (-b - root) / (2.0f * a);
+      float const t2 = (-b + root) / (2.0f * a);
+      float const t_min = std::min(t1, t2);
+      float const t_max = std::max(t1, t2);
+      if (t_min >= 0.0f) {
+        t = t_min;
+      } else if (t_max >= 0.0f) {
+        t = t_max;
+      }
+    }
+  }
+
+  return pos + velocity * std::clamp(t, 0.0f, max_lead_time);
+}
+
+namespace test
+{
+namespace
+{
+float const Step = 1.0f / 32.0f;
+
+void Move(SimUnit& unit, vec3 const& velocity, int const steps,
+          UnitTracker& tracker)
+{
+  CMovementData& movement = *unit.GetMovement();
+  movement.move_flags =
+    length(velocity) > 0.0f ? MovementFlags::Forward : MovementFlags::Idle;
+  movement.current_speed = length(velocity);
+  for (int i = 0; i < steps; ++i) {
+    movement.position += velocity * Step;
+    tracker.Update(Step);
+  }
+}
+}
+
+TEST_CASE("UnitTracker estimates a unit's velocity")
+{
+  SimObjectManager objmgr{0};
+  SimUnit& unit = objmgr.AddSimUnit(100);
+  unit.GetMovement()->position = vec3{10.0f, 20.0f, 0.0f};
+
+  UnitTracker tracker{objmgr};
+  CHECK(!tracker.GetVelocity(100));
+  tracker.Track(100);
+  tracker.Update(Step);
+  REQUIRE(tracker.GetVelocity(100));
+  CHECK(length(*tracker.GetVelocity(100)) == doctest::Approx(0.0f));
+
+  vec3 const run{7.0f, -3.0f, 0.0f};
+  Move(unit, run, 20, tracker);
+  vec3 const velocity = *tracker.GetVelocity(100);
+  CHECK(velocity.x == doctest::Approx(run.x).epsilon(0.01));
+  CHECK(velocity.y == doctest::Approx(run.y).epsilon(0.01));
+
+  // stopping is caught straight away
+  Move(unit, vec3{0, 0, 0}, 1, tracker);
+  CHECK(length(*tracker.GetVelocity(100)) == doctest::Approx(0.0f));
+
+  // and a turn within a window
+  Move(unit, vec3{0, 7.0f, 0}, 20, tracker);
+  CHECK(tracker.GetVelocity(100)->y == doctest::Approx(7.0f).epsilon(0.01));
+
+  // forgotten once it's out of sight
+  objmgr.RemoveSimUnit(100);
+  tracker.Update(Step);
+  CHECK(tracker.IsTracking(100));
+  CHECK(!tracker.GetLatest(100));
+}
+
+TEST_CASE("UnitTracker predicts where to intercept a unit")
+{
+  SimObjectManager objmgr{0};
+  SimUnit& unit = objmgr.AddSimUnit(100);
+  unit.GetMovement()->position = vec3{0.0f, 10.0f, 0.0f};
+  UnitTracker tracker{objmgr};
+  tracker.Track(100);
+
+  // standing still, go to where it is
+  tracker.Update(Step);
+  vec3 const from{0, 0, 0};
+  vec3 intercept = *tracker.PredictIntercept(100, from, 7.0f);
+  CHECK(intercept.y == doctest::Approx(10.0f));
+
+  // running across in front of us, cut it off
+  Move(unit, vec3{3.0f, 0, 0}, 16, tracker);
+  vec3 const pos = unit.GetMovement()->position;
+  intercept = *tracker.PredictIntercept(100, from, 7.0f);
+  CHECK(intercept.x > pos.x);
+  float const t = (intercept.x - pos.x) / 3.0f;
+  CHECK(length(intercept.xy - from.xy) == doctest::Approx(7.0f * t));
+
+  // running away faster than us, lead it as far as we'll go
+  Move(unit, vec3{0, 9.0f, 0}, 16, tracker);
+  vec3 const away = unit.GetMovement()->position;
+  intercept = *tracker.PredictIntercept(100, from, 7.0f);
+  CHECK(intercept.y ==
+        doctest::Approx(away.y + 9.0f * tracker.max_lead_time));
+}
+}
+}
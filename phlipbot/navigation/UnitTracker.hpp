@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <unordered_map>
+
+#include <boost/optional.hpp>
+
+#include "../ObjectManager.hpp"
+
+namespace phlipbot
+{
+// Where the tracked units have been lately, and so where they're going.
+//
+// Update() once a frame samples every tracked unit's movement data into a
+// short history. Velocity is the least squares fit of the positions over
+// the last window seconds, so a unit that stops or turns is caught up with
+// within a window. Units that go out of sight are forgotten, and picked up
+// again from scratch if they come back.
+struct UnitTracker {
+  // at 30 Hz, about half a second
+  static size_t const HistorySize = 16;
+
+  struct Sample {
+    float time;
+    vec3 position;
+    float facing;
+    uint32_t move_flags;
+    float speed;
+  };
+
+  explicit UnitTracker(ObjectManager& objmgr) noexcept;
+
+  void Track(Guid const guid);
+  void Untrack(Guid const guid);
+  void Clear() { units.clear(); }
+  bool IsTracking(Guid const guid) const { return units.count(guid) != 0; }
+
+  void Update(float const dt);
+
+  // as of the last Update, none if the unit isn't tracked or wasn't seen
+  boost::optional<Sample> GetLatest(Guid const guid) const;
+  boost::optional<vec3> GetVelocity(Guid const guid) const;
+
+  // Where to run, at speed yards per second from from, to meet the unit if
+  // it keeps going the way it is. If it can't be caught up with, or not for
+  // a while, where it'll be max_lead_time seconds from now.
+  boost::optional<vec3> PredictIntercept(Guid const guid,
+                                         vec3 const& from,
+                                         float const speed) const;
+
+  float window{0.5f};
+  float max_lead_time{3.0f};
+
+private:
+  struct History {
+    std::array<Sample, HistorySize> samples;
+    size_t count{0};
+    size_t next{0};
+
+    Sample const& Latest() const
+    {
+      return samples[(next + HistorySize - 1) % HistorySize];
+    }
+    // i = 0 is the latest, i < count
+    Sample const& Back(size_t const i) const
+    {
+      return samples[(next + HistorySize - 1 - i) % HistorySize];
+    }
+  };
+
+  vec3 EstimateVelocity(History const& history) const;
+
+  ObjectManager& objmgr;
+  float time{0.0f};
+  std::unordered_map<Guid, History> units;
+};
+}